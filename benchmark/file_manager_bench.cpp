@@ -0,0 +1,762 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include <benchmark/benchmark.h>
+
+#include "utilities/conversion/convert_string.h"
+
+#include "container/container.h"
+#include "values/numeric_value.h"
+#include "values/string_value.h"
+
+#include "fmt/format.h"
+
+#include "checksum.h"
+#include "chunk_cipher.h"
+#include "chunk_frame.h"
+#include "file_manager.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace container_module;
+using namespace utility_module;
+
+// run with --benchmark_out=<file> --benchmark_out_format=json to keep the
+// results; the run_file_manager_bench target does that
+
+// every heap allocation of the process is counted so that the cost of
+// building transfer_condition messages can be reported per message
+atomic<size_t> allocation_count{ 0 };
+
+void* operator new(size_t size)
+{
+	allocation_count.fetch_add(1, memory_order_relaxed);
+
+	void* target = malloc(size == 0 ? 1 : size);
+	if (target == nullptr)
+	{
+		throw bad_alloc();
+	}
+
+	return target;
+}
+
+void operator delete(void* target) noexcept { free(target); }
+
+void operator delete(void* target, size_t) noexcept { free(target); }
+
+namespace
+{
+	// the layout file_manager used before transfer_table: five parallel
+	// maps looked up one after another on every received() call
+	class legacy_file_manager
+	{
+	public:
+		bool set(const wstring& indication_id,
+				 const wstring& source_id,
+				 const wstring& source_sub_id,
+				 const vector<wstring>& file_list)
+		{
+			scoped_lock<mutex> guard(_mutex);
+
+			auto target = _transferring_list.find(indication_id);
+			if (target != _transferring_list.end())
+			{
+				return false;
+			}
+
+			_transferring_list.insert({ indication_id, file_list });
+			_transferring_ids.insert(
+				{ indication_id, { source_id, source_sub_id } });
+			_transferred_list.insert({ indication_id, vector<wstring>() });
+			_failed_list.insert({ indication_id, vector<wstring>() });
+			_transferred_percentage.insert({ indication_id, 0 });
+
+			return true;
+		}
+
+		shared_ptr<value_container> received(const wstring& indication_id,
+											 const wstring& file_path)
+		{
+			scoped_lock<mutex> guard(_mutex);
+
+			auto ids = _transferring_ids.find(indication_id);
+			if (ids == _transferring_ids.end())
+			{
+				return nullptr;
+			}
+
+			auto source = _transferring_list.find(indication_id);
+			if (source == _transferring_list.end())
+			{
+				return nullptr;
+			}
+
+			auto target = _transferred_list.find(indication_id);
+			if (target == _transferred_list.end())
+			{
+				return nullptr;
+			}
+
+			auto fail = _failed_list.find(indication_id);
+			if (fail == _failed_list.end())
+			{
+				return nullptr;
+			}
+
+			auto percentage = _transferred_percentage.find(indication_id);
+			if (percentage == _transferred_percentage.end())
+			{
+				return nullptr;
+			}
+
+			if (file_path.empty())
+			{
+				fail->second.push_back(file_path);
+			}
+			else
+			{
+				target->second.push_back(file_path);
+			}
+
+			unsigned short temp
+				= (unsigned short)(((double)target->second.size()
+									/ (double)source->second.size())
+								   * 100);
+			if (percentage->second == temp)
+			{
+				return nullptr;
+			}
+
+			percentage->second = temp;
+
+			auto message = make_shared<value_container>(
+				std::get<0>(convert_string::to_string(ids->second.first))
+					.value_or(""),
+				std::get<0>(convert_string::to_string(ids->second.second))
+					.value_or(""),
+				"transfer_condition",
+				vector<shared_ptr<value>>{
+					make_shared<string_value>(
+						"indication_id",
+						std::get<0>(convert_string::to_string(indication_id))
+							.value_or("")),
+					make_shared<numeric_value<unsigned short,
+											  value_types::ushort_value>>(
+						"percentage", temp) });
+
+			if (temp == 100)
+			{
+				_transferring_list.erase(source);
+				_transferring_ids.erase(ids);
+				_transferred_list.erase(target);
+				_failed_list.erase(fail);
+				_transferred_percentage.erase(percentage);
+			}
+
+			return message;
+		}
+
+	private:
+		mutex _mutex;
+		map<wstring, unsigned short> _transferred_percentage;
+		map<wstring, pair<wstring, wstring>> _transferring_ids;
+		map<wstring, vector<wstring>> _transferring_list;
+		map<wstring, vector<wstring>> _transferred_list;
+		map<wstring, vector<wstring>> _failed_list;
+	};
+
+	vector<wstring> widen(const vector<string>& source)
+	{
+		vector<wstring> result;
+		result.reserve(source.size());
+		for (auto& item : source)
+		{
+			result.push_back(
+				std::get<0>(convert_string::to_wstring(item)).value_or(L""));
+		}
+
+		return result;
+	}
+
+	vector<string> make_ids(const int64_t& count)
+	{
+		vector<string> result;
+		result.reserve(count);
+		for (int64_t index = 0; index < count; ++index)
+		{
+			result.push_back(fmt::format("indication_{:08}_{:08x}", index,
+										 index * 2654435761u));
+		}
+
+		return result;
+	}
+
+	vector<string> make_files(const int64_t& count)
+	{
+		vector<string> result;
+		result.reserve(count);
+		for (int64_t index = 0; index < count; ++index)
+		{
+			result.push_back(
+				fmt::format("/data/target/folder/file_{}", index));
+		}
+
+		return result;
+	}
+
+	file_manager_options make_options(const bool& emitting,
+									  const bool& statistics = false)
+	{
+		file_manager_options options;
+		options.shard_count = 16;
+		// without emission only completion builds a message
+		if (!emitting)
+		{
+			options.notification_step = 101;
+		}
+		// latencies are recorded on every receipt, while the snapshot only
+		// runs once a second on the maintenance thread
+		if (statistics)
+		{
+			options.statistics_interval = chrono::milliseconds(1000);
+		}
+
+		return options;
+	}
+
+	// transfers x files per transfer, up to a million entries per run
+	void transfer_sizes(benchmark::internal::Benchmark* target)
+	{
+		target->ArgNames({ "transfers", "files" });
+		for (int64_t transfers : { 1, 1000, 1000000 })
+		{
+			for (int64_t files : { 1, 100, 1000000 })
+			{
+				if (transfers * files <= 1000000)
+				{
+					target->Args({ transfers, files });
+				}
+			}
+		}
+	}
+}
+
+static void set_transfers(benchmark::State& state)
+{
+	const auto ids = make_ids(state.range(0));
+	const auto files = make_files(state.range(1));
+
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		auto manager = make_unique<file_manager>(make_options(true));
+		state.ResumeTiming();
+
+		for (auto& id : ids)
+		{
+			benchmark::DoNotOptimize(
+				manager->set(id, "source_id", "source_sub_id", files));
+		}
+
+		state.PauseTiming();
+		manager.reset();
+		state.ResumeTiming();
+	}
+
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(set_transfers)
+	->Name("set")
+	->Apply(transfer_sizes)
+	->Unit(benchmark::kMillisecond);
+
+// every file of every transfer is received once per iteration, leaving out
+// the last one so that no transfer completes
+template <bool emitting, bool statistics = false>
+static void receive_files(benchmark::State& state)
+{
+	const auto ids = make_ids(state.range(0));
+	const auto files = make_files(state.range(1) + 1);
+
+	int64_t messages = 0;
+	size_t allocations = 0;
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		auto manager
+			= make_unique<file_manager>(make_options(emitting, statistics));
+		for (auto& id : ids)
+		{
+			manager->set(id, "source_id", "source_sub_id", files);
+		}
+		const size_t before = allocation_count.load(memory_order_relaxed);
+		state.ResumeTiming();
+
+		for (auto& id : ids)
+		{
+			for (int64_t file = 0; file < state.range(1); ++file)
+			{
+				messages += manager->received(id, files[file]) != nullptr;
+			}
+		}
+
+		state.PauseTiming();
+		allocations += allocation_count.load(memory_order_relaxed) - before;
+		manager.reset();
+		state.ResumeTiming();
+	}
+
+	state.SetItemsProcessed(state.iterations() * state.range(0)
+							* state.range(1));
+	state.counters["messages"] = benchmark::Counter(
+		(double)messages, benchmark::Counter::kAvgIterations);
+	state.counters["allocations_per_message"]
+		= messages == 0 ? 0.0 : (double)allocations / (double)messages;
+}
+BENCHMARK(receive_files<true>)
+	->Name("received/emitting")
+	->Apply(transfer_sizes)
+	->Unit(benchmark::kMillisecond);
+BENCHMARK(receive_files<false>)
+	->Name("received/silent")
+	->Apply(transfer_sizes)
+	->Unit(benchmark::kMillisecond);
+BENCHMARK(receive_files<false, true>)
+	->Name("received/statistics")
+	->Apply(transfer_sizes)
+	->Unit(benchmark::kMillisecond);
+
+// received/emitting through the five map layout file_manager replaced,
+// driven with wide strings as the servers did then
+static void receive_legacy(benchmark::State& state)
+{
+	const auto ids = widen(make_ids(state.range(0)));
+	const auto files = widen(make_files(state.range(1) + 1));
+
+	int64_t messages = 0;
+	size_t allocations = 0;
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		auto manager = make_unique<legacy_file_manager>();
+		for (auto& id : ids)
+		{
+			manager->set(id, L"source_id", L"source_sub_id", files);
+		}
+		const size_t before = allocation_count.load(memory_order_relaxed);
+		state.ResumeTiming();
+
+		for (int64_t file = 0; file < state.range(1); ++file)
+		{
+			for (auto& id : ids)
+			{
+				messages += manager->received(id, files[file]) != nullptr;
+			}
+		}
+
+		state.PauseTiming();
+		allocations += allocation_count.load(memory_order_relaxed) - before;
+		manager.reset();
+		state.ResumeTiming();
+	}
+
+	state.SetItemsProcessed(state.iterations() * state.range(0)
+							* state.range(1));
+	state.counters["messages"] = benchmark::Counter(
+		(double)messages, benchmark::Counter::kAvgIterations);
+	state.counters["allocations_per_message"]
+		= messages == 0 ? 0.0 : (double)allocations / (double)messages;
+}
+BENCHMARK(receive_legacy)
+	->Name("received/legacy")
+	->ArgNames({ "transfers", "files" })
+	->Args({ 1000, 100 })
+	->Args({ 10000, 100 })
+	->Unit(benchmark::kMillisecond);
+
+// the last file of each transfer completes it, so this is the completion
+// message plus the release of the record
+static void clear_transfers(benchmark::State& state)
+{
+	const auto ids = make_ids(state.range(0));
+	const auto files = make_files(state.range(1));
+
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		auto manager = make_unique<file_manager>(make_options(false));
+		for (auto& id : ids)
+		{
+			manager->set(id, "source_id", "source_sub_id", files);
+			for (int64_t file = 0; file + 1 < state.range(1); ++file)
+			{
+				manager->received(id, files[file]);
+			}
+		}
+		state.ResumeTiming();
+
+		for (auto& id : ids)
+		{
+			benchmark::DoNotOptimize(manager->received(id, files.back()));
+		}
+
+		state.PauseTiming();
+		manager.reset();
+		state.ResumeTiming();
+	}
+
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(clear_transfers)
+	->Name("clear")
+	->ArgNames({ "transfers", "files" })
+	->Args({ 1, 1 })
+	->Args({ 1000, 1 })
+	->Args({ 1000, 100 })
+	->Args({ 1000000, 1 })
+	->Unit(benchmark::kMillisecond);
+
+// the same load as received/emitting through other policy combinations
+template <typename manager_type>
+static void receive_with_policies(benchmark::State& state)
+{
+	const auto ids = make_ids(1000);
+	const auto files = make_files(101);
+
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		auto manager = make_unique<manager_type>(make_options(true));
+		for (auto& id : ids)
+		{
+			manager->set(id, "source_id", "source_sub_id", files);
+		}
+		state.ResumeTiming();
+
+		for (auto& id : ids)
+		{
+			for (size_t file = 0; file + 1 < files.size(); ++file)
+			{
+				benchmark::DoNotOptimize(manager->received(id, files[file]));
+			}
+		}
+
+		state.PauseTiming();
+		manager.reset();
+		state.ResumeTiming();
+	}
+
+	state.SetItemsProcessed(state.iterations() * 1000 * 100);
+}
+BENCHMARK(receive_with_policies<basic_file_manager<shared_locking,
+												   transfer_table,
+												   coalesced_notification>>)
+	->Name("policies/shared/table/coalesced")
+	->Unit(benchmark::kMillisecond);
+BENCHMARK(receive_with_policies<basic_file_manager<exclusive_locking,
+												   transfer_table,
+												   coalesced_notification>>)
+	->Name("policies/exclusive/table/coalesced")
+	->Unit(benchmark::kMillisecond);
+BENCHMARK(receive_with_policies<basic_file_manager<shared_locking,
+												   transfer_map,
+												   coalesced_notification>>)
+	->Name("policies/shared/map/coalesced")
+	->Unit(benchmark::kMillisecond);
+BENCHMARK(receive_with_policies<basic_file_manager<shared_locking,
+												   transfer_table,
+												   completion_notification>>)
+	->Name("policies/shared/table/completion")
+	->Unit(benchmark::kMillisecond);
+
+// workers share one manager and each receives the files of its own slice
+// of the transfers, which is how the servers' receiving threads use it.
+// one shard against many shows what the sharding buys under contention.
+static void receive_concurrently(benchmark::State& state)
+{
+	static unique_ptr<file_manager> manager;
+	static vector<string> ids;
+	static vector<string> files;
+
+	const int64_t transfers = state.range(0);
+	const int64_t file_count = state.range(1);
+
+	if (state.thread_index() == 0)
+	{
+		ids = make_ids(transfers);
+		files = make_files(file_count + 1);
+		auto options = make_options(true);
+		options.shard_count = (unsigned short)state.range(2);
+		manager = make_unique<file_manager>(options);
+		for (auto& id : ids)
+		{
+			manager->set(id, "source_id", "source_sub_id", files);
+		}
+	}
+
+	const int64_t threads = state.threads();
+	int64_t file = 0;
+	int64_t processed = 0;
+	for (auto _ : state)
+	{
+		for (int64_t index = state.thread_index(); index < transfers;
+			 index += threads)
+		{
+			benchmark::DoNotOptimize(manager->received(ids[index], files[file]));
+		}
+
+		// files are marked once, so rounds beyond the file count measure
+		// the rejection of repeated notifications
+		file = (file + 1) % file_count;
+		processed += (transfers - state.thread_index() + threads - 1) / threads;
+	}
+
+	state.SetItemsProcessed(processed);
+
+	if (state.thread_index() == 0)
+	{
+		manager.reset();
+		ids.clear();
+		files.clear();
+	}
+}
+BENCHMARK(receive_concurrently)
+	->Name("received/threads")
+	->ArgNames({ "transfers", "files", "shards" })
+	->Args({ 1000, 1000, 1 })
+	->Args({ 1000, 1000, 16 })
+	->Args({ 100000, 10, 1 })
+	->Args({ 100000, 10, 16 })
+	->ThreadRange(1, 64)
+	->UseRealTime();
+
+// restart cost of one transfer with half of its files received, replayed
+// from the journal or from the snapshot folded from it on the first start
+template <bool snapshot> static void replay_journal(benchmark::State& state)
+{
+	const filesystem::path directory
+		= filesystem::temp_directory_path() / "file_manager_bench";
+	const auto files = make_files(state.range(0));
+
+	file_manager_options options;
+	options.journal_path = (directory / "transfers").string();
+
+	auto prepare = [&]()
+	{
+		filesystem::remove_all(directory);
+		filesystem::create_directories(directory);
+
+		file_manager manager(options);
+		manager.set("indication_id", "source_id", "source_sub_id", files);
+		for (size_t index = 0; index < files.size() / 2; ++index)
+		{
+			manager.received("indication_id", files[index]);
+		}
+	};
+
+	if (snapshot)
+	{
+		prepare();
+		file_manager folding(options);
+	}
+
+	for (auto _ : state)
+	{
+		if (!snapshot)
+		{
+			state.PauseTiming();
+			prepare();
+			state.ResumeTiming();
+		}
+
+		file_manager manager(options);
+		benchmark::DoNotOptimize(&manager);
+	}
+
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	filesystem::remove_all(directory);
+}
+BENCHMARK(replay_journal<false>)
+	->Name("replay/journal")
+	->ArgName("files")
+	->Arg(1000)
+	->Arg(1000000)
+	->Unit(benchmark::kMillisecond);
+BENCHMARK(replay_journal<true>)
+	->Name("replay/snapshot")
+	->ArgName("files")
+	->Arg(1000)
+	->Arg(1000000)
+	->Unit(benchmark::kMillisecond);
+
+// the CPU work of one buffered chunk, as file_sender does it per chunk
+// with verify on, with and without encryption. per_core is the rate of
+// one thread, so the runs over more threads show how it holds up as
+// every core encrypts.
+template <bool encrypted> static void frame_chunks(benchmark::State& state)
+{
+	static unique_ptr<chunk_cipher> cipher;
+
+	const size_t chunk_size = (size_t)state.range(0);
+	if (state.thread_index() == 0)
+	{
+		cipher = make_unique<chunk_cipher>("benchmark_connection_key");
+	}
+
+	vector<char> source(chunk_size);
+	for (size_t index = 0; index < source.size(); ++index)
+	{
+		source[index] = (char)(index * 2654435761u >> 13);
+	}
+
+	chunk_header header;
+	header.indication_id = "indication";
+	header.file_path = "/data/target/folder/file";
+	header.file_size = chunk_size;
+	header.original_size = (uint32_t)chunk_size;
+	header.flags = chunk_header::checked;
+
+	vector<char> payload;
+	vector<char> frame;
+	for (auto _ : state)
+	{
+		payload.assign(source.begin(), source.end());
+		header.checksum = crc32c(payload.data(), payload.size());
+		if (encrypted && !cipher->encrypt(payload, header))
+		{
+			state.SkipWithError("cannot encrypt");
+			break;
+		}
+
+		header.size = (uint32_t)payload.size();
+		frame.clear();
+		encode_header(header, frame);
+		benchmark::DoNotOptimize(frame.data());
+		benchmark::DoNotOptimize(payload.data());
+	}
+
+	const int64_t bytes = (int64_t)state.iterations() * (int64_t)chunk_size;
+	state.SetBytesProcessed(bytes);
+	state.counters["per_core"] = benchmark::Counter(
+		(double)bytes,
+		benchmark::Counter::kIsRate | benchmark::Counter::kAvgThreads,
+		benchmark::Counter::kIs1024);
+	if (encrypted)
+	{
+		state.SetLabel(chunk_cipher::implementation());
+	}
+
+	if (state.thread_index() == 0)
+	{
+		cipher.reset();
+	}
+}
+BENCHMARK(frame_chunks<false>)
+	->Name("chunks/plain")
+	->ArgName("chunk_size")
+	->Arg(64 << 10)
+	->Arg(1 << 20)
+	->Arg(4 << 20)
+	->ThreadRange(1, 64)
+	->UseRealTime();
+BENCHMARK(frame_chunks<true>)
+	->Name("chunks/encrypted")
+	->ArgName("chunk_size")
+	->Arg(64 << 10)
+	->Arg(1 << 20)
+	->Arg(4 << 20)
+	->ThreadRange(1, 64)
+	->UseRealTime();
+
+// the receiving side, which decrypts every chunk before its checksum
+static void open_chunks(benchmark::State& state)
+{
+	static unique_ptr<chunk_cipher> cipher;
+	static vector<char> sealed;
+	static chunk_header header;
+
+	const size_t chunk_size = (size_t)state.range(0);
+	if (state.thread_index() == 0)
+	{
+		cipher = make_unique<chunk_cipher>("benchmark_connection_key");
+		sealed.assign(chunk_size, 'x');
+		header.indication_id = "indication";
+		header.file_path = "/data/target/folder/file";
+		cipher->encrypt(sealed, header);
+	}
+
+	vector<char> payload;
+	for (auto _ : state)
+	{
+		payload.assign(sealed.begin(), sealed.end());
+		if (!cipher->decrypt(payload, header))
+		{
+			state.SkipWithError("cannot decrypt");
+			break;
+		}
+
+		benchmark::DoNotOptimize(crc32c(payload.data(), payload.size()));
+	}
+
+	const int64_t bytes = (int64_t)state.iterations() * (int64_t)chunk_size;
+	state.SetBytesProcessed(bytes);
+	state.counters["per_core"] = benchmark::Counter(
+		(double)bytes,
+		benchmark::Counter::kIsRate | benchmark::Counter::kAvgThreads,
+		benchmark::Counter::kIs1024);
+
+	if (state.thread_index() == 0)
+	{
+		cipher.reset();
+		sealed.clear();
+	}
+}
+BENCHMARK(open_chunks)
+	->Name("chunks/decrypted")
+	->ArgName("chunk_size")
+	->Arg(64 << 10)
+	->Arg(1 << 20)
+	->Arg(4 << 20)
+	->ThreadRange(1, 64)
+	->UseRealTime();
+
+BENCHMARK_MAIN();
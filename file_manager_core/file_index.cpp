@@ -0,0 +1,225 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+
+#include "file_index.h"
+
+#include <bit>
+#include <functional>
+
+constexpr uint64_t empty_slot = 0;
+constexpr uint64_t received_state = 1;
+constexpr uint64_t failed_state = 2;
+
+file_index::file_index(void) : _mask(0), _states(nullptr) {}
+
+file_index::file_index(const vector<string>& file_list)
+	: file_index(path_manifest(file_list))
+{
+}
+
+file_index::file_index(path_manifest&& file_list, vector<uint32_t>* positions)
+	: _mask(0), _file_list(std::move(file_list)), _states(nullptr)
+{
+	allocate(_file_list.size());
+
+	bool repeated = false;
+	_file_list.for_each([&](const uint32_t& index, string_view file_path)
+						{ repeated = !insert(file_path, index) || repeated; });
+
+	if (positions != nullptr)
+	{
+		positions->resize(_file_list.size());
+		for (uint32_t index = 0; index < _file_list.size(); ++index)
+		{
+			(*positions)[index] = index;
+		}
+	}
+
+	// repeated entries would never be marked, so only the first one counts.
+	// they are rare enough to pay for a second pass over a compacted list.
+	if (repeated)
+	{
+		path_manifest unique;
+		_file_list.for_each(
+			[&](const uint32_t& index, string_view file_path)
+			{
+				const uint32_t first = find(file_path);
+				if (first == index)
+				{
+					unique.push_back(file_path);
+				}
+
+				if (positions != nullptr)
+				{
+					(*positions)[index] = first == index
+											  ? unique.size() - 1
+											  : (*positions)[first];
+				}
+			});
+		unique.shrink_to_fit();
+
+		_file_list = std::move(unique);
+		allocate(_file_list.size());
+		_file_list.for_each([&](const uint32_t& index, string_view file_path)
+							{ insert(file_path, index); });
+	}
+
+	size_t words = ((size_t)_file_list.size() + 31) / 32;
+	_states = make_unique<atomic<uint64_t>[]>(words);
+	for (size_t word = 0; word < words; ++word)
+	{
+		_states[word].store(0, memory_order_relaxed);
+	}
+}
+
+file_index::~file_index(void) {}
+
+uint32_t file_index::find(string_view file_path) const
+{
+	if (_slots.empty())
+	{
+		return npos;
+	}
+
+	size_t hash = std::hash<string_view>{}(file_path);
+	uint64_t tag = (uint64_t)hash >> 32;
+
+	for (uint64_t slot = hash & _mask;; slot = (slot + 1) & _mask)
+	{
+		uint64_t entry = _slots[slot];
+		if (entry == empty_slot)
+		{
+			return npos;
+		}
+
+		uint32_t index = (uint32_t)(entry & UINT32_MAX) - 1;
+		if ((entry >> 32) == tag && _file_list.equals(index, file_path))
+		{
+			return index;
+		}
+	}
+}
+
+bool file_index::mark(const uint32_t& index)
+{
+	return settle(index, received_state);
+}
+
+bool file_index::fail(const uint32_t& index)
+{
+	return settle(index, failed_state);
+}
+
+bool file_index::marked(const uint32_t& index) const
+{
+	return state(index) == received_state;
+}
+
+bool file_index::failed(const uint32_t& index) const
+{
+	return state(index) == failed_state;
+}
+
+bool file_index::settled(const uint32_t& index) const
+{
+	return state(index) != 0;
+}
+
+string file_index::path(const uint32_t& index) const
+{
+	return _file_list.path(index);
+}
+
+const path_manifest& file_index::paths(void) const { return _file_list; }
+
+uint32_t file_index::size(void) const { return _file_list.size(); }
+
+void file_index::allocate(const uint32_t& count)
+{
+	// at most half of the slots are used to keep probe sequences short
+	uint64_t capacity = bit_ceil((uint64_t)count * 2);
+	if (capacity < 16)
+	{
+		capacity = 16;
+	}
+
+	_mask = capacity - 1;
+	_slots.assign(capacity, empty_slot);
+}
+
+bool file_index::insert(string_view file_path, const uint32_t& index)
+{
+	size_t hash = std::hash<string_view>{}(file_path);
+	uint64_t tag = (uint64_t)hash >> 32;
+
+	uint64_t slot = hash & _mask;
+	for (; _slots[slot] != empty_slot; slot = (slot + 1) & _mask)
+	{
+		uint32_t other = (uint32_t)(_slots[slot] & UINT32_MAX) - 1;
+		if ((_slots[slot] >> 32) == tag && _file_list.equals(other, file_path))
+		{
+			return false;
+		}
+	}
+
+	_slots[slot] = (tag << 32) | ((uint64_t)index + 1);
+
+	return true;
+}
+
+bool file_index::settle(const uint32_t& index, const uint64_t& state)
+{
+	const unsigned shift = (index & 31) * 2;
+	auto& word = _states[index >> 5];
+
+	// one exchange decides between a failure and a success racing on the
+	// same file, so it never ends up counted as both
+	uint64_t current = word.load(memory_order_acquire);
+	do
+	{
+		if ((current >> shift & 3) != 0)
+		{
+			return false;
+		}
+	} while (!word.compare_exchange_weak(current, current | (state << shift),
+										 memory_order_acq_rel,
+										 memory_order_acquire));
+
+	return true;
+}
+
+uint64_t file_index::state(const uint32_t& index) const
+{
+	return _states[index >> 5].load(memory_order_acquire) >> ((index & 31) * 2)
+		   & 3;
+}
@@ -0,0 +1,94 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "path_manifest.h"
+
+using namespace std;
+
+// membership index over the file list of one transfer. every slot packs the
+// upper half of the path hash with the position of the path in the list, so
+// a million paths cost 16 MB of slots plus two bits each for the settled
+// state, and mismatching probes rarely need a string comparison. the paths
+// themselves stay front coded in a path_manifest.
+class file_index
+{
+public:
+	file_index(void);
+	file_index(const vector<string>& file_list);
+	// repeated paths are dropped, so positions, when given, receives the
+	// position in the index of every path of file_list
+	file_index(path_manifest&& file_list,
+			   vector<uint32_t>* positions = nullptr);
+	~file_index(void);
+
+	file_index(file_index&& other) = default;
+	file_index& operator=(file_index&& other) = default;
+
+public:
+	static constexpr uint32_t npos = UINT32_MAX;
+
+	uint32_t find(string_view file_path) const;
+	// a file settles once, either received or failed, so both return false
+	// when it was settled before
+	bool mark(const uint32_t& index);
+	bool fail(const uint32_t& index);
+	bool marked(const uint32_t& index) const;
+	bool failed(const uint32_t& index) const;
+	bool settled(const uint32_t& index) const;
+
+	string path(const uint32_t& index) const;
+	const path_manifest& paths(void) const;
+	uint32_t size(void) const;
+
+private:
+	void allocate(const uint32_t& count);
+	bool insert(string_view file_path, const uint32_t& index);
+	bool settle(const uint32_t& index, const uint64_t& state);
+	uint64_t state(const uint32_t& index) const;
+
+private:
+	uint64_t _mask;
+	path_manifest _file_list;
+	vector<uint64_t> _slots;
+	// two bits per file, received and failed, 32 files per word
+	unique_ptr<atomic<uint64_t>[]> _states;
+};
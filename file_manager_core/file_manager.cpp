@@ -0,0 +1,1258 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "file_manager.h"
+
+#include "utilities/conversion/convert_string.h"
+
+#include <cstdint>
+
+using namespace utility_module;
+using namespace container_module;
+
+// weight of the newest throughput sample in the moving average
+constexpr double rate_weight = 0.3;
+// resolution of transfer expiry in milliseconds
+constexpr uint64_t expiry_tick = 100;
+
+// only a coalescing policy holds reports back for the flush timer
+uint64_t flush_interval(const chrono::milliseconds& interval,
+						const bool& coalescing)
+{
+	if (!coalescing || interval.count() <= 0)
+	{
+		return 0;
+	}
+
+	return (uint64_t)interval.count();
+}
+
+uint64_t ticks(const chrono::milliseconds& timeout)
+{
+	if (timeout.count() <= 0)
+	{
+		return 0;
+	}
+
+	return ((uint64_t)timeout.count() + expiry_tick - 1) / expiry_tick;
+}
+
+// files settle in any order, so each one adds a mix of its position and
+// digest. the sum is the same on both ends of a transfer whatever the
+// order, and a file digest that moved to another file changes it.
+uint64_t fold_digest(const uint32_t& index, const uint32_t& digest)
+{
+	uint64_t value = ((uint64_t)index << 32) | digest;
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+
+	return value ^ (value >> 31);
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+basic_file_manager<lock_policy, storage_policy, notify_policy>::basic_file_manager(
+	const file_manager_options& options)
+	: _retain_paths(options.retain_paths)
+	, _shard_count(options.shard_count == 0 ? 1 : options.shard_count)
+	, _shards(make_unique<shard[]>(_shard_count))
+	, _notification_interval(flush_interval(options.notification_interval,
+											 notify_policy::coalescing))
+	, _notification_step(
+		  options.notification_step == 0 ? 1 : options.notification_step)
+	, _notification(nullptr)
+	, _next_flush(0)
+	, _expiry(options.idle_timeout.count() > 0
+			  || options.transfer_timeout.count() > 0)
+	, _idle_ticks(ticks(options.idle_timeout))
+	, _timeout_ticks(ticks(options.transfer_timeout))
+	, _origin(now())
+	, _tick(0)
+	, _serial(0)
+	, _journal(nullptr)
+	, _statistics_interval(options.statistics_interval.count() > 0
+							   ? (uint64_t)options.statistics_interval.count()
+							   : 0)
+	, _next_statistics(0)
+	, _first_file(nullptr)
+	, _file_gap(nullptr)
+	, _completion(nullptr)
+	, _snapshot(nullptr)
+	, _maintenance_stop(false)
+{
+	if (_statistics_interval > 0)
+	{
+		_first_file = make_unique<latency_histogram>();
+		_file_gap = make_unique<latency_histogram>();
+		_completion = make_unique<latency_histogram>();
+	}
+
+	if (!options.journal_path.empty())
+	{
+		_journal = make_unique<transfer_journal>(
+			options.journal_path, _shard_count,
+			options.journal_commit_interval, options.journal_snapshot_size);
+
+		for (auto& transfer : _journal->recover())
+		{
+			restore(transfer);
+		}
+
+		bool started = _journal->start(
+			[this](const function<void(const transfer_record&)>& visit)
+			{
+				for (unsigned short index = 0; index < _shard_count; ++index)
+				{
+					typename lock_policy::read_lock guard(_shards[index]._mutex);
+
+					_shards[index]._transfers.for_each(
+						[&](const size_t&, transfer_record& record)
+						{ visit(record); });
+				}
+			});
+		if (!started)
+		{
+			_journal.reset();
+		}
+	}
+
+	// the thread wakes up as often as the most frequent of its duties
+	uint64_t period = 0;
+	for (const uint64_t& interval : { _notification_interval,
+									  _expiry ? expiry_tick : 0,
+									  _statistics_interval })
+	{
+		if (interval > 0 && (period == 0 || interval < period))
+		{
+			period = interval;
+		}
+	}
+
+	if (period == 0)
+	{
+		return;
+	}
+
+	_maintenance_thread = thread(
+		[this, period]()
+		{
+			unique_lock<mutex> lock(_maintenance_mutex);
+			while (!_maintenance_condition.wait_for(
+				lock, chrono::milliseconds(period),
+				[this]() { return _maintenance_stop; }))
+			{
+				lock.unlock();
+				maintain();
+				lock.lock();
+			}
+		});
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+basic_file_manager<lock_policy, storage_policy, notify_policy>::~basic_file_manager(void)
+{
+	if (!_maintenance_thread.joinable())
+	{
+		return;
+	}
+
+	{
+		scoped_lock<mutex> guard(_maintenance_mutex);
+		_maintenance_stop = true;
+	}
+
+	_maintenance_condition.notify_one();
+	_maintenance_thread.join();
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+bool basic_file_manager<lock_policy, storage_policy, notify_policy>::set(
+	const string& indication_id,
+	const string& source_id,
+	const string& source_sub_id,
+	const vector<string>& file_list,
+	const vector<uint64_t>& file_sizes)
+{
+	if (file_list.size() >= UINT32_MAX)
+	{
+		return false;
+	}
+
+	return set(indication_id, source_id, source_sub_id,
+			   path_manifest(file_list), file_sizes);
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+bool basic_file_manager<lock_policy, storage_policy, notify_policy>::set(
+	const string& indication_id,
+	const string& source_id,
+	const string& source_sub_id,
+	path_manifest&& file_list,
+	const vector<uint64_t>& file_sizes)
+{
+	// a full manifest dropped every path pushed after it filled up
+	if (file_list.size() >= UINT32_MAX)
+	{
+		return false;
+	}
+
+	auto record = build(indication_id, source_id, source_sub_id,
+						std::move(file_list), file_sizes);
+	if (record == nullptr)
+	{
+		return false;
+	}
+
+	return install(storage_policy::hash(indication_id), std::move(record),
+				   true);
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+shared_ptr<value_container> basic_file_manager<lock_policy, storage_policy, notify_policy>::received(
+	string_view indication_id,
+	string_view file_path,
+	const uint32_t& digest)
+{
+	// an empty path reports a file that failed
+	return settle(indication_id, 1,
+				  [&](const size_t&)
+				  {
+					  return file_receipt{ indication_id, file_path,
+										   !file_path.empty(), digest };
+				  });
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+shared_ptr<value_container> basic_file_manager<lock_policy, storage_policy, notify_policy>::received_batch(
+	string_view indication_id,
+	span<const string> file_paths,
+	span<const bool> results)
+{
+	if (file_paths.empty()
+		|| (!results.empty() && results.size() != file_paths.size()))
+	{
+		return nullptr;
+	}
+
+	return settle(indication_id, file_paths.size(),
+				  [&](const size_t& item)
+				  {
+					  return file_receipt{ indication_id, file_paths[item],
+										   results.empty() || results[item] };
+				  });
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+vector<shared_ptr<value_container>> basic_file_manager<lock_policy, storage_policy, notify_policy>::received_batch(
+	span<const file_receipt> receipts)
+{
+	// receipts are grouped by transfer, in order of first appearance, so
+	// every transfer is looked up and locked once
+	vector<vector<size_t>> groups;
+	unordered_map<string_view, size_t> positions;
+	for (size_t item = 0; item < receipts.size(); ++item)
+	{
+		auto [position, added] = positions.try_emplace(
+			receipts[item].indication_id, groups.size());
+		if (added)
+		{
+			groups.emplace_back();
+		}
+
+		groups[position->second].push_back(item);
+	}
+
+	vector<shared_ptr<value_container>> messages;
+	for (auto& group : groups)
+	{
+		auto message = settle(receipts[group.front()].indication_id,
+							  group.size(),
+							  [&](const size_t& item)
+							  { return receipts[group[item]]; });
+		if (message != nullptr)
+		{
+			messages.push_back(message);
+		}
+	}
+
+	return messages;
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+shared_ptr<value_container> basic_file_manager<lock_policy, storage_policy, notify_policy>::received_bytes(
+	string_view indication_id,
+	string_view file_path,
+	const uint64_t& bytes)
+{
+	const size_t hash = storage_policy::hash(indication_id);
+
+	auto& target = select(hash);
+	typename lock_policy::read_lock guard(target._mutex);
+
+	auto record = target._transfers.find(hash, indication_id);
+	if (record == nullptr || record->total_bytes == 0)
+	{
+		return nullptr;
+	}
+
+	if (_expiry)
+	{
+		record->touched_tick.store(_tick.load(memory_order_relaxed),
+								   memory_order_relaxed);
+	}
+
+	uint32_t index = record->files.find(file_path);
+	if (index == file_index::npos || record->files.settled(index))
+	{
+		return nullptr;
+	}
+
+	if (credit(*record, index, bytes) == 0)
+	{
+		return nullptr;
+	}
+
+	const uint64_t counts = record->counts.load(memory_order_acquire);
+	const uint64_t completed = counts & UINT32_MAX;
+	if (completed + (counts >> 32) == record->files.size())
+	{
+		return nullptr;
+	}
+
+	return notify(*record, percentage(*record, completed), now());
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+bool basic_file_manager<lock_policy, storage_policy, notify_policy>::expects(
+	string_view indication_id, string_view file_path)
+{
+	const size_t hash = storage_policy::hash(indication_id);
+
+	auto& target = select(hash);
+	typename lock_policy::read_lock guard(target._mutex);
+
+	auto record = target._transfers.find(hash, indication_id);
+	if (record == nullptr)
+	{
+		return false;
+	}
+
+	uint32_t index = record->files.find(file_path);
+
+	return index != file_index::npos && !record->files.settled(index);
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+bool basic_file_manager<lock_policy, storage_policy, notify_policy>::set(
+	const wstring& indication_id,
+	const wstring& source_id,
+	const wstring& source_sub_id,
+	const vector<wstring>& file_list)
+{
+	auto [indication_str, indication_err]
+		= convert_string::to_string(indication_id);
+	auto [source_str, source_err] = convert_string::to_string(source_id);
+	auto [source_sub_str, source_sub_err]
+		= convert_string::to_string(source_sub_id);
+	if (!indication_str.has_value() || !source_str.has_value()
+		|| !source_sub_str.has_value())
+	{
+		return false;
+	}
+
+	path_manifest paths;
+	for (auto& file_path : file_list)
+	{
+		auto [path_str, path_err] = convert_string::to_string(file_path);
+		if (!path_str.has_value())
+		{
+			return false;
+		}
+
+		paths.push_back(path_str.value());
+	}
+	paths.shrink_to_fit();
+
+	return set(indication_str.value(), source_str.value(),
+			   source_sub_str.value(), std::move(paths));
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+shared_ptr<value_container> basic_file_manager<lock_policy, storage_policy, notify_policy>::received(
+	const wstring& indication_id,
+	const wstring& file_path)
+{
+	auto [indication_str, indication_err]
+		= convert_string::to_string(indication_id);
+	auto [path_str, path_err] = convert_string::to_string(file_path);
+	if (!indication_str.has_value() || !path_str.has_value())
+	{
+		return nullptr;
+	}
+
+	return received(string_view(indication_str.value()),
+					string_view(path_str.value()));
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+void basic_file_manager<lock_policy, storage_policy, notify_policy>::set_notification(
+	const function<void(shared_ptr<value_container>)>& notification)
+{
+	vector<shared_ptr<value_container>> recovered;
+	{
+		scoped_lock<mutex> guard(_notification_mutex);
+
+		_notification = notification;
+		recovered.swap(_recovered);
+	}
+
+	dispatch(recovered);
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+unsigned short basic_file_manager<lock_policy, storage_policy, notify_policy>::shard_count(void) const
+{
+	return _shard_count;
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+shared_ptr<const transfer_snapshot> basic_file_manager<lock_policy, storage_policy, notify_policy>::snapshot(void) const
+{
+	return _snapshot.load(memory_order_acquire);
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+latency_statistics basic_file_manager<lock_policy, storage_policy, notify_policy>::latency(void) const
+{
+	latency_statistics result;
+	if (_statistics_interval == 0)
+	{
+		return result;
+	}
+
+	result.first_file = _first_file->summary();
+	result.file_gap = _file_gap->summary();
+	result.completion = _completion->summary();
+
+	return result;
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+typename basic_file_manager<lock_policy, storage_policy, notify_policy>::shard&
+basic_file_manager<lock_policy, storage_policy, notify_policy>::select(
+	const size_t& hash)
+{
+	// transfer_table probes with the low bits, so shards are picked from the
+	// high bits of a multiplicative mix to keep both distributions independent
+	return _shards[(size_t)(((uint64_t)hash * 0x9E3779B97F4A7C15ull) >> 40)
+				   % _shard_count];
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+unsigned short basic_file_manager<lock_policy, storage_policy, notify_policy>::lane(
+	const shard& target) const
+{
+	return (unsigned short)(&target - _shards.get());
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+unique_ptr<transfer_record> basic_file_manager<lock_policy, storage_policy, notify_policy>::build(
+	const string& indication_id,
+	const string& source_id,
+	const string& source_sub_id,
+	path_manifest&& file_list,
+	const vector<uint64_t>& file_sizes)
+{
+	if (file_list.empty())
+	{
+		return nullptr;
+	}
+
+	if (!file_sizes.empty() && file_sizes.size() != file_list.size())
+	{
+		return nullptr;
+	}
+
+	auto record = make_unique<transfer_record>();
+	record->indication_id = indication_id;
+	record->condition
+		= transfer_condition(source_id, source_sub_id, indication_id);
+
+	vector<uint32_t> positions;
+	record->files = file_index(std::move(file_list),
+							   file_sizes.empty() ? nullptr : &positions);
+
+	if (!file_sizes.empty())
+	{
+		// file_index drops repeated paths, so sizes follow its positions
+		record->file_sizes.assign(record->files.size(), 0);
+		record->file_bytes
+			= make_unique<atomic<uint64_t>[]>(record->files.size());
+		for (size_t index = 0; index < positions.size(); ++index)
+		{
+			uint32_t position = positions[index];
+			if (record->file_sizes[position] == 0)
+			{
+				record->file_sizes[position] = file_sizes[index];
+			}
+		}
+
+		for (uint32_t position = 0; position < record->files.size();
+			 ++position)
+		{
+			record->file_bytes[position].store(0, memory_order_relaxed);
+			record->total_bytes += record->file_sizes[position];
+		}
+	}
+
+	record->timed = _notification_interval > 0 || record->total_bytes > 0;
+	if (record->timed)
+	{
+		record->rate_time = now();
+		record->notified.store(record->rate_time << 16, memory_order_relaxed);
+	}
+
+	if (_statistics_interval > 0)
+	{
+		record->set_time = now_micro();
+	}
+
+	if (_expiry)
+	{
+		record->serial = _serial.fetch_add(1, memory_order_relaxed) + 1;
+		record->created_tick = _tick.load(memory_order_relaxed);
+		record->touched_tick.store(record->created_tick,
+								   memory_order_relaxed);
+	}
+
+	return record;
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+bool basic_file_manager<lock_policy, storage_policy, notify_policy>::install(
+	const size_t& hash,
+	unique_ptr<transfer_record> record,
+	const bool& journaled)
+{
+	const string indication_id = record->indication_id;
+	const uint64_t serial = record->serial;
+	const uint64_t expiry = _expiry ? deadline(*record) : 0;
+	const vector<char> entry = journaled && _journal != nullptr
+								   ? transfer_journal::set_entry(*record)
+								   : vector<char>();
+
+	auto& target = select(hash);
+	typename lock_policy::write_lock guard(target._mutex);
+
+	if (target._transfers.insert(hash, std::move(record)) == nullptr)
+	{
+		return false;
+	}
+
+	if (!entry.empty())
+	{
+		_journal->append(lane(target), entry);
+	}
+
+	guard.unlock();
+
+	if (_expiry)
+	{
+		scoped_lock<mutex> expiry_guard(_expiry_mutex);
+
+		_expiries.schedule(expiry, { hash, serial, indication_id });
+	}
+
+	return true;
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+void basic_file_manager<lock_policy, storage_policy, notify_policy>::restore(
+	journal_transfer& transfer)
+{
+	auto record = build(transfer.indication_id, transfer.source_id,
+						transfer.source_sub_id, std::move(transfer.file_list),
+						transfer.file_sizes);
+	if (record == nullptr)
+	{
+		return;
+	}
+
+	// the journal keeps file lists as file_index left them, so positions and
+	// bits line up
+	uint64_t completed = 0;
+	for (uint32_t index = 0; index < record->files.size(); ++index)
+	{
+		if ((transfer.failed_files[index >> 6] >> (index & 63) & 1) != 0)
+		{
+			record->files.fail(index);
+			continue;
+		}
+
+		if ((transfer.received[index >> 6] >> (index & 63) & 1) == 0)
+		{
+			continue;
+		}
+
+		record->files.mark(index);
+		if (record->total_bytes > 0)
+		{
+			credit(*record, index, UINT64_MAX);
+		}
+		++completed;
+	}
+	record->restored = completed > 0;
+
+	const uint64_t failed = transfer.failed;
+	record->counts.store(completed | (failed << 32), memory_order_relaxed);
+
+	if (completed + failed < record->files.size())
+	{
+		install(storage_policy::hash(transfer.indication_id),
+				std::move(record), false);
+		return;
+	}
+
+	// settled before the clear made it to the journal
+	_journal->clear(0, transfer.indication_id);
+	_recovered.push_back(
+		record->total_bytes > 0
+			? record->condition.completion(percentage(*record, completed),
+										   completed, failed,
+										   throughput(*record, now()))
+			: record->condition.completion(percentage(*record, completed),
+										   completed, failed));
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+template <typename receipt_function>
+shared_ptr<value_container> basic_file_manager<lock_policy, storage_policy, notify_policy>::settle(
+	string_view indication_id,
+	const size_t& count,
+	const receipt_function& receipt)
+{
+	const size_t hash = storage_policy::hash(indication_id);
+
+	auto& target = select(hash);
+	typename lock_policy::read_lock guard(target._mutex);
+
+	auto record = target._transfers.find(hash, indication_id);
+	if (record == nullptr)
+	{
+		return nullptr;
+	}
+
+	if (_expiry)
+	{
+		record->touched_tick.store(_tick.load(memory_order_relaxed),
+								   memory_order_relaxed);
+	}
+
+	const uint64_t total = record->files.size();
+	const uint64_t arrival = _statistics_interval > 0 ? now_micro() : 0;
+
+	uint64_t counts = 0;
+	for (size_t item = 0; item < count; ++item)
+	{
+		const file_receipt file = receipt(item);
+		const string_view file_path = file.file_path;
+		const bool transferred = file.transferred;
+
+		// stray paths and repeated notifications must not move the
+		// percentage, so a file settles once whichever way it went. an
+		// empty path carries nothing to settle and is counted as is.
+		uint32_t index = file_index::npos;
+		if (!file_path.empty())
+		{
+			index = record->files.find(file_path);
+			if (index == file_index::npos
+				|| !(transferred ? record->files.mark(index)
+								 : record->files.fail(index)))
+			{
+				continue;
+			}
+		}
+
+		const uint64_t increment = transferred ? 1 : (1ull << 32);
+
+		uint64_t current = record->counts.load(memory_order_relaxed);
+		do
+		{
+			// a late notification after the last file has been settled
+			if ((current & UINT32_MAX) + (current >> 32) >= total)
+			{
+				break;
+			}
+		} while (!record->counts.compare_exchange_weak(
+			current, current + increment, memory_order_acq_rel,
+			memory_order_relaxed));
+
+		if ((current & UINT32_MAX) + (current >> 32) >= total)
+		{
+			break;
+		}
+		counts = current + increment;
+
+		if (_statistics_interval > 0)
+		{
+			// threads settling files of one transfer race on the exchange,
+			// so a gap is never taken against a later arrival
+			const uint64_t previous
+				= record->last_file_time.exchange(arrival, memory_order_relaxed);
+			if (previous == 0)
+			{
+				_first_file->record(arrival - record->set_time);
+			}
+			else
+			{
+				_file_gap->record(arrival > previous ? arrival - previous : 0);
+			}
+		}
+
+		// whatever part of the file was not reported by chunks arrived with it
+		if (transferred && record->total_bytes > 0)
+		{
+			credit(*record, index, UINT64_MAX);
+		}
+
+		if (transferred && file.digest != 0)
+		{
+			record->digest.fetch_add(fold_digest(index, file.digest),
+									 memory_order_relaxed);
+		}
+
+		if (_journal != nullptr)
+		{
+			if (transferred)
+			{
+				_journal->received(lane(target), indication_id, index);
+			}
+			else
+			{
+				_journal->failed(lane(target), indication_id,
+								 (uint32_t)(counts >> 32), index);
+			}
+		}
+
+		if (_retain_paths)
+		{
+			scoped_lock<mutex> paths_guard(record->paths_mutex);
+
+			if (transferred)
+			{
+				record->transferred_list.push_back(index);
+			}
+			else if (index != file_index::npos)
+			{
+				record->failed_list.push_back(index);
+			}
+		}
+	}
+
+	// nothing in this call was counted
+	if (counts == 0)
+	{
+		return nullptr;
+	}
+
+	const uint64_t completed = counts & UINT32_MAX;
+	const uint64_t failed = counts >> 32;
+	const uint64_t time = record->timed ? now() : 0;
+	unsigned short temp = percentage(*record, completed);
+
+	if (completed + failed != total)
+	{
+		return notify(*record, temp, time);
+	}
+
+	if (_statistics_interval > 0)
+	{
+		_completion->record(arrival - record->set_time);
+	}
+
+	// files the journal restored as received carry no digest, so a
+	// restored transfer reports none rather than a partial one
+	const uint64_t digest
+		= record->restored ? 0 : record->digest.load(memory_order_relaxed);
+
+	// this thread settled the last file; readers still reporting progress
+	// keep the shared lock, so the record is released once they are done
+	auto message
+		= record->total_bytes > 0
+			  ? record->condition.completion(temp, completed, failed,
+											 throughput(*record, time), digest)
+			  : record->condition.completion(temp, completed, failed, digest);
+	attach_paths(*record, message);
+
+	guard.unlock();
+	clear(target, hash, record);
+
+	return message;
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+uint64_t basic_file_manager<lock_policy, storage_policy, notify_policy>::now(void) const
+{
+	return (uint64_t)chrono::duration_cast<chrono::milliseconds>(
+			   chrono::steady_clock::now().time_since_epoch())
+		.count();
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+uint64_t basic_file_manager<lock_policy, storage_policy, notify_policy>::now_micro(void) const
+{
+	return (uint64_t)chrono::duration_cast<chrono::microseconds>(
+			   chrono::steady_clock::now().time_since_epoch())
+		.count();
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+shared_ptr<value_container> basic_file_manager<lock_policy, storage_policy, notify_policy>::notify(
+	transfer_record& record,
+	const unsigned short& percentage,
+	const uint64_t& time)
+{
+	if (!notify_policy::elect(record.notified, percentage, time,
+							  _notification_interval, _notification_step))
+	{
+		return nullptr;
+	}
+
+	if (record.total_bytes > 0)
+	{
+		return record.condition.progress(percentage,
+										 throughput(record, time));
+	}
+
+	return record.condition.progress(percentage);
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+unsigned short basic_file_manager<lock_policy, storage_policy, notify_policy>::percentage(
+	const transfer_record& record,
+	const uint64_t& completed) const
+{
+	if (record.total_bytes == 0)
+	{
+		return (unsigned short)((completed * 100) / record.files.size());
+	}
+
+	uint64_t transferred
+		= record.transferred_bytes.load(memory_order_relaxed);
+
+	return (unsigned short)((transferred * 100) / record.total_bytes);
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+uint64_t basic_file_manager<lock_policy, storage_policy, notify_policy>::credit(
+	transfer_record& record,
+	const uint32_t& index,
+	const uint64_t& bytes)
+{
+	const uint64_t size = record.file_sizes[index];
+
+	// chunks may be reported again after a retry, so a file never counts
+	// for more than its own size
+	uint64_t current = record.file_bytes[index].load(memory_order_relaxed);
+	uint64_t next = current;
+	do
+	{
+		if (current >= size)
+		{
+			return 0;
+		}
+
+		next = (bytes >= size - current) ? size : current + bytes;
+	} while (!record.file_bytes[index].compare_exchange_weak(
+		current, next, memory_order_relaxed));
+
+	record.transferred_bytes.fetch_add(next - current, memory_order_relaxed);
+
+	return next - current;
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+transfer_throughput basic_file_manager<lock_policy, storage_policy, notify_policy>::throughput(
+	transfer_record& record,
+	const uint64_t& time)
+{
+	transfer_throughput result;
+	result.transferred_bytes
+		= record.transferred_bytes.load(memory_order_relaxed);
+	result.total_bytes = record.total_bytes;
+
+	// a reporter that finds the sampler busy reuses the last estimate
+	unique_lock<mutex> guard(record.rate_mutex, try_to_lock);
+	if (guard.owns_lock() && time > record.rate_time
+		&& result.transferred_bytes >= record.rate_bytes)
+	{
+		uint64_t sample = ((result.transferred_bytes - record.rate_bytes)
+						   * 1000)
+						  / (time - record.rate_time);
+		uint64_t previous
+			= record.bytes_per_second.load(memory_order_relaxed);
+
+		record.bytes_per_second.store(
+			previous == 0 ? sample
+						  : (uint64_t)(rate_weight * sample
+									   + (1.0 - rate_weight) * previous),
+			memory_order_relaxed);
+		record.rate_time = time;
+		record.rate_bytes = result.transferred_bytes;
+	}
+
+	result.bytes_per_second
+		= record.bytes_per_second.load(memory_order_relaxed);
+	if (result.bytes_per_second > 0
+		&& result.total_bytes > result.transferred_bytes)
+	{
+		result.eta_seconds
+			= (result.total_bytes - result.transferred_bytes
+			   + result.bytes_per_second - 1)
+			  / result.bytes_per_second;
+	}
+
+	return result;
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+void basic_file_manager<lock_policy, storage_policy, notify_policy>::maintain(void)
+{
+	const uint64_t time = now();
+
+	if (_notification_interval > 0 && time >= _next_flush)
+	{
+		flush(time);
+		_next_flush = time + _notification_interval;
+	}
+
+	if (_expiry)
+	{
+		expire(time);
+	}
+
+	if (_statistics_interval > 0 && time >= _next_statistics)
+	{
+		publish(time);
+		_next_statistics = time + _statistics_interval;
+	}
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+void basic_file_manager<lock_policy, storage_policy, notify_policy>::flush(
+	const uint64_t& time)
+{
+	vector<shared_ptr<value_container>> messages;
+
+	for (unsigned short index = 0; index < _shard_count; ++index)
+	{
+		typename lock_policy::read_lock guard(_shards[index]._mutex);
+
+		_shards[index]._transfers.for_each(
+			[&](const size_t&, transfer_record& record)
+			{
+				const uint64_t total = record.files.size();
+				const uint64_t counts
+					= record.counts.load(memory_order_acquire);
+				const uint64_t completed = counts & UINT32_MAX;
+
+				// the thread settling the last file reports completion
+				if (completed + (counts >> 32) == total)
+				{
+					return;
+				}
+
+				auto message
+					= notify(record, percentage(record, completed), time);
+				if (message != nullptr)
+				{
+					messages.push_back(message);
+				}
+			});
+	}
+
+	dispatch(messages);
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+void basic_file_manager<lock_policy, storage_policy, notify_policy>::expire(
+	const uint64_t& time)
+{
+	const uint64_t tick = (time - _origin) / expiry_tick;
+	_tick.store(tick, memory_order_relaxed);
+
+	vector<expiry_entry> due;
+	{
+		scoped_lock<mutex> guard(_expiry_mutex);
+
+		_expiries.advance(tick,
+						  [&](const uint64_t&, expiry_entry&& entry)
+						  { due.push_back(std::move(entry)); });
+	}
+
+	if (due.empty())
+	{
+		return;
+	}
+
+	vector<shared_ptr<value_container>> messages;
+	vector<pair<uint64_t, expiry_entry>> postponed;
+
+	for (auto& entry : due)
+	{
+		auto& target = select(entry.hash);
+		typename lock_policy::write_lock guard(target._mutex);
+
+		// the transfer may have completed and even been set up again
+		auto record = target._transfers.find(entry.hash, entry.indication_id);
+		if (record == nullptr || record->serial != entry.serial)
+		{
+			continue;
+		}
+
+		const uint64_t counts = record->counts.load(memory_order_acquire);
+		const uint64_t completed = counts & UINT32_MAX;
+		const uint64_t failed = counts >> 32;
+
+		// the thread that settled the last file is about to release it
+		if (completed + failed == record->files.size())
+		{
+			continue;
+		}
+
+		// touched since the timer was armed, so it is only re-armed here
+		const uint64_t expiry = deadline(*record);
+		if (expiry > tick)
+		{
+			postponed.push_back({ expiry, std::move(entry) });
+			continue;
+		}
+
+		messages.push_back(record->condition.expiration(
+			percentage(*record, completed), completed, failed));
+		attach_paths(*record, messages.back());
+		if (_journal != nullptr)
+		{
+			_journal->clear(lane(target), entry.indication_id);
+		}
+		target._transfers.erase(entry.hash, record);
+	}
+
+	if (!postponed.empty())
+	{
+		scoped_lock<mutex> guard(_expiry_mutex);
+
+		for (auto& [expiry, entry] : postponed)
+		{
+			_expiries.schedule(expiry, std::move(entry));
+		}
+	}
+
+	dispatch(messages);
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+void basic_file_manager<lock_policy, storage_policy, notify_policy>::publish(
+	const uint64_t& time)
+{
+	// only the raw counters are copied under each shard lock, which under
+	// exclusive_locking holds up every received() of the shard; the samples
+	// are worked out once it is released
+	struct counters
+	{
+		string indication_id;
+		uint64_t file_count;
+		uint64_t counts;
+		uint64_t set_time;
+		uint64_t transferred_bytes;
+		uint64_t total_bytes;
+		uint64_t bytes_per_second;
+	};
+
+	vector<counters> taken;
+	for (unsigned short index = 0; index < _shard_count; ++index)
+	{
+		typename lock_policy::read_lock guard(_shards[index]._mutex);
+
+		taken.reserve(taken.size() + _shards[index]._transfers.size());
+		_shards[index]._transfers.for_each(
+			[&](const size_t&, transfer_record& record)
+			{
+				taken.push_back(
+					{ record.indication_id, record.files.size(),
+					  record.counts.load(memory_order_acquire),
+					  record.set_time,
+					  record.transferred_bytes.load(memory_order_relaxed),
+					  record.total_bytes,
+					  record.bytes_per_second.load(memory_order_relaxed) });
+			});
+	}
+
+	auto result = make_shared<transfer_snapshot>();
+	result->time = time;
+	result->transfers.reserve(taken.size());
+
+	const uint64_t current = now_micro();
+	for (auto& record : taken)
+	{
+		transfer_sample sample;
+		sample.indication_id = std::move(record.indication_id);
+		sample.file_count = record.file_count;
+		sample.completed = record.counts & UINT32_MAX;
+		sample.failed = record.counts >> 32;
+		sample.age_ms = current > record.set_time
+							? (current - record.set_time) / 1000
+							: 0;
+		if (sample.age_ms > 0)
+		{
+			sample.files_per_second
+				= (sample.completed + sample.failed) * 1000 / sample.age_ms;
+		}
+		if (record.total_bytes > 0)
+		{
+			sample.transferred_bytes = record.transferred_bytes;
+			sample.total_bytes = record.total_bytes;
+			sample.bytes_per_second = record.bytes_per_second;
+		}
+
+		result->transfers.push_back(std::move(sample));
+	}
+
+	// readers holding the previous snapshot keep it alive until they let go
+	_snapshot.store(std::move(result), memory_order_release);
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+uint64_t basic_file_manager<lock_policy, storage_policy, notify_policy>::deadline(
+	const transfer_record& record) const
+{
+	uint64_t result = UINT64_MAX;
+
+	if (_idle_ticks > 0)
+	{
+		result = record.touched_tick.load(memory_order_relaxed) + _idle_ticks;
+	}
+
+	if (_timeout_ticks > 0 && record.created_tick + _timeout_ticks < result)
+	{
+		result = record.created_tick + _timeout_ticks;
+	}
+
+	return result;
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+void basic_file_manager<lock_policy, storage_policy, notify_policy>::attach_paths(
+	transfer_record& record,
+	shared_ptr<value_container> message)
+{
+	if (!_retain_paths || message == nullptr)
+	{
+		return;
+	}
+
+	// files the journal restored were settled before the restart, so only
+	// the paths settled since are listed
+	scoped_lock<mutex> guard(record.paths_mutex);
+
+	for (auto& index : record.transferred_list)
+	{
+		message << make_shared<string_value>("transferred_file",
+											 record.files.path(index));
+	}
+	for (auto& index : record.failed_list)
+	{
+		message << make_shared<string_value>("failed_file",
+											 record.files.path(index));
+	}
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+void basic_file_manager<lock_policy, storage_policy, notify_policy>::dispatch(
+	const vector<shared_ptr<value_container>>& messages)
+{
+	if (messages.empty())
+	{
+		return;
+	}
+
+	scoped_lock<mutex> guard(_notification_mutex);
+	if (_notification == nullptr)
+	{
+		return;
+	}
+
+	for (auto& message : messages)
+	{
+		_notification(message);
+	}
+}
+
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+void basic_file_manager<lock_policy, storage_policy, notify_policy>::clear(
+	shard& target,
+	const size_t& hash,
+	transfer_record* record)
+{
+	typename lock_policy::write_lock guard(target._mutex);
+
+	if (_journal != nullptr)
+	{
+		_journal->clear(lane(target), record->indication_id);
+	}
+
+	target._transfers.erase(hash, record);
+}
+
+template class basic_file_manager<shared_locking,
+								  transfer_table,
+								  coalesced_notification>;
+template class basic_file_manager<shared_locking,
+								  transfer_table,
+								  completion_notification>;
+template class basic_file_manager<shared_locking,
+								  transfer_map,
+								  coalesced_notification>;
+template class basic_file_manager<shared_locking,
+								  transfer_map,
+								  completion_notification>;
+template class basic_file_manager<exclusive_locking,
+								  transfer_table,
+								  coalesced_notification>;
+template class basic_file_manager<exclusive_locking,
+								  transfer_table,
+								  completion_notification>;
+template class basic_file_manager<exclusive_locking,
+								  transfer_map,
+								  coalesced_notification>;
+template class basic_file_manager<exclusive_locking,
+								  transfer_map,
+								  completion_notification>;
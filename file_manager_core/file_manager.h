@@ -0,0 +1,307 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#pragma once
+
+#include "container/container.h"
+#include "core/value.h"
+#include "values/string_value.h"
+
+#include "file_manager_policies.h"
+#include "path_manifest.h"
+#include "timer_wheel.h"
+#include "transfer_journal.h"
+#include "transfer_map.h"
+#include "transfer_statistics.h"
+#include "transfer_table.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+using namespace container_module;
+
+struct file_manager_options
+{
+	unsigned short shard_count = 1;
+	// keeps the path of every settled file per transfer, and lists them in
+	// the completion or expiration of the transfer as transferred_file and
+	// failed_file units. failures reported without a path are only counted.
+	bool retain_paths = false;
+	// progress of a transfer is reported at most once per interval and only
+	// after it moved by at least the step. updates held back by the interval
+	// are flushed by a timer through the notification callback. completion
+	// is never held back.
+	chrono::milliseconds notification_interval{ 0 };
+	unsigned short notification_step = 1;
+	// a transfer without notifications for idle_timeout, or still open
+	// after transfer_timeout, reports completed=false with the counts so
+	// far and is dropped. 0 disables either deadline.
+	chrono::milliseconds idle_timeout{ 0 };
+	chrono::milliseconds transfer_timeout{ 0 };
+	// with a journal path, set, received and clear are appended to a
+	// write-ahead journal and the open transfers are restored from it on
+	// construction. appends are committed by one fsync per interval, and the
+	// journal is folded into a snapshot once it outgrows snapshot_size.
+	string journal_path;
+	chrono::milliseconds journal_commit_interval{ 10 };
+	uint64_t journal_snapshot_size = 64ull << 20;
+	// with an interval, latencies from set to the first file, between files
+	// and from set to completion are recorded, and a snapshot of the open
+	// transfers is published once per interval. 0 disables both.
+	chrono::milliseconds statistics_interval{ 0 };
+};
+
+// one file of a cross-transfer batch; the views only have to outlive the
+// received_batch() call
+struct file_receipt
+{
+	string_view indication_id;
+	string_view file_path;
+	bool transferred = true;
+	// crc32c of the whole file as checked by the transfer, 0 when unknown
+	uint32_t digest = 0;
+};
+
+// the policies are picked at compile time, so none of them costs a virtual
+// call on the hot path:
+// - lock_policy: shared_locking or exclusive_locking
+// - storage_policy: transfer_table or transfer_map, or any type with their
+//   hash, find, insert, erase, for_each and size
+// - notify_policy: coalesced_notification or completion_notification
+// the combinations of the policies above are instantiated in
+// file_manager_core.
+template <typename lock_policy, typename storage_policy, typename notify_policy>
+class basic_file_manager
+{
+public:
+	basic_file_manager(
+		const file_manager_options& options = file_manager_options());
+	~basic_file_manager(void);
+
+public:
+	// ids and paths are kept as UTF-8, so the narrow pair is the hot path and
+	// the wide pair converts its arguments once before forwarding
+	// with file_sizes, in the order of file_list, progress is weighted by
+	// bytes and reports carry the measured throughput and an ETA
+	bool set(const string& indication_id,
+			 const string& source_id,
+			 const string& source_sub_id,
+			 const vector<string>& file_list,
+			 const vector<uint64_t>& file_sizes = {});
+	// takes over a manifest built while parsing a request, so a large file
+	// list is never held as separate strings
+	bool set(const string& indication_id,
+			 const string& source_id,
+			 const string& source_sub_id,
+			 path_manifest&& file_list,
+			 const vector<uint64_t>& file_sizes = {});
+
+	// a digest of the file is folded into the digest the completion of the
+	// transfer reports, see transfer_record::digest
+	shared_ptr<value_container> received(string_view indication_id,
+										 string_view file_path,
+										 const uint32_t& digest = 0);
+
+	// settles many files under one lookup and one lock and returns at most
+	// one transfer_condition per transfer. without results every file
+	// counts as transferred; a false result counts it as failed.
+	shared_ptr<value_container> received_batch(string_view indication_id,
+											   span<const string> file_paths,
+											   span<const bool> results = {});
+	vector<shared_ptr<value_container>> received_batch(
+		span<const file_receipt> receipts);
+
+	// partial progress of a file that is still being transferred
+	shared_ptr<value_container> received_bytes(string_view indication_id,
+											   string_view file_path,
+											   const uint64_t& bytes);
+
+	// whether file_path is a file of the open transfer indication_id that
+	// has not settled yet, so a data endpoint only takes files it asked for
+	bool expects(string_view indication_id, string_view file_path);
+
+	bool set(const wstring& indication_id,
+			 const wstring& source_id,
+			 const wstring& source_sub_id,
+			 const vector<wstring>& file_list);
+
+	shared_ptr<value_container> received(
+		const wstring& indication_id, const wstring& file_path);
+
+	// receives the progress updates flushed by the coalescing timer, the
+	// final reports of expired transfers and those of transfers the journal
+	// restored already settled
+	void set_notification(
+		const function<void(shared_ptr<value_container>)>& notification);
+
+	unsigned short shard_count(void) const;
+
+	// the latest published snapshot, or nullptr without statistics. reading
+	// it takes no shard lock, so it never holds up received().
+	shared_ptr<const transfer_snapshot> snapshot(void) const;
+	latency_statistics latency(void) const;
+
+private:
+	// each shard sits on its own cache line so that workers hitting
+	// different shards do not bounce the same line between cores
+	struct alignas(64) shard
+	{
+		typename lock_policy::mutex_type _mutex;
+		storage_policy _transfers;
+	};
+
+	shard& select(const size_t& hash);
+	unsigned short lane(const shard& target) const;
+	unique_ptr<transfer_record> build(const string& indication_id,
+									  const string& source_id,
+									  const string& source_sub_id,
+									  path_manifest&& file_list,
+									  const vector<uint64_t>& file_sizes);
+	bool install(const size_t& hash,
+				 unique_ptr<transfer_record> record,
+				 const bool& journaled);
+	void restore(journal_transfer& transfer);
+	// receipt(item) yields the file_receipt of the item-th file
+	template <typename receipt_function>
+	shared_ptr<value_container> settle(string_view indication_id,
+									   const size_t& count,
+									   const receipt_function& receipt);
+	uint64_t now(void) const;
+	uint64_t now_micro(void) const;
+	shared_ptr<value_container> notify(transfer_record& record,
+									   const unsigned short& percentage,
+									   const uint64_t& time);
+	unsigned short percentage(const transfer_record& record,
+							  const uint64_t& completed) const;
+	uint64_t credit(transfer_record& record,
+					const uint32_t& index,
+					const uint64_t& bytes);
+	transfer_throughput throughput(transfer_record& record,
+								   const uint64_t& time);
+	void maintain(void);
+	void flush(const uint64_t& time);
+	void expire(const uint64_t& time);
+	void publish(const uint64_t& time);
+	uint64_t deadline(const transfer_record& record) const;
+	void attach_paths(transfer_record& record,
+					  shared_ptr<value_container> message);
+	void dispatch(const vector<shared_ptr<value_container>>& messages);
+	void clear(shard& target,
+			   const size_t& hash,
+			   transfer_record* record);
+
+private:
+	bool _retain_paths;
+	unsigned short _shard_count;
+	unique_ptr<shard[]> _shards;
+
+	uint64_t _notification_interval;
+	unsigned short _notification_step;
+
+	mutex _notification_mutex;
+	function<void(shared_ptr<value_container>)> _notification;
+
+	uint64_t _next_flush;
+
+	struct expiry_entry
+	{
+		size_t hash;
+		uint64_t serial;
+		string indication_id;
+	};
+
+	bool _expiry;
+	uint64_t _idle_ticks;
+	uint64_t _timeout_ticks;
+	uint64_t _origin;
+	atomic<uint64_t> _tick;
+	atomic<uint64_t> _serial;
+	mutex _expiry_mutex;
+	timer_wheel<expiry_entry> _expiries;
+
+	unique_ptr<transfer_journal> _journal;
+	vector<shared_ptr<value_container>> _recovered;
+
+	uint64_t _statistics_interval;
+	uint64_t _next_statistics;
+	unique_ptr<latency_histogram> _first_file;
+	unique_ptr<latency_histogram> _file_gap;
+	unique_ptr<latency_histogram> _completion;
+	atomic<shared_ptr<const transfer_snapshot>> _snapshot;
+
+	bool _maintenance_stop;
+	mutex _maintenance_mutex;
+	condition_variable _maintenance_condition;
+	thread _maintenance_thread;
+};
+
+extern template class basic_file_manager<shared_locking,
+										 transfer_table,
+										 coalesced_notification>;
+extern template class basic_file_manager<shared_locking,
+										 transfer_table,
+										 completion_notification>;
+extern template class basic_file_manager<shared_locking,
+										 transfer_map,
+										 coalesced_notification>;
+extern template class basic_file_manager<shared_locking,
+										 transfer_map,
+										 completion_notification>;
+extern template class basic_file_manager<exclusive_locking,
+										 transfer_table,
+										 coalesced_notification>;
+extern template class basic_file_manager<exclusive_locking,
+										 transfer_table,
+										 completion_notification>;
+extern template class basic_file_manager<exclusive_locking,
+										 transfer_map,
+										 coalesced_notification>;
+extern template class basic_file_manager<exclusive_locking,
+										 transfer_map,
+										 completion_notification>;
+
+// shared locking over the open-addressing table with coalesced progress
+using file_manager = basic_file_manager<shared_locking,
+										transfer_table,
+										coalesced_notification>;
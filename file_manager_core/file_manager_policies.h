@@ -0,0 +1,114 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+
+using namespace std;
+
+// locking policies guard one shard of transfers. received() only reads the
+// layout of a shard, set() and the release of a transfer change it.
+
+// receiving threads hitting the same shard proceed in parallel
+struct shared_locking
+{
+	using mutex_type = shared_mutex;
+	using read_lock = shared_lock<shared_mutex>;
+	using write_lock = unique_lock<shared_mutex>;
+};
+
+// one uncontended atomic instead of the reader count of shared_mutex, for
+// servers where few threads report at once
+struct exclusive_locking
+{
+	using mutex_type = mutex;
+	using read_lock = unique_lock<mutex>;
+	using write_lock = unique_lock<mutex>;
+};
+
+// notification policies elect the progress reports that get built.
+// completion and expiry are always reported.
+
+// at most one report per notification_interval and only after the
+// percentage moved by notification_step. percentage and time are swapped
+// together, so only one thread wins a report and the interval holds no
+// matter how many workers race here.
+struct coalesced_notification
+{
+	static constexpr bool coalescing = true;
+
+	static bool elect(atomic<uint64_t>& notified,
+					  const unsigned short& percentage,
+					  const uint64_t& time,
+					  const uint64_t& interval,
+					  const unsigned short& step)
+	{
+		uint64_t current = notified.load(memory_order_relaxed);
+		do
+		{
+			uint64_t last_percentage = current & UINT16_MAX;
+			uint64_t last_time = current >> 16;
+
+			if (percentage < last_percentage + step)
+			{
+				return false;
+			}
+
+			if (time < last_time + interval)
+			{
+				return false;
+			}
+		} while (!notified.compare_exchange_weak(
+			current, (time << 16) | percentage, memory_order_relaxed));
+
+		return true;
+	}
+};
+
+// for servers that relay only the outcome of a transfer
+struct completion_notification
+{
+	static constexpr bool coalescing = false;
+
+	static bool elect(atomic<uint64_t>&,
+					  const unsigned short&,
+					  const uint64_t&,
+					  const uint64_t&,
+					  const unsigned short&)
+	{
+		return false;
+	}
+};
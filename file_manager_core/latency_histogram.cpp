@@ -0,0 +1,181 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace
+{
+	atomic<size_t> next_slot{ 0 };
+
+	// threads are spread over the shards in the order they first record
+	size_t slot(void)
+	{
+		thread_local size_t result
+			= next_slot.fetch_add(1, memory_order_relaxed);
+
+		return result;
+	}
+}
+
+latency_histogram::latency_histogram(void)
+	: _shards(make_unique<shard[]>(shard_count))
+{
+	for (size_t index = 0; index < shard_count; ++index)
+	{
+		for (auto& count : _shards[index].counts)
+		{
+			count.store(0, memory_order_relaxed);
+		}
+		_shards[index].sum.store(0, memory_order_relaxed);
+		_shards[index].min.store(UINT64_MAX, memory_order_relaxed);
+		_shards[index].max.store(0, memory_order_relaxed);
+	}
+}
+
+latency_histogram::~latency_histogram(void) {}
+
+void latency_histogram::record(const uint64_t& value)
+{
+	auto& target = _shards[slot() % shard_count];
+
+	target.counts[bucket(value)].fetch_add(1, memory_order_relaxed);
+	target.sum.fetch_add(value, memory_order_relaxed);
+
+	// the extremes move rarely, so the loads mostly end the loops
+	uint64_t current = target.min.load(memory_order_relaxed);
+	while (value < current
+		   && !target.min.compare_exchange_weak(current, value,
+												memory_order_relaxed))
+	{
+	}
+
+	current = target.max.load(memory_order_relaxed);
+	while (value > current
+		   && !target.max.compare_exchange_weak(current, value,
+												memory_order_relaxed))
+	{
+	}
+}
+
+latency_summary latency_histogram::summary(void) const
+{
+	latency_summary result;
+
+	array<uint64_t, bucket_count> counts{};
+	uint64_t sum = 0;
+	uint64_t min = UINT64_MAX;
+	for (size_t index = 0; index < shard_count; ++index)
+	{
+		for (size_t position = 0; position < bucket_count; ++position)
+		{
+			counts[position]
+				+= _shards[index].counts[position].load(memory_order_relaxed);
+		}
+		sum += _shards[index].sum.load(memory_order_relaxed);
+		min = std::min(min, _shards[index].min.load(memory_order_relaxed));
+		result.max = std::max(result.max,
+							  _shards[index].max.load(memory_order_relaxed));
+	}
+
+	for (auto& count : counts)
+	{
+		result.count += count;
+	}
+
+	if (result.count == 0)
+	{
+		return result;
+	}
+
+	result.min = min;
+	result.mean = sum / result.count;
+
+	// percentiles report the top of their bucket, never above the maximum
+	const array<pair<uint64_t*, double>, 4> targets{ {
+		{ &result.p50, 0.5 },
+		{ &result.p90, 0.9 },
+		{ &result.p99, 0.99 },
+		{ &result.p999, 0.999 },
+	} };
+
+	uint64_t seen = 0;
+	size_t position = 0;
+	for (auto& [target, quantile] : targets)
+	{
+		const uint64_t rank = (uint64_t)(quantile * (double)result.count);
+		while (position < bucket_count && seen + counts[position] <= rank)
+		{
+			seen += counts[position];
+			++position;
+		}
+
+		*target = std::min(upper(std::min(position, bucket_count - 1)),
+						   result.max);
+	}
+
+	return result;
+}
+
+size_t latency_histogram::bucket(const uint64_t& value)
+{
+	if (value < linear_count)
+	{
+		return (size_t)value;
+	}
+
+	const uint64_t clamped
+		= std::min(value, (uint64_t(1) << max_bits) - 1);
+	const uint64_t shift
+		= (uint64_t)bit_width(clamped) - 1 - sub_bucket_bits;
+	const uint64_t mantissa = clamped >> shift;
+
+	return (size_t)(linear_count + (shift - 1) * (1ull << sub_bucket_bits)
+					+ (mantissa - (1ull << sub_bucket_bits)));
+}
+
+uint64_t latency_histogram::upper(const size_t& index)
+{
+	if (index < linear_count)
+	{
+		return index;
+	}
+
+	const uint64_t offset = index - linear_count;
+	const uint64_t shift = offset / (1ull << sub_bucket_bits) + 1;
+	const uint64_t mantissa
+		= offset % (1ull << sub_bucket_bits) + (1ull << sub_bucket_bits);
+
+	return ((mantissa + 1) << shift) - 1;
+}
@@ -0,0 +1,89 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+using namespace std;
+
+struct latency_summary
+{
+	uint64_t count = 0;
+	uint64_t min = 0;
+	uint64_t max = 0;
+	uint64_t mean = 0;
+	uint64_t p50 = 0;
+	uint64_t p90 = 0;
+	uint64_t p99 = 0;
+	uint64_t p999 = 0;
+};
+
+// log-linear histogram in the manner of HdrHistogram: values below 64 are
+// exact and every power of two above is split into 32 buckets, so any
+// reported percentile is within about 3% of the recorded value. recording
+// goes to one of several cache-line aligned shards picked per thread, so
+// threads rarely touch the same counters; summary() merges them.
+class latency_histogram
+{
+public:
+	latency_histogram(void);
+	~latency_histogram(void);
+
+public:
+	void record(const uint64_t& value);
+	latency_summary summary(void) const;
+
+private:
+	static constexpr uint64_t sub_bucket_bits = 5;
+	static constexpr uint64_t linear_count = 2ull << sub_bucket_bits;
+	static constexpr uint64_t max_bits = 40;
+	static constexpr size_t bucket_count
+		= linear_count + (max_bits - sub_bucket_bits) * (1ull << sub_bucket_bits);
+	static constexpr size_t shard_count = 16;
+
+	static size_t bucket(const uint64_t& value);
+	static uint64_t upper(const size_t& index);
+
+	struct alignas(64) shard
+	{
+		array<atomic<uint64_t>, bucket_count> counts;
+		atomic<uint64_t> sum;
+		atomic<uint64_t> min;
+		atomic<uint64_t> max;
+	};
+
+	unique_ptr<shard[]> _shards;
+};
@@ -0,0 +1,218 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "path_manifest.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	void put(vector<char>& arena, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			arena.push_back((char)(value | 0x80));
+			value >>= 7;
+		}
+		arena.push_back((char)value);
+	}
+
+	uint64_t get(const char*& source)
+	{
+		uint64_t value = 0;
+		for (uint32_t shift = 0;; shift += 7)
+		{
+			const uint8_t byte = (uint8_t)*source++;
+			value |= (uint64_t)(byte & 0x7f) << shift;
+			if (byte < 0x80)
+			{
+				return value;
+			}
+		}
+	}
+}
+
+path_manifest::path_manifest(void) : _count(0) {}
+
+path_manifest::path_manifest(const vector<string>& file_list) : _count(0)
+{
+	for (auto& file_path : file_list)
+	{
+		if (push_back(file_path) == npos)
+		{
+			break;
+		}
+	}
+
+	shrink_to_fit();
+}
+
+path_manifest::~path_manifest(void) {}
+
+uint32_t path_manifest::push_back(string_view file_path)
+{
+	if (_count == npos)
+	{
+		return npos;
+	}
+
+	size_t shared = 0;
+	if (_count % block_size == 0)
+	{
+		_blocks.push_back(_arena.size());
+	}
+	else
+	{
+		const size_t limit = min(_last.size(), file_path.size());
+		while (shared < limit && _last[shared] == file_path[shared])
+		{
+			++shared;
+		}
+	}
+
+	put(_arena, shared);
+	put(_arena, file_path.size() - shared);
+	_arena.insert(_arena.end(), file_path.begin() + shared, file_path.end());
+
+	_last.assign(file_path);
+
+	return _count++;
+}
+
+void path_manifest::shrink_to_fit(void)
+{
+	_arena.shrink_to_fit();
+	_blocks.shrink_to_fit();
+}
+
+string path_manifest::path(const uint32_t& index) const
+{
+	string result;
+	if (index >= _count)
+	{
+		return result;
+	}
+
+	uint32_t position = 0;
+	const char* source = seek(index, position);
+	for (;; ++position)
+	{
+		const uint64_t shared = get(source);
+		const uint64_t suffix = get(source);
+
+		result.resize(shared);
+		result.append(source, suffix);
+		source += suffix;
+
+		if (position == index)
+		{
+			return result;
+		}
+	}
+}
+
+bool path_manifest::equals(const uint32_t& index, string_view file_path) const
+{
+	if (index >= _count)
+	{
+		return false;
+	}
+
+	// matched is the prefix the current path has in common with file_path.
+	// a path sharing more than that with its predecessor differs right
+	// there, so only suffixes starting inside the match are compared.
+	uint32_t position = 0;
+	const char* source = seek(index, position);
+	size_t matched = 0;
+	size_t length = 0;
+	for (;; ++position)
+	{
+		const uint64_t shared = get(source);
+		const uint64_t suffix = get(source);
+
+		if (shared <= matched)
+		{
+			const size_t limit
+				= min((size_t)suffix, file_path.size() - (size_t)shared);
+			size_t common = 0;
+			while (common < limit
+				   && source[common] == file_path[shared + common])
+			{
+				++common;
+			}
+			matched = shared + common;
+		}
+		length = shared + suffix;
+		source += suffix;
+
+		if (position == index)
+		{
+			return matched == length && length == file_path.size();
+		}
+	}
+}
+
+void path_manifest::for_each(
+	const function<void(const uint32_t&, string_view)>& callback) const
+{
+	string current;
+	const char* source = _arena.data();
+	for (uint32_t position = 0; position < _count; ++position)
+	{
+		const uint64_t shared = get(source);
+		const uint64_t suffix = get(source);
+
+		current.resize(shared);
+		current.append(source, suffix);
+		source += suffix;
+
+		callback(position, current);
+	}
+}
+
+uint32_t path_manifest::size(void) const { return _count; }
+
+bool path_manifest::empty(void) const { return _count == 0; }
+
+uint64_t path_manifest::memory(void) const
+{
+	return _arena.capacity() + _blocks.capacity() * sizeof(uint64_t);
+}
+
+const char* path_manifest::seek(const uint32_t& index,
+								uint32_t& position) const
+{
+	position = index - index % block_size;
+
+	return _arena.data() + _blocks[index / block_size];
+}
@@ -0,0 +1,88 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// UTF-8 file list of one transfer, front coded in a single arena. paths are
+// grouped in blocks of block_size; the first path of a block is stored
+// whole and every other one as the length it shares with its predecessor
+// plus the remaining bytes. deep trees of a million files mostly repeat
+// their directories, so the list costs a fraction of a vector<string>, and
+// a path is referred to by its 32-bit position.
+class path_manifest
+{
+public:
+	path_manifest(void);
+	path_manifest(const vector<string>& file_list);
+	~path_manifest(void);
+
+	path_manifest(path_manifest&& other) = default;
+	path_manifest& operator=(path_manifest&& other) = default;
+
+public:
+	static constexpr uint32_t npos = UINT32_MAX;
+	static constexpr uint32_t block_size = 8;
+
+	// returns the position of the path, or npos once the list is full
+	uint32_t push_back(string_view file_path);
+	void shrink_to_fit(void);
+
+	string path(const uint32_t& index) const;
+	// compares without decoding the path into a buffer
+	bool equals(const uint32_t& index, string_view file_path) const;
+	// decodes every path in order, which is cheaper than path() per index
+	void for_each(
+		const function<void(const uint32_t&, string_view)>& callback) const;
+
+	uint32_t size(void) const;
+	bool empty(void) const;
+	// bytes held by the arena and the block offsets
+	uint64_t memory(void) const;
+
+private:
+	const char* seek(const uint32_t& index, uint32_t& position) const;
+
+private:
+	uint32_t _count;
+	vector<char> _arena;
+	vector<uint64_t> _blocks;
+	// the last path pushed, to share its prefix with the next one
+	string _last;
+};
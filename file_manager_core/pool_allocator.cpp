@@ -0,0 +1,137 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+
+#include "pool_allocator.h"
+
+#include <array>
+
+using namespace std;
+
+namespace
+{
+	constexpr size_t size_classes
+		= block_pool::max_block_size / block_pool::block_alignment;
+
+	struct free_block
+	{
+		free_block* next;
+	};
+
+	// trivially destructible, so blocks released by objects that outlive
+	// the thread's pool (globals torn down after main's thread locals) can
+	// still see that the pool is gone and go back to operator delete
+	struct block_cache
+	{
+		array<free_block*, size_classes> heads;
+		array<size_t, size_classes> counts;
+		bool released;
+	};
+
+	thread_local block_cache cache{};
+
+	struct block_cache_guard
+	{
+		~block_cache_guard(void)
+		{
+			cache.released = true;
+
+			for (auto& head : cache.heads)
+			{
+				while (head != nullptr)
+				{
+					free_block* next = head->next;
+					::operator delete(head);
+					head = next;
+				}
+			}
+		}
+	};
+
+	thread_local block_cache_guard guard;
+
+	size_t size_class(const size_t& size)
+	{
+		return (size + block_pool::block_alignment - 1)
+				   / block_pool::block_alignment
+			   - 1;
+	}
+}
+
+void* block_pool::allocate(const size_t& size)
+{
+	if (size == 0 || size > max_block_size)
+	{
+		return ::operator new(size);
+	}
+
+	size_t index = size_class(size);
+	free_block* head = cache.heads[index];
+	if (head == nullptr)
+	{
+		return ::operator new((index + 1) * block_alignment);
+	}
+
+	cache.heads[index] = head->next;
+	--cache.counts[index];
+
+	return head;
+}
+
+void block_pool::deallocate(void* block, const size_t& size)
+{
+	if (block == nullptr)
+	{
+		return;
+	}
+
+	if (size == 0 || size > max_block_size)
+	{
+		::operator delete(block);
+		return;
+	}
+
+	size_t index = size_class(size);
+	if (cache.released || cache.counts[index] >= max_cached_blocks)
+	{
+		::operator delete(block);
+		return;
+	}
+
+	// the guard drains this thread's lists when the thread exits
+	(void)&guard;
+
+	auto target = static_cast<free_block*>(block);
+	target->next = cache.heads[index];
+	cache.heads[index] = target;
+	++cache.counts[index];
+}
@@ -0,0 +1,84 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+// thread local free lists of fixed size blocks. blocks are handed out in
+// 16 byte size classes up to max_block_size and fall back to operator new
+// above it. a block released on another thread simply joins that thread's
+// list, and every list keeps at most max_cached_blocks spare blocks.
+class block_pool
+{
+public:
+	static constexpr size_t block_alignment = 16;
+	static constexpr size_t max_block_size = 1024;
+	static constexpr size_t max_cached_blocks = 4096;
+
+	static void* allocate(const size_t& size);
+	static void deallocate(void* block, const size_t& size);
+};
+
+template <typename T> class pool_allocator
+{
+public:
+	using value_type = T;
+
+	pool_allocator(void) noexcept {}
+	template <typename U> pool_allocator(const pool_allocator<U>&) noexcept {}
+
+	T* allocate(size_t count)
+	{
+		static_assert(alignof(T) <= block_pool::block_alignment,
+					  "pool_allocator cannot satisfy over-aligned types");
+
+		return static_cast<T*>(block_pool::allocate(count * sizeof(T)));
+	}
+
+	void deallocate(T* target, size_t count) noexcept
+	{
+		block_pool::deallocate(target, count * sizeof(T));
+	}
+
+	template <typename U> bool operator==(const pool_allocator<U>&) const
+	{
+		return true;
+	}
+
+	template <typename U> bool operator!=(const pool_allocator<U>&) const
+	{
+		return false;
+	}
+};
@@ -0,0 +1,150 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+using namespace std;
+
+// hierarchical timer wheel of four levels with 64 slots each. a timer lands
+// on the coarsest level that still tells its slot apart and is moved down
+// level by level as the wheel turns, so scheduling is O(1) and every timer
+// is touched at most once per level. timers beyond the reach of the wheel
+// are parked in the farthest slot and re-scheduled from there.
+template <typename entry_type> class timer_wheel
+{
+public:
+	timer_wheel(const uint64_t& start_tick = 0) : _tick(start_tick) {}
+
+	void schedule(const uint64_t& deadline, entry_type&& entry)
+	{
+		// the slot of the current tick has already been handed out
+		place(deadline, _tick + 1, std::move(entry));
+	}
+
+	// moves the wheel up to tick and hands every timer that became due to
+	// expired together with its deadline
+	void advance(
+		const uint64_t& tick,
+		const function<void(const uint64_t&, entry_type&&)>& expired)
+	{
+		while (_tick < tick)
+		{
+			++_tick;
+
+			for (size_t level = 1; level < levels; ++level)
+			{
+				if ((_tick & ((1ull << (slot_bits * level)) - 1)) != 0)
+				{
+					break;
+				}
+
+				cascade(level);
+			}
+
+			auto& slot = _slots[0][_tick & slot_mask];
+			auto due = std::move(slot);
+			slot.clear();
+
+			for (auto& timer : due)
+			{
+				if (timer.deadline > _tick)
+				{
+					place(timer.deadline, _tick + 1, std::move(timer.entry));
+					continue;
+				}
+
+				expired(timer.deadline, std::move(timer.entry));
+			}
+		}
+	}
+
+	uint64_t tick(void) const { return _tick; }
+
+private:
+	void place(const uint64_t& deadline,
+			   const uint64_t& earliest,
+			   entry_type&& entry)
+	{
+		uint64_t target = deadline > earliest ? deadline : earliest;
+		uint64_t delta = target - _tick;
+
+		for (size_t level = 0; level < levels; ++level)
+		{
+			if (delta < (1ull << (slot_bits * (level + 1)))
+				|| level == levels - 1)
+			{
+				if (delta >= (1ull << (slot_bits * levels)))
+				{
+					target = _tick + (1ull << (slot_bits * levels)) - 1;
+				}
+
+				_slots[level][(target >> (slot_bits * level)) & slot_mask]
+					.push_back({ deadline, std::move(entry) });
+				return;
+			}
+		}
+	}
+
+	void cascade(const size_t& level)
+	{
+		auto& slot
+			= _slots[level][(_tick >> (slot_bits * level)) & slot_mask];
+		auto moving = std::move(slot);
+		slot.clear();
+
+		// timers due right now land in the level 0 slot about to be expired
+		for (auto& timer : moving)
+		{
+			place(timer.deadline, _tick, std::move(timer.entry));
+		}
+	}
+
+private:
+	static constexpr size_t levels = 4;
+	static constexpr uint64_t slot_bits = 6;
+	static constexpr uint64_t slot_mask = (1ull << slot_bits) - 1;
+
+	struct timer
+	{
+		uint64_t deadline;
+		entry_type entry;
+	};
+
+	uint64_t _tick;
+	array<array<vector<timer>, 1ull << slot_bits>, levels> _slots;
+};
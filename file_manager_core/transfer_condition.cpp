@@ -0,0 +1,180 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+
+#include "transfer_condition.h"
+
+#include "pool_allocator.h"
+
+#include "container/core/value_types.h"
+#include "container/values/bool_value.h"
+#include "container/values/numeric_value.h"
+#include "container/values/string_value.h"
+
+using ushort_value = numeric_value<unsigned short, value_types::ushort_value>;
+using ullong_value
+	= numeric_value<unsigned long long, value_types::ullong_value>;
+
+transfer_condition::transfer_condition(void) : _indication_id(nullptr) {}
+
+transfer_condition::transfer_condition(const string& source_id,
+									   const string& source_sub_id,
+									   const string& indication_id)
+	: _source_id(source_id)
+	, _source_sub_id(source_sub_id)
+	, _indication_id(make_shared<string_value>("indication_id", indication_id))
+{
+}
+
+transfer_condition::~transfer_condition(void) {}
+
+shared_ptr<value_container> transfer_condition::progress(
+	const unsigned short& percentage) const
+{
+	pool_allocator<ushort_value> allocator;
+
+	return make({ _indication_id,
+				  allocate_shared<ushort_value>(allocator, "percentage",
+												percentage) });
+}
+
+shared_ptr<value_container> transfer_condition::progress(
+	const unsigned short& percentage,
+	const transfer_throughput& throughput) const
+{
+	pool_allocator<ullong_value> allocator;
+
+	return make({ _indication_id,
+				  allocate_shared<ushort_value>(allocator, "percentage",
+												percentage),
+				  allocate_shared<ullong_value>(allocator, "transferred_bytes",
+												throughput.transferred_bytes),
+				  allocate_shared<ullong_value>(allocator, "total_bytes",
+												throughput.total_bytes),
+				  allocate_shared<ullong_value>(allocator, "bytes_per_second",
+												throughput.bytes_per_second),
+				  allocate_shared<ullong_value>(allocator, "eta_seconds",
+												throughput.eta_seconds) });
+}
+
+shared_ptr<value_container> transfer_condition::completion(
+	const unsigned short& percentage,
+	const uint64_t& completed_count,
+	const uint64_t& failed_count,
+	const uint64_t& digest) const
+{
+	pool_allocator<ullong_value> allocator;
+
+	vector<shared_ptr<value>> units{
+		_indication_id,
+		allocate_shared<ushort_value>(allocator, "percentage", percentage),
+		allocate_shared<ullong_value>(allocator, "completed_count",
+									  completed_count),
+		allocate_shared<ullong_value>(allocator, "failed_count", failed_count),
+		allocate_shared<bool_value>(allocator, "completed", true)
+	};
+	if (digest != 0)
+	{
+		units.push_back(
+			allocate_shared<ullong_value>(allocator, "digest", digest));
+	}
+
+	return make(std::move(units));
+}
+
+shared_ptr<value_container> transfer_condition::completion(
+	const unsigned short& percentage,
+	const uint64_t& completed_count,
+	const uint64_t& failed_count,
+	const transfer_throughput& throughput,
+	const uint64_t& digest) const
+{
+	pool_allocator<ullong_value> allocator;
+
+	vector<shared_ptr<value>> units{
+		_indication_id,
+		allocate_shared<ushort_value>(allocator, "percentage", percentage),
+		allocate_shared<ullong_value>(allocator, "completed_count",
+									  completed_count),
+		allocate_shared<ullong_value>(allocator, "failed_count", failed_count),
+		allocate_shared<ullong_value>(allocator, "transferred_bytes",
+									  throughput.transferred_bytes),
+		allocate_shared<ullong_value>(allocator, "total_bytes",
+									  throughput.total_bytes),
+		allocate_shared<ullong_value>(allocator, "bytes_per_second",
+									  throughput.bytes_per_second),
+		allocate_shared<bool_value>(allocator, "completed", true)
+	};
+	if (digest != 0)
+	{
+		units.push_back(
+			allocate_shared<ullong_value>(allocator, "digest", digest));
+	}
+
+	return make(std::move(units));
+}
+
+shared_ptr<value_container> transfer_condition::expiration(
+	const unsigned short& percentage,
+	const uint64_t& completed_count,
+	const uint64_t& failed_count) const
+{
+	pool_allocator<ullong_value> allocator;
+
+	return make({ _indication_id,
+				  allocate_shared<ushort_value>(allocator, "percentage",
+												percentage),
+				  allocate_shared<ullong_value>(allocator, "completed_count",
+												completed_count),
+				  allocate_shared<ullong_value>(allocator, "failed_count",
+												failed_count),
+				  allocate_shared<bool_value>(allocator, "completed",
+											  false) });
+}
+
+const string& transfer_condition::source_id(void) const { return _source_id; }
+
+const string& transfer_condition::source_sub_id(void) const
+{
+	return _source_sub_id;
+}
+
+shared_ptr<value_container> transfer_condition::make(
+	vector<shared_ptr<value>>&& units) const
+{
+	pool_allocator<value_container> allocator;
+
+	return allocate_shared<value_container>(allocator, _source_id,
+											_source_sub_id,
+											"transfer_condition",
+											std::move(units));
+}
@@ -0,0 +1,100 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+
+#pragma once
+
+#include "container/container.h"
+#include "core/value.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+using namespace std;
+using namespace container_module;
+
+struct transfer_throughput
+{
+	uint64_t transferred_bytes = 0;
+	uint64_t total_bytes = 0;
+	uint64_t bytes_per_second = 0;
+	// 0 while no rate has been measured yet
+	uint64_t eta_seconds = 0;
+};
+
+// prototype of the transfer_condition message of one transfer. the header
+// ids and the indication_id unit are encoded once in set(); emitting a
+// message only creates the numeric units, all from pooled blocks.
+class transfer_condition
+{
+public:
+	transfer_condition(void);
+	transfer_condition(const string& source_id,
+					   const string& source_sub_id,
+					   const string& indication_id);
+	~transfer_condition(void);
+
+public:
+	shared_ptr<value_container> progress(
+		const unsigned short& percentage) const;
+	shared_ptr<value_container> progress(
+		const unsigned short& percentage,
+		const transfer_throughput& throughput) const;
+	// a nonzero digest is reported as the digest unit
+	shared_ptr<value_container> completion(const unsigned short& percentage,
+										   const uint64_t& completed_count,
+										   const uint64_t& failed_count,
+										   const uint64_t& digest = 0) const;
+	shared_ptr<value_container> completion(
+		const unsigned short& percentage,
+		const uint64_t& completed_count,
+		const uint64_t& failed_count,
+		const transfer_throughput& throughput,
+		const uint64_t& digest = 0) const;
+	shared_ptr<value_container> expiration(const unsigned short& percentage,
+										   const uint64_t& completed_count,
+										   const uint64_t& failed_count) const;
+
+	const string& source_id(void) const;
+	const string& source_sub_id(void) const;
+
+private:
+	shared_ptr<value_container> make(
+		vector<shared_ptr<value>>&& units) const;
+
+private:
+	string _source_id;
+	string _source_sub_id;
+	// never modified after construction, so every message shares it
+	shared_ptr<value> _indication_id;
+};
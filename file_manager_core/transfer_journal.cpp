@@ -0,0 +1,838 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "transfer_journal.h"
+#include "checksum.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+	constexpr uint64_t snapshot_magic = 0x32504E534A4D4621ull; // "!FMJSNP2"
+
+	enum class entry_types : uint8_t
+	{
+		set = 1,
+		received = 2,
+		failed = 3,
+		clear = 4,
+	};
+
+	// entry: u32 size, u32 crc of the body, body = u8 type + payload
+	constexpr size_t entry_header = sizeof(uint32_t) * 2;
+
+	template <typename value_type>
+	void put(vector<char>& buffer, const value_type& value)
+	{
+		const size_t offset = buffer.size();
+		buffer.resize(offset + sizeof(value_type));
+		memcpy(buffer.data() + offset, &value, sizeof(value_type));
+	}
+
+	void put(vector<char>& buffer, string_view value)
+	{
+		put(buffer, (uint32_t)value.size());
+		buffer.insert(buffer.end(), value.begin(), value.end());
+	}
+
+	// reserves the header, which seal() fills in once the body is complete
+	size_t open_entry(vector<char>& buffer, const entry_types& type)
+	{
+		const size_t offset = buffer.size();
+		buffer.resize(offset + entry_header);
+		put(buffer, (uint8_t)type);
+
+		return offset;
+	}
+
+	void seal(vector<char>& buffer, const size_t& offset)
+	{
+		const size_t body = offset + entry_header;
+		const uint32_t size = (uint32_t)(buffer.size() - body);
+		const uint32_t crc = crc32c(buffer.data() + body, size);
+
+		memcpy(buffer.data() + offset, &size, sizeof(size));
+		memcpy(buffer.data() + offset + sizeof(size), &crc, sizeof(crc));
+	}
+
+	class reader
+	{
+	public:
+		reader(const char* data, const size_t& size)
+			: _data(data), _size(size), _offset(0)
+		{
+		}
+
+		template <typename value_type> bool get(value_type& value)
+		{
+			if (_size - _offset < sizeof(value_type))
+			{
+				return false;
+			}
+
+			memcpy(&value, _data + _offset, sizeof(value_type));
+			_offset += sizeof(value_type);
+
+			return true;
+		}
+
+		bool get(string_view& value)
+		{
+			uint32_t size = 0;
+			if (!get(size) || _size - _offset < size)
+			{
+				return false;
+			}
+
+			value = string_view(_data + _offset, size);
+			_offset += size;
+
+			return true;
+		}
+
+		bool get(string& value)
+		{
+			string_view view;
+			if (!get(view))
+			{
+				return false;
+			}
+
+			value.assign(view);
+
+			return true;
+		}
+
+		template <typename value_type> bool get(vector<value_type>& values,
+												const size_t& count)
+		{
+			if ((_size - _offset) / sizeof(value_type) < count)
+			{
+				return false;
+			}
+
+			values.resize(count);
+			memcpy(values.data(), _data + _offset, count * sizeof(value_type));
+			_offset += count * sizeof(value_type);
+
+			return true;
+		}
+
+		const char* current(void) const { return _data + _offset; }
+		size_t remained(void) const { return _size - _offset; }
+		void skip(const size_t& size) { _offset += size; }
+
+	private:
+		const char* _data;
+		size_t _size;
+		size_t _offset;
+	};
+
+	// read-only view of a whole file. recovery only walks the bytes once, so
+	// mapping saves copying the snapshot into the heap before parsing it.
+	class mapped_file
+	{
+	public:
+		mapped_file(const string& path) : _data(nullptr), _size(0)
+		{
+#ifdef _WIN32
+			ifstream stream(path, ios::binary | ios::ate);
+			if (!stream.is_open())
+			{
+				return;
+			}
+
+			_buffer.resize((size_t)stream.tellg());
+			stream.seekg(0);
+			stream.read(_buffer.data(), (streamsize)_buffer.size());
+			_data = _buffer.data();
+			_size = (size_t)stream.gcount();
+#else
+			int descriptor = ::open(path.c_str(), O_RDONLY);
+			if (descriptor < 0)
+			{
+				return;
+			}
+
+			struct stat status;
+			if (fstat(descriptor, &status) == 0 && status.st_size > 0)
+			{
+				void* data = mmap(nullptr, (size_t)status.st_size, PROT_READ,
+								  MAP_PRIVATE, descriptor, 0);
+				if (data != MAP_FAILED)
+				{
+					madvise(data, (size_t)status.st_size, MADV_SEQUENTIAL);
+					_data = (const char*)data;
+					_size = (size_t)status.st_size;
+				}
+			}
+
+			::close(descriptor);
+#endif
+		}
+
+		~mapped_file(void)
+		{
+#ifndef _WIN32
+			if (_data != nullptr)
+			{
+				munmap((void*)_data, _size);
+			}
+#endif
+		}
+
+		mapped_file(const mapped_file&) = delete;
+		mapped_file& operator=(const mapped_file&) = delete;
+
+		const char* data(void) const { return _data; }
+		size_t size(void) const { return _size; }
+
+	private:
+		const char* _data;
+		size_t _size;
+#ifdef _WIN32
+		vector<char> _buffer;
+#endif
+	};
+
+	bool sync(FILE* file)
+	{
+		if (fflush(file) != 0)
+		{
+			return false;
+		}
+
+#ifdef _WIN32
+		return _commit(_fileno(file)) == 0;
+#else
+		return fsync(fileno(file)) == 0;
+#endif
+	}
+
+	// makes a rename durable on file systems that journal metadata lazily
+	void sync_directory(const filesystem::path& directory)
+	{
+#ifndef _WIN32
+		int descriptor = ::open(
+			directory.empty() ? "." : directory.string().c_str(), O_RDONLY);
+		if (descriptor < 0)
+		{
+			return;
+		}
+
+		fsync(descriptor);
+		::close(descriptor);
+#else
+		(void)directory;
+#endif
+	}
+}
+
+transfer_journal::transfer_journal(const string& path,
+								   const unsigned short& lane_count,
+								   const chrono::milliseconds& commit_interval,
+								   const uint64_t& snapshot_size)
+	: _path(path)
+	, _lane_count(lane_count == 0 ? 1 : lane_count)
+	, _lanes(make_unique<lane[]>(_lane_count))
+	, _commit_interval(commit_interval.count() > 0 ? commit_interval
+												   : chrono::milliseconds(1))
+	, _snapshot_size(snapshot_size)
+	, _capture(nullptr)
+	, _file(nullptr)
+	, _generation(0)
+	, _written(0)
+	, _replayed(false)
+	, _stop(false)
+{
+}
+
+transfer_journal::~transfer_journal(void)
+{
+	if (_thread.joinable())
+	{
+		{
+			scoped_lock<mutex> guard(_mutex);
+			_stop = true;
+		}
+
+		_condition.notify_one();
+		_thread.join();
+	}
+
+	commit();
+	if (_file != nullptr)
+	{
+		fclose(_file);
+		_file = nullptr;
+	}
+}
+
+vector<journal_transfer> transfer_journal::recover(void)
+{
+	unordered_map<string, journal_transfer> transfers;
+
+	uint64_t first = 0;
+	{
+		mapped_file snapshot(_path + ".snapshot");
+
+		reader input(snapshot.data(), snapshot.size());
+		uint64_t magic = 0;
+		uint64_t generation = 0;
+		uint64_t count = 0;
+		uint32_t crc = 0;
+		if (input.get(magic) && magic == snapshot_magic
+			&& input.get(generation) && input.get(count) && input.get(crc)
+			&& crc32c(input.current(), input.remained()) == crc)
+		{
+			transfers.reserve(count);
+			for (uint64_t index = 0; index < count; ++index)
+			{
+				journal_transfer transfer;
+				uint32_t file_count = 0;
+				uint8_t sized = 0;
+				if (!input.get(transfer.indication_id)
+					|| !input.get(transfer.source_id)
+					|| !input.get(transfer.source_sub_id)
+					|| !input.get(file_count) || !input.get(sized)
+					|| !input.get(transfer.failed))
+				{
+					break;
+				}
+
+				bool valid = true;
+				for (uint32_t file = 0; valid && file < file_count; ++file)
+				{
+					string_view file_path;
+					valid = input.get(file_path);
+					transfer.file_list.push_back(file_path);
+				}
+				transfer.file_list.shrink_to_fit();
+
+				if (!valid
+					|| (sized != 0
+						&& !input.get(transfer.file_sizes, file_count))
+					|| !input.get(transfer.received,
+								  ((size_t)file_count + 63) / 64)
+					|| !input.get(transfer.failed_files,
+								  ((size_t)file_count + 63) / 64))
+				{
+					break;
+				}
+
+				string key = transfer.indication_id;
+				transfers.emplace(std::move(key), std::move(transfer));
+			}
+
+			first = generation;
+			_generation = generation;
+		}
+	}
+
+	for (auto& generation : generations())
+	{
+		if (generation < first)
+		{
+			continue;
+		}
+
+		if (replay(journal_path(generation), transfers) > 0)
+		{
+			_replayed = true;
+		}
+		_generation = generation;
+	}
+
+	vector<journal_transfer> result;
+	result.reserve(transfers.size());
+	for (auto& [indication_id, transfer] : transfers)
+	{
+		result.push_back(std::move(transfer));
+	}
+
+	return result;
+}
+
+bool transfer_journal::start(const capture_function& capture)
+{
+	_capture = capture;
+
+	if (!open(_generation + 1))
+	{
+		return false;
+	}
+
+	// the replayed journals are folded into a snapshot, so the next start
+	// does not walk them again
+	if (_replayed && !compact())
+	{
+		return false;
+	}
+
+	_thread = thread(&transfer_journal::run, this);
+
+	return true;
+}
+
+vector<char> transfer_journal::set_entry(const transfer_record& record)
+{
+	const uint32_t count = record.files.size();
+
+	vector<char> entry;
+	size_t offset = open_entry(entry, entry_types::set);
+	put(entry, string_view(record.indication_id));
+	put(entry, string_view(record.condition.source_id()));
+	put(entry, string_view(record.condition.source_sub_id()));
+	put(entry, count);
+	put(entry, (uint8_t)(record.file_sizes.empty() ? 0 : 1));
+	record.files.paths().for_each([&](const uint32_t&, string_view file_path)
+								  { put(entry, file_path); });
+	for (auto& file_size : record.file_sizes)
+	{
+		put(entry, file_size);
+	}
+	seal(entry, offset);
+
+	return entry;
+}
+
+void transfer_journal::append(const unsigned short& lane,
+							  const vector<char>& entry)
+{
+	auto& target = _lanes[lane % _lane_count];
+	scoped_lock<mutex> guard(target._mutex);
+
+	target._buffer.insert(target._buffer.end(), entry.begin(), entry.end());
+}
+
+void transfer_journal::received(const unsigned short& lane,
+								string_view indication_id,
+								const uint32_t& index)
+{
+	auto& target = _lanes[lane % _lane_count];
+	scoped_lock<mutex> guard(target._mutex);
+
+	size_t offset = open_entry(target._buffer, entry_types::received);
+	put(target._buffer, indication_id);
+	put(target._buffer, index);
+	seal(target._buffer, offset);
+}
+
+void transfer_journal::failed(const unsigned short& lane,
+							  string_view indication_id,
+							  const uint32_t& failed_count,
+							  const uint32_t& index)
+{
+	auto& target = _lanes[lane % _lane_count];
+	scoped_lock<mutex> guard(target._mutex);
+
+	// the running count, not an increment, so replaying it over a snapshot
+	// that already holds it is harmless. the index is UINT32_MAX for a
+	// failure reported without a path.
+	size_t offset = open_entry(target._buffer, entry_types::failed);
+	put(target._buffer, indication_id);
+	put(target._buffer, failed_count);
+	put(target._buffer, index);
+	seal(target._buffer, offset);
+}
+
+void transfer_journal::clear(const unsigned short& lane,
+							 string_view indication_id)
+{
+	auto& target = _lanes[lane % _lane_count];
+	scoped_lock<mutex> guard(target._mutex);
+
+	size_t offset = open_entry(target._buffer, entry_types::clear);
+	put(target._buffer, indication_id);
+	seal(target._buffer, offset);
+}
+
+void transfer_journal::run(void)
+{
+	unique_lock<mutex> lock(_mutex);
+	while (!_condition.wait_for(lock, _commit_interval,
+								[this]() { return _stop; }))
+	{
+		lock.unlock();
+
+		if (commit() && _snapshot_size > 0 && _written >= _snapshot_size)
+		{
+			compact();
+		}
+
+		lock.lock();
+	}
+}
+
+bool transfer_journal::commit(void)
+{
+	// events of a commit that failed stay in front of the newer ones
+	for (unsigned short index = 0; index < _lane_count; ++index)
+	{
+		scoped_lock<mutex> guard(_lanes[index]._mutex);
+
+		_pending.insert(_pending.end(), _lanes[index]._buffer.begin(),
+						_lanes[index]._buffer.end());
+		_lanes[index]._buffer.clear();
+	}
+
+	if (_pending.empty())
+	{
+		return true;
+	}
+
+	// before start() there is no journal to write to, and after a failed
+	// commit the file is opened again
+	const string file_path = journal_path(_generation);
+	if (_file == nullptr)
+	{
+		if (_capture == nullptr)
+		{
+			return false;
+		}
+
+		_file = fopen(file_path.c_str(), "ab");
+		if (_file == nullptr)
+		{
+			return false;
+		}
+	}
+
+	if (fwrite(_pending.data(), 1, _pending.size(), _file) != _pending.size()
+		|| !sync(_file))
+	{
+		// whatever reached the file is cut off again, so the next attempt
+		// neither leaves a torn entry in front of it nor repeats one
+		fclose(_file);
+		error_code error;
+		filesystem::resize_file(file_path, _written, error);
+		_file = fopen(file_path.c_str(), "ab");
+
+		return false;
+	}
+
+	_written += _pending.size();
+	_pending.clear();
+
+	return true;
+}
+
+bool transfer_journal::compact(void)
+{
+	// everything appended so far was applied in memory before, so the
+	// capture below holds it; events appended from here on go to the next
+	// generation and are replayed on top of the snapshot
+	if (!commit() || !open(_generation + 1))
+	{
+		return false;
+	}
+
+	vector<char> body;
+	uint64_t count = 0;
+	_capture(
+		[&](const transfer_record& record)
+		{
+			const uint32_t file_count = record.files.size();
+			const uint64_t counts = record.counts.load(memory_order_acquire);
+
+			put(body, string_view(record.indication_id));
+			put(body, string_view(record.condition.source_id()));
+			put(body, string_view(record.condition.source_sub_id()));
+			put(body, file_count);
+			put(body, (uint8_t)(record.file_sizes.empty() ? 0 : 1));
+			put(body, (uint32_t)(counts >> 32));
+			record.files.paths().for_each(
+				[&](const uint32_t&, string_view file_path)
+				{ put(body, file_path); });
+			for (auto& file_size : record.file_sizes)
+			{
+				put(body, file_size);
+			}
+
+			uint64_t received = 0;
+			uint64_t failed = 0;
+			vector<uint64_t> failed_words;
+			failed_words.reserve(((size_t)file_count + 63) / 64);
+			for (uint32_t index = 0; index < file_count; ++index)
+			{
+				if (record.files.marked(index))
+				{
+					received |= 1ull << (index & 63);
+				}
+				else if (record.files.failed(index))
+				{
+					failed |= 1ull << (index & 63);
+				}
+
+				if ((index & 63) == 63 || index + 1 == file_count)
+				{
+					put(body, received);
+					failed_words.push_back(failed);
+					received = 0;
+					failed = 0;
+				}
+			}
+
+			for (auto& word : failed_words)
+			{
+				put(body, word);
+			}
+
+			++count;
+		});
+
+	vector<char> header;
+	put(header, snapshot_magic);
+	put(header, _generation);
+	put(header, count);
+	put(header, crc32c(body.data(), body.size()));
+
+	const string snapshot_path = _path + ".snapshot";
+	const string temporary_path = snapshot_path + ".tmp";
+
+	FILE* snapshot = fopen(temporary_path.c_str(), "wb");
+	if (snapshot == nullptr)
+	{
+		return false;
+	}
+
+	bool written
+		= fwrite(header.data(), 1, header.size(), snapshot) == header.size()
+		  && fwrite(body.data(), 1, body.size(), snapshot) == body.size()
+		  && sync(snapshot);
+	fclose(snapshot);
+
+	error_code error;
+	if (!written)
+	{
+		filesystem::remove(temporary_path, error);
+		return false;
+	}
+
+	filesystem::rename(temporary_path, snapshot_path, error);
+	if (error)
+	{
+		return false;
+	}
+
+	sync_directory(filesystem::path(snapshot_path).parent_path());
+
+	for (auto& generation : generations())
+	{
+		if (generation < _generation)
+		{
+			filesystem::remove(journal_path(generation), error);
+		}
+	}
+
+	return true;
+}
+
+bool transfer_journal::open(const uint64_t& generation)
+{
+	FILE* file = fopen(journal_path(generation).c_str(), "ab");
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	if (_file != nullptr)
+	{
+		fclose(_file);
+	}
+
+	_file = file;
+	_generation = generation;
+	_written = 0;
+
+	return true;
+}
+
+size_t transfer_journal::replay(
+	const string& file_path, unordered_map<string, journal_transfer>& transfers)
+{
+	mapped_file journal(file_path);
+
+	reader input(journal.data(), journal.size());
+	for (size_t count = 0;; ++count)
+	{
+		uint32_t size = 0;
+		uint32_t crc = 0;
+		// a torn tail ends the journal; nothing behind it was acknowledged
+		if (!input.get(size) || !input.get(crc) || input.remained() < size
+			|| crc32c(input.current(), size) != crc)
+		{
+			return count;
+		}
+
+		reader entry(input.current(), size);
+		input.skip(size);
+
+		uint8_t type = 0;
+		string_view indication_id;
+		if (!entry.get(type) || !entry.get(indication_id))
+		{
+			return count;
+		}
+
+		switch ((entry_types)type)
+		{
+		case entry_types::set:
+		{
+			// a set replaces whatever a snapshot taken later still holds
+			journal_transfer transfer;
+			transfer.indication_id.assign(indication_id);
+			uint32_t file_count = 0;
+			uint8_t sized = 0;
+			if (!entry.get(transfer.source_id)
+				|| !entry.get(transfer.source_sub_id)
+				|| !entry.get(file_count) || !entry.get(sized))
+			{
+				return count;
+			}
+
+			for (uint32_t file = 0; file < file_count; ++file)
+			{
+				string_view path;
+				if (!entry.get(path))
+				{
+					return count;
+				}
+
+				transfer.file_list.push_back(path);
+			}
+			transfer.file_list.shrink_to_fit();
+
+			if (sized != 0 && !entry.get(transfer.file_sizes, file_count))
+			{
+				return count;
+			}
+
+			transfer.received.assign(((size_t)file_count + 63) / 64, 0);
+			transfer.failed_files.assign(transfer.received.size(), 0);
+			transfers.insert_or_assign(transfer.indication_id,
+									   std::move(transfer));
+			break;
+		}
+		case entry_types::received:
+		{
+			uint32_t index = 0;
+			auto target = transfers.find(string(indication_id));
+			if (!entry.get(index) || target == transfers.end()
+				|| index >= target->second.file_list.size())
+			{
+				break;
+			}
+
+			target->second.received[index >> 6] |= 1ull << (index & 63);
+			break;
+		}
+		case entry_types::failed:
+		{
+			uint32_t failed_count = 0;
+			uint32_t index = UINT32_MAX;
+			auto target = transfers.find(string(indication_id));
+			if (!entry.get(failed_count) || !entry.get(index)
+				|| target == transfers.end())
+			{
+				break;
+			}
+
+			target->second.failed = max(target->second.failed, failed_count);
+			if (index < target->second.file_list.size())
+			{
+				target->second.failed_files[index >> 6]
+					|= 1ull << (index & 63);
+			}
+			break;
+		}
+		case entry_types::clear:
+			transfers.erase(string(indication_id));
+			break;
+		default:
+			return count;
+		}
+	}
+}
+
+string transfer_journal::journal_path(const uint64_t& generation) const
+{
+	return _path + "." + to_string(generation) + ".wal";
+}
+
+vector<uint64_t> transfer_journal::generations(void) const
+{
+	vector<uint64_t> result;
+
+	const filesystem::path base(_path);
+	const string prefix = base.filename().string() + ".";
+	const filesystem::path directory
+		= base.has_parent_path() ? base.parent_path() : filesystem::path(".");
+
+	error_code error;
+	for (auto& item : filesystem::directory_iterator(directory, error))
+	{
+		const string name = item.path().filename().string();
+		if (name.size() <= prefix.size() + 4 || name.rfind(prefix, 0) != 0
+			|| name.compare(name.size() - 4, 4, ".wal") != 0)
+		{
+			continue;
+		}
+
+		const string number
+			= name.substr(prefix.size(), name.size() - prefix.size() - 4);
+		if (number.find_first_not_of("0123456789") != string::npos)
+		{
+			continue;
+		}
+
+		result.push_back(stoull(number));
+	}
+
+	sort(result.begin(), result.end());
+
+	return result;
+}
@@ -0,0 +1,147 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#pragma once
+
+#include "path_manifest.h"
+#include "transfer_table.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// state of one transfer as rebuilt from the journal
+struct journal_transfer
+{
+	string indication_id;
+	string source_id;
+	string source_sub_id;
+	path_manifest file_list;
+	vector<uint64_t> file_sizes;
+	// one bit per entry of file_list
+	vector<uint64_t> received;
+	vector<uint64_t> failed_files;
+	// includes failures reported without a path
+	uint32_t failed = 0;
+};
+
+// append-only journal of set, received and clear events. events land in a
+// buffer per lane, so writers on different shards never share a lock, and a
+// writer thread commits all lanes with a single fsync per interval. once the
+// journal outgrows snapshot_size the live state is written to a snapshot and
+// the journal restarts empty under the next generation. events of a commit
+// that fails are kept and written again by the next one.
+//
+// files: <path>.snapshot and <path>.<generation>.wal
+class transfer_journal
+{
+public:
+	transfer_journal(const string& path,
+					 const unsigned short& lane_count,
+					 const chrono::milliseconds& commit_interval,
+					 const uint64_t& snapshot_size);
+	~transfer_journal(void);
+
+public:
+	// rebuilds the state from the snapshot and the journal behind it
+	vector<journal_transfer> recover(void);
+
+	// capture visits every live transfer from the writer thread and has to
+	// keep each record from being erased while it is visited
+	using capture_function = function<void(
+		const function<void(const transfer_record&)>& visit)>;
+
+	// opens the next generation and starts committing. a journal replayed
+	// by recover() is compacted right away.
+	bool start(const capture_function& capture);
+
+	// every event has to be appended after it was applied in memory and
+	// while its shard lock still orders it against other events of the
+	// same transfer. set entries are encoded up front, outside that lock.
+	static vector<char> set_entry(const transfer_record& record);
+	void append(const unsigned short& lane, const vector<char>& entry);
+	void received(const unsigned short& lane,
+				  string_view indication_id,
+				  const uint32_t& index);
+	void failed(const unsigned short& lane,
+				string_view indication_id,
+				const uint32_t& failed_count,
+				const uint32_t& index);
+	void clear(const unsigned short& lane, string_view indication_id);
+
+private:
+	struct alignas(64) lane
+	{
+		mutex _mutex;
+		vector<char> _buffer;
+	};
+
+	void run(void);
+	bool commit(void);
+	bool compact(void);
+	bool open(const uint64_t& generation);
+	size_t replay(const string& file_path,
+				  unordered_map<string, journal_transfer>& transfers);
+	string journal_path(const uint64_t& generation) const;
+	vector<uint64_t> generations(void) const;
+
+private:
+	string _path;
+	unsigned short _lane_count;
+	unique_ptr<lane[]> _lanes;
+	chrono::milliseconds _commit_interval;
+	uint64_t _snapshot_size;
+
+	capture_function _capture;
+	// owned by the writer thread once it runs
+	FILE* _file;
+	uint64_t _generation;
+	uint64_t _written;
+	bool _replayed;
+	vector<char> _pending;
+
+	bool _stop;
+	mutex _mutex;
+	condition_variable _condition;
+	thread _thread;
+};
@@ -0,0 +1,93 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "transfer_map.h"
+
+transfer_map::transfer_map(void) {}
+
+transfer_map::~transfer_map(void) {}
+
+size_t transfer_map::hash(string_view indication_id)
+{
+	return transfer_table::hash(indication_id);
+}
+
+transfer_record* transfer_map::find(const size_t& hash,
+									string_view indication_id)
+{
+	auto target = _records.find(indication_id);
+	if (target == _records.end() || target->second.hash != hash)
+	{
+		return nullptr;
+	}
+
+	return target->second.record.get();
+}
+
+transfer_record* transfer_map::insert(const size_t& hash,
+									  unique_ptr<transfer_record> record)
+{
+	string_view key = record->indication_id;
+
+	auto [target, added] = _records.try_emplace(key, entry{ hash, nullptr });
+	if (!added)
+	{
+		return nullptr;
+	}
+
+	target->second.record = std::move(record);
+
+	return target->second.record.get();
+}
+
+void transfer_map::erase(const size_t& hash, transfer_record* record)
+{
+	auto target = _records.find(record->indication_id);
+	if (target == _records.end() || target->second.hash != hash
+		|| target->second.record.get() != record)
+	{
+		return;
+	}
+
+	_records.erase(target);
+}
+
+void transfer_map::for_each(
+	const function<void(const size_t&, transfer_record&)>& callback)
+{
+	for (auto& [indication_id, target] : _records)
+	{
+		callback(target.hash, *target.record);
+	}
+}
+
+size_t transfer_map::size(void) const { return _records.size(); }
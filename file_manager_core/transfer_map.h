@@ -0,0 +1,76 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+
+#include "transfer_table.h"
+
+using namespace std;
+
+// node-based storage with the interface of transfer_table. lookups cost a
+// node hop more, but iteration only visits live transfers, so the flush,
+// expiry and snapshot passes stay cheap on a shard that once held far more
+// transfers than it does now.
+class transfer_map
+{
+public:
+	transfer_map(void);
+	~transfer_map(void);
+
+public:
+	static size_t hash(string_view indication_id);
+
+	transfer_record* find(const size_t& hash, string_view indication_id);
+	transfer_record* insert(const size_t& hash,
+							unique_ptr<transfer_record> record);
+	void erase(const size_t& hash, transfer_record* record);
+	void for_each(const function<void(const size_t&, transfer_record&)>&
+					  callback);
+
+	size_t size(void) const;
+
+private:
+	struct entry
+	{
+		size_t hash;
+		unique_ptr<transfer_record> record;
+	};
+
+	// keys view the indication_id of their own record
+	unordered_map<string_view, entry> _records;
+};
@@ -0,0 +1,175 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+
+#include "transfer_table.h"
+
+
+// 0 is reserved for an empty slot
+constexpr size_t empty_slot = 0;
+constexpr size_t initial_capacity = 16;
+
+transfer_table::transfer_table(void)
+	: _count(0)
+	, _mask(initial_capacity - 1)
+	, _hashes(initial_capacity, empty_slot)
+	, _records(initial_capacity)
+{
+}
+
+transfer_table::~transfer_table(void) {}
+
+size_t transfer_table::hash(string_view indication_id)
+{
+	size_t result = std::hash<string_view>{}(indication_id);
+
+	return (result == empty_slot) ? 1 : result;
+}
+
+transfer_record* transfer_table::find(const size_t& hash,
+									  string_view indication_id)
+{
+	for (size_t index = hash & _mask;; index = (index + 1) & _mask)
+	{
+		if (_hashes[index] == empty_slot)
+		{
+			return nullptr;
+		}
+
+		if (_hashes[index] == hash
+			&& _records[index]->indication_id == indication_id)
+		{
+			return _records[index].get();
+		}
+	}
+}
+
+transfer_record* transfer_table::insert(const size_t& hash,
+										unique_ptr<transfer_record> record)
+{
+	if ((_count + 1) * 4 > _hashes.size() * 3)
+	{
+		grow();
+	}
+
+	size_t index = hash & _mask;
+	for (; _hashes[index] != empty_slot; index = (index + 1) & _mask)
+	{
+		if (_hashes[index] == hash
+			&& _records[index]->indication_id == record->indication_id)
+		{
+			return nullptr;
+		}
+	}
+
+	_hashes[index] = hash;
+	_records[index] = std::move(record);
+	++_count;
+
+	return _records[index].get();
+}
+
+void transfer_table::erase(const size_t& hash, transfer_record* record)
+{
+	size_t hole = hash & _mask;
+	while (_records[hole].get() != record)
+	{
+		if (_hashes[hole] == empty_slot)
+		{
+			return;
+		}
+
+		hole = (hole + 1) & _mask;
+	}
+
+	// backward shift deletion keeps every probe sequence intact without
+	// leaving tombstones behind
+	for (size_t next = (hole + 1) & _mask; _hashes[next] != empty_slot;
+		 next = (next + 1) & _mask)
+	{
+		size_t home = _hashes[next] & _mask;
+		if (((next - home) & _mask) < ((next - hole) & _mask))
+		{
+			continue;
+		}
+
+		_hashes[hole] = _hashes[next];
+		_records[hole] = std::move(_records[next]);
+		hole = next;
+	}
+
+	_hashes[hole] = empty_slot;
+	_records[hole].reset();
+	--_count;
+}
+
+void transfer_table::for_each(
+	const function<void(const size_t&, transfer_record&)>& callback)
+{
+	for (size_t index = 0; index < _hashes.size(); ++index)
+	{
+		if (_hashes[index] != empty_slot)
+		{
+			callback(_hashes[index], *_records[index]);
+		}
+	}
+}
+
+size_t transfer_table::size(void) const { return _count; }
+
+void transfer_table::grow(void)
+{
+	vector<size_t> hashes(_hashes.size() * 2, empty_slot);
+	vector<unique_ptr<transfer_record>> records(_records.size() * 2);
+	size_t mask = hashes.size() - 1;
+
+	for (size_t source = 0; source < _hashes.size(); ++source)
+	{
+		if (_hashes[source] == empty_slot)
+		{
+			continue;
+		}
+
+		size_t index = _hashes[source] & mask;
+		while (hashes[index] != empty_slot)
+		{
+			index = (index + 1) & mask;
+		}
+
+		hashes[index] = _hashes[source];
+		records[index] = std::move(_records[source]);
+	}
+
+	_hashes.swap(hashes);
+	_records.swap(records);
+	_mask = mask;
+}
@@ -0,0 +1,134 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file_index.h"
+#include "transfer_condition.h"
+
+using namespace std;
+
+struct transfer_record
+{
+	string indication_id;
+	transfer_condition condition;
+	file_index files;
+
+	// transferred count in the low 32 bits and failed count in the high 32
+	// bits, so one compare-and-swap both admits a notification and tells
+	// whether it was the last one of the transfer
+	atomic<uint64_t> counts{ 0 };
+	// last reported percentage in the low 16 bits and the steady clock time
+	// of that report in milliseconds above them
+	atomic<uint64_t> notified{ 0 };
+
+	// byte weighted progress, only used when set() was given file sizes.
+	// file_bytes follows the positions of file_index.
+	uint64_t total_bytes = 0;
+	vector<uint64_t> file_sizes;
+	unique_ptr<atomic<uint64_t>[]> file_bytes;
+	atomic<uint64_t> transferred_bytes{ 0 };
+
+	// expiry bookkeeping in ticks of file_manager's timer wheel. touching a
+	// record is a single relaxed store; the wheel checks it lazily.
+	uint64_t serial = 0;
+	uint64_t created_tick = 0;
+	atomic<uint64_t> touched_tick{ 0 };
+
+	// steady clock microseconds of set() and of the latest settled file,
+	// only kept when file_manager collects statistics
+	uint64_t set_time = 0;
+	atomic<uint64_t> last_file_time{ 0 };
+
+	// whether reports of this record carry steady clock times
+	bool timed = false;
+
+	// sum of the folded digests of the files settled so far, reported on
+	// completion. restored is set when the journal brought back files whose
+	// digests were not kept.
+	atomic<uint64_t> digest{ 0 };
+	bool restored = false;
+
+	// exponentially weighted throughput, sampled by the reporting thread
+	mutex rate_mutex;
+	uint64_t rate_time = 0;
+	uint64_t rate_bytes = 0;
+	atomic<uint64_t> bytes_per_second{ 0 };
+
+	// only filled when file_manager retains paths, as positions in files.
+	// a failure reported without a path has no position and is left out.
+	mutex paths_mutex;
+	vector<uint32_t> transferred_list;
+	vector<uint32_t> failed_list;
+};
+
+// open addressing table with linear probing keyed by a precomputed hash of
+// indication_id. hashes are kept in their own array so that probing never
+// touches the records themselves until a candidate hash matches. records
+// are owned through pointers so that their atomics never move on growth.
+class transfer_table
+{
+public:
+	transfer_table(void);
+	~transfer_table(void);
+
+public:
+	static size_t hash(string_view indication_id);
+
+	transfer_record* find(const size_t& hash, string_view indication_id);
+	transfer_record* insert(const size_t& hash,
+							unique_ptr<transfer_record> record);
+	void erase(const size_t& hash, transfer_record* record);
+	void for_each(const function<void(const size_t&, transfer_record&)>&
+					  callback);
+
+	size_t size(void) const;
+
+private:
+	void grow(void);
+
+private:
+	size_t _count;
+	size_t _mask;
+	vector<size_t> _hashes;
+	vector<unique_ptr<transfer_record>> _records;
+};
@@ -36,6 +36,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <map>
 #include <functional>
+#include <filesystem>
 
 #include "utilities/parsing/argument_parser.h"
 #include "utilities/conversion/convert_string.h"
@@ -43,6 +44,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "logger/core/logger.h"
 
 #include "container.h"
+#include "values/bool_value.h"
+#include "values/numeric_value.h"
+#include "values/string_value.h"
 #include "network/network.h"
 
 #include <algorithm>
@@ -57,7 +61,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "fmt/format.h"
 #include "fmt/xchar.h"
 
+#include "blob_store.h"
+#include "chunk_cipher.h"
+#include "chunk_compressor.h"
+#include "chunk_receiver.h"
 #include "file_manager.h"
+#include "send_engine.h"
 
 constexpr auto PROGRAM_NAME = "main_server";
 
@@ -69,6 +78,10 @@ using namespace utility_module;
 // file_handler는 utility_module에 포함됨
 // argument_parser는 utility_module에 포함됨
 
+using ullong_value
+	= numeric_value<unsigned long long, value_types::ullong_value>;
+using llong_value = numeric_value<long long, value_types::llong_value>;
+
 #ifdef _DEBUG
 bool encrypt_mode = false;
 bool compress_mode = false;
@@ -80,16 +93,57 @@ bool compress_mode = true;
 log_types log_level = log_types::Information;
 bool write_console = false;
 #endif
+// in KB, clamped to 64 KB - 4 MB; compressed transfers use it as their
+// chunk size
 unsigned short compress_block_size = 1024;
 
-string connection_key = "main_connection_key";
+// chunks are only encrypted under a key set with --connection_key, as the
+// default one every build shares protects nothing
+const string default_connection_key = "main_connection_key";
+string connection_key = default_connection_key;
 unsigned short server_port = 9753;
 unsigned short high_priority_count = 4;
 unsigned short normal_priority_count = 4;
 unsigned short low_priority_count = 4;
+unsigned short file_manager_shard_count = 16;
+bool retain_transfer_paths = false;
+unsigned short notification_interval = 0;
+unsigned short notification_step = 1;
+unsigned short transfer_idle_timeout = 0;
+unsigned short transfer_timeout = 0;
+string journal_path = "";
+unsigned short journal_commit_interval = 10;
+unsigned short statistics_interval = 0;
+unsigned short transfer_chunk_size = 1024;
+unsigned short send_worker_count = 4;
+// 0 takes one per core
+unsigned short pipeline_worker_count = 0;
+unsigned short pipeline_depth = 0;
+unsigned short stripe_size = 64;
+unsigned short max_stripes = 4;
+bool delta_transfer = false;
+bool verify_chunks = true;
+unsigned short chunk_retries = 3;
+string blob_store_path = "";
+string data_host = "127.0.0.1";
+unsigned short data_port = 0;
+// uploads land below it, the working directory when empty
+string data_root = "";
 size_t session_limit_count = 0;
 
-shared_ptr<file_manager> _file_manager = nullptr;
+// main_server tracks few transfers reported from few threads, so a plain
+// mutex per shard is cheaper than a reader count
+using server_file_manager = basic_file_manager<exclusive_locking,
+											   transfer_table,
+											   coalesced_notification>;
+
+shared_ptr<server_file_manager> _file_manager = nullptr;
+shared_ptr<send_engine> _send_engine = nullptr;
+shared_ptr<chunk_compressor> _chunk_compressor = nullptr;
+shared_ptr<chunk_cipher> _chunk_cipher = nullptr;
+shared_ptr<chunk_pipeline> _chunk_pipeline = nullptr;
+shared_ptr<blob_store> _blob_store = nullptr;
+shared_ptr<chunk_receiver> _chunk_receiver = nullptr;
 shared_ptr<messaging_server> _main_server = nullptr;
 
 void signal_callback(int signum);
@@ -107,6 +161,23 @@ void received_message(shared_ptr<value_container> container);
 void transfer_file(shared_ptr<value_container> container);
 void upload_files(shared_ptr<value_container> container);
 
+void flushed_transfer_condition(shared_ptr<value_container> container);
+void compressed_transfer(shared_ptr<value_container> container);
+void sent_bytes(const string& indication_id,
+				const string& target_path,
+				const uint64_t& bytes);
+void sent_file(const string& indication_id,
+			   const string& target_path,
+			   const bool& sent,
+			   const uint32_t& digest);
+void received_chunk(const string& indication_id,
+					const string& target_path,
+					const uint64_t& bytes);
+void received_chunked_file(const string& indication_id,
+						   const string& target_path,
+						   const bool& received,
+						   const uint32_t& digest);
+
 void received_file(const wstring& source_id,
 				   const wstring& source_sub_id,
 				   const wstring& indication_id,
@@ -131,6 +202,10 @@ int main(int argc, char* argv[])
 	signal(SIGFPE, signal_callback);
 	signal(SIGSEGV, signal_callback);
 	signal(SIGTERM, signal_callback);
+#ifndef _WIN32
+	// a receiver hanging up must fail its transfer, not end the server
+	signal(SIGPIPE, SIG_IGN);
+#endif
 
 	log_module::set_title(PROGRAM_NAME);
 	if (write_console) {
@@ -139,10 +214,142 @@ int main(int argc, char* argv[])
 	log_module::file_target(log_level);
 	log_module::start();
 
+	if (encrypt_mode && connection_key == default_connection_key)
+	{
+		log_module::write_error(
+			"cannot encrypt chunks under the default connection key, set "
+			"--connection_key or turn --encrypt_mode off");
+		log_module::stop();
+
+		return 0;
+	}
+
 	_registered_messages.insert({ "transfer_file", &transfer_file });
 	_registered_messages.insert({ "upload_files", &upload_files });
 
-	_file_manager = make_shared<file_manager>();
+	file_manager_options options;
+	options.shard_count = file_manager_shard_count;
+	options.retain_paths = retain_transfer_paths;
+	options.notification_interval
+		= chrono::milliseconds(notification_interval);
+	options.notification_step = notification_step;
+	options.idle_timeout = chrono::seconds(transfer_idle_timeout);
+	options.transfer_timeout = chrono::seconds(transfer_timeout);
+	options.journal_path = journal_path;
+	options.journal_commit_interval
+		= chrono::milliseconds(journal_commit_interval);
+	options.statistics_interval = chrono::milliseconds(statistics_interval);
+	_file_manager = make_shared<server_file_manager>(options);
+	_file_manager->set_notification(&flushed_transfer_condition);
+
+	// compressed or encrypted chunks have to be rewritten in memory, so only
+	// plain transfers let the kernel copy file pages into the socket
+	send_options send_option;
+	send_option.chunk_size = (uint32_t)transfer_chunk_size * 1024;
+	if (compress_mode)
+	{
+		send_option.chunk_size
+			= (uint32_t)clamp<unsigned short>(compress_block_size, 64, 4096)
+			  * 1024;
+	}
+	send_option.zero_copy = !compress_mode && !encrypt_mode;
+	send_option.stripe_size = (uint64_t)stripe_size << 20;
+	send_option.max_stripes = max_stripes;
+	send_option.delta = delta_transfer;
+	send_option.verify = verify_chunks;
+	send_option.retries = chunk_retries;
+	send_option.pipeline_depth = pipeline_depth;
+	send_option.secret = connection_key;
+	_send_engine = make_shared<send_engine>(send_worker_count, send_option,
+											&sent_bytes, &sent_file);
+
+	// chunks are compressed one by one where it pays, see chunk_compressor
+	if (compress_mode)
+	{
+		_chunk_compressor = make_shared<chunk_compressor>();
+		_send_engine->add_transform(
+			[](vector<char>& payload, chunk_header& header)
+			{ return _chunk_compressor->encode(payload, header); });
+		_send_engine->set_observer(
+			[](const uint64_t& bytes, const uint64_t& nanoseconds)
+			{ _chunk_compressor->transmitted(bytes, nanoseconds); });
+	}
+
+	// chunks are encrypted after compression, as ciphertext does not
+	// compress. the key comes from the connection key middle_server shares.
+	if (encrypt_mode)
+	{
+		_chunk_cipher = make_shared<chunk_cipher>(connection_key);
+		_send_engine->add_transform(
+			[](vector<char>& payload, chunk_header& header)
+			{ return _chunk_cipher->encrypt(payload, header); });
+		log_module::write_information(
+			fmt::format("encrypting chunks with AES-256-GCM on {}",
+						chunk_cipher::implementation())
+				.c_str());
+	}
+
+	// transformed chunks are spread over every core, so one large transfer
+	// is not held to the thread sending it
+	if (compress_mode || encrypt_mode)
+	{
+		_chunk_pipeline = make_shared<chunk_pipeline>(pipeline_worker_count);
+		_send_engine->set_pipeline(_chunk_pipeline);
+	}
+
+	// uploads offered by their blocks are kept once per distinct block, and
+	// the paths they were stored at are served back from the store
+	if (!blob_store_path.empty())
+	{
+		_blob_store = make_shared<blob_store>(blob_store_path);
+		if (!_blob_store->open())
+		{
+			log_module::write_error(
+				fmt::format("cannot open the blob store at {}",
+							blob_store_path)
+					.c_str());
+			_blob_store.reset();
+		}
+		else
+		{
+			_send_engine->set_store(_blob_store);
+			log_module::write_information(
+				fmt::format("storing uploads in {} with {} blocks",
+							blob_store_path, _blob_store->block_count())
+					.c_str());
+		}
+	}
+
+	if (data_port > 0)
+	{
+		_chunk_receiver = make_shared<chunk_receiver>(
+			io_options(), &received_chunk, &received_chunked_file);
+		_chunk_receiver->set_store(_blob_store);
+		// only files of uploads this server accepted, below its root, from
+		// peers holding the connection key
+		_chunk_receiver->set_root(data_root);
+		_chunk_receiver->set_secret(connection_key);
+		_chunk_receiver->set_registry(
+			[](const string& indication_id, const string& file_path)
+			{ return _file_manager->expects(indication_id, file_path); });
+		_chunk_receiver->add_transform(chunk_header::compressed,
+									   &chunk_compressor::decode);
+		if (_chunk_cipher != nullptr)
+		{
+			_chunk_receiver->add_transform(
+				chunk_header::encrypted,
+				[](vector<char>& payload, const chunk_header& header)
+				{ return _chunk_cipher->decrypt(payload, header); });
+			_chunk_receiver->require(chunk_header::encrypted);
+		}
+		if (!_chunk_receiver->start(data_port))
+		{
+			log_module::write_error(
+				fmt::format("cannot listen for uploads on port {}", data_port)
+					.c_str());
+			_chunk_receiver.reset();
+		}
+	}
 
 	create_main_server();
 
@@ -151,6 +358,24 @@ int main(int argc, char* argv[])
 		this_thread::sleep_for(chrono::milliseconds(100));
 	}
 
+	_chunk_receiver.reset();
+	_send_engine.reset();
+	_chunk_pipeline.reset();
+	_chunk_compressor.reset();
+	_chunk_cipher.reset();
+
+	if (statistics_interval > 0)
+	{
+		auto latency = _file_manager->latency();
+		log_module::write_information(
+			fmt::format("transfer latency in us: first file p50 {} p99 {}, "
+						"file gap p50 {} p99 {}, completion p50 {} p99 {}",
+						latency.first_file.p50, latency.first_file.p99,
+						latency.file_gap.p50, latency.file_gap.p99,
+						latency.completion.p50, latency.completion.p99)
+				.c_str());
+	}
+
 	log_module::stop();
 
 	return 0;
@@ -208,6 +433,144 @@ bool parse_arguments(argument_manager& arguments)
 		low_priority_count = *ushort_target;
 	}
 
+	ushort_target = arguments.to_ushort("--file_manager_shard_count");
+	if (ushort_target != std::nullopt)
+	{
+		file_manager_shard_count = *ushort_target;
+	}
+
+	bool_target = arguments.to_bool("--retain_transfer_paths");
+	if (bool_target != std::nullopt)
+	{
+		retain_transfer_paths = *bool_target;
+	}
+
+	bool_target = arguments.to_bool("--delta_transfer");
+	if (bool_target != std::nullopt)
+	{
+		delta_transfer = *bool_target;
+	}
+
+	bool_target = arguments.to_bool("--verify_chunks");
+	if (bool_target != std::nullopt)
+	{
+		verify_chunks = *bool_target;
+	}
+
+	ushort_target = arguments.to_ushort("--notification_interval");
+	if (ushort_target != std::nullopt)
+	{
+		notification_interval = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--notification_step");
+	if (ushort_target != std::nullopt)
+	{
+		notification_step = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--transfer_idle_timeout");
+	if (ushort_target != std::nullopt)
+	{
+		transfer_idle_timeout = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--transfer_timeout");
+	if (ushort_target != std::nullopt)
+	{
+		transfer_timeout = *ushort_target;
+	}
+
+	auto journal_target = arguments.to_string("--journal_path");
+	if (journal_target != std::nullopt)
+	{
+		journal_path = *journal_target;
+	}
+
+	auto key_target = arguments.to_string("--connection_key");
+	if (key_target != std::nullopt && !key_target->empty())
+	{
+		connection_key = *key_target;
+	}
+
+	auto store_target = arguments.to_string("--blob_store_path");
+	if (store_target != std::nullopt)
+	{
+		blob_store_path = *store_target;
+	}
+
+	auto host_target = arguments.to_string("--data_host");
+	if (host_target != std::nullopt)
+	{
+		data_host = *host_target;
+	}
+
+	ushort_target = arguments.to_ushort("--data_port");
+	if (ushort_target != std::nullopt)
+	{
+		data_port = *ushort_target;
+	}
+
+	auto root_target = arguments.to_string("--data_root");
+	if (root_target != std::nullopt)
+	{
+		data_root = *root_target;
+	}
+
+	ushort_target = arguments.to_ushort("--journal_commit_interval");
+	if (ushort_target != std::nullopt)
+	{
+		journal_commit_interval = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--statistics_interval");
+	if (ushort_target != std::nullopt)
+	{
+		statistics_interval = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--transfer_chunk_size");
+	if (ushort_target != std::nullopt && *ushort_target > 0)
+	{
+		transfer_chunk_size = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--send_worker_count");
+	if (ushort_target != std::nullopt && *ushort_target > 0)
+	{
+		send_worker_count = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--pipeline_worker_count");
+	if (ushort_target != std::nullopt)
+	{
+		pipeline_worker_count = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--pipeline_depth");
+	if (ushort_target != std::nullopt)
+	{
+		pipeline_depth = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--stripe_size");
+	if (ushort_target != std::nullopt)
+	{
+		stripe_size = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--max_stripes");
+	if (ushort_target != std::nullopt && *ushort_target > 0)
+	{
+		max_stripes = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--chunk_retries");
+	if (ushort_target != std::nullopt)
+	{
+		chunk_retries = *ushort_target;
+	}
+
 	auto int_target = arguments.to_int("--log_types");
 	if (int_target != std::nullopt)
 	{
@@ -312,10 +675,56 @@ void transfer_file(shared_ptr<value_container> container)
 
 	log_module::write_information(						   "received message: transfer_file");
 
-	// Note: The new messaging_server API doesn't have send_files method
-	// This would need to be implemented differently or the messaging system 
-	// would need to be extended to support file transfers
-	log_module::write_information(						   "File transfer not implemented in new messaging system API");
+	// the requester names the data endpoint it receives chunk frames on
+	send_job job;
+	job.indication_id = container->get_value("indication_id")->to_string();
+	job.host = container->get_value("data_host")->to_string();
+	job.port = container->get_value("data_port")->to_ushort();
+
+	vector<string> target_paths;
+	vector<uint64_t> target_sizes;
+	for (auto& file : container->value_array("file"))
+	{
+		auto source_array = file->value_array("source");
+		auto target_array = file->value_array("target");
+		if (source_array.empty() || target_array.empty())
+		{
+			continue;
+		}
+
+		send_file item{ source_array[0]->to_string(),
+						target_array[0]->to_string() };
+
+		// sizes come from the disk, so progress is weighted by bytes
+		error_code error;
+		uint64_t size = filesystem::file_size(item.source_path, error);
+		target_sizes.push_back(error ? 0 : size);
+		target_paths.push_back(item.target_path);
+		job.files.push_back(std::move(item));
+	}
+
+	if (job.files.empty() || job.host.empty() || job.port == 0)
+	{
+		log_module::write_error(
+			fmt::format("cannot transfer files of {} without files or a data "
+						"endpoint",
+						job.indication_id)
+				.c_str());
+		return;
+	}
+
+	if (!_file_manager->set(job.indication_id, container->source_id(),
+							container->source_sub_id(), target_paths,
+							target_sizes))
+	{
+		log_module::write_error(
+			fmt::format("cannot transfer files of {} twice at once",
+						job.indication_id)
+				.c_str());
+		return;
+	}
+
+	_send_engine->push(std::move(job));
 }
 
 void upload_files(shared_ptr<value_container> container)
@@ -330,27 +739,135 @@ void upload_files(shared_ptr<value_container> container)
 		return;
 	}
 
-	log_module::write_information(						   "received message: upload_files");
+	log_module::write_information("received message: upload_files");
 
-	// Note: The new container API is different from the old value_container
-	// This would need to be reimplemented using the new container API
-	// which uses set_value/get_value methods with string keys
-	
-	try {
-		// Extract indication_id if present
-		auto indication_value = container->get_value("indication_id");
-		if (indication_value) {
-			string indication_id = indication_value->to_string();
-			log_module::write_information(								   fmt::format("Processing upload for indication_id: {}", 
-											  indication_id).c_str());
+	string indication_id = container->get_value("indication_id")->to_string();
+	vector<string> target_paths;
+	for (auto& file : container->value_array("file"))
+	{
+		auto target_array = file->value_array("target");
+		if (target_array.empty() || target_array[0]->to_string().empty())
+		{
+			continue;
 		}
-		
-		log_module::write_information(							   "Upload files processing needs to be reimplemented for new API");
-	} catch (const exception& e) {
-		string error_msg = e.what();
-		log_module::write_information(							   fmt::format("Error processing upload_files: {}", 
-										  error_msg).c_str());
+
+		target_paths.push_back(target_array[0]->to_string());
+	}
+
+	// the uploader streams the files to the data endpoint, offering each
+	// by its blocks first, so content the store holds moves no data. the
+	// messaging_server here cannot answer a session, so the uploader has to
+	// know the endpoint, and the outcome is only logged.
+	if (_chunk_receiver == nullptr || target_paths.empty()
+		|| !_file_manager->set(indication_id, container->source_id(),
+							   container->source_sub_id(), target_paths))
+	{
+		log_module::write_error(
+			fmt::format("cannot receive uploads of {} without a data "
+						"endpoint or target files",
+						indication_id)
+				.c_str());
+		return;
+	}
+
+	log_module::write_information(
+		fmt::format("receiving {} files of {} on {}:{}{}",
+					target_paths.size(), indication_id, data_host,
+					_chunk_receiver->port(),
+					_blob_store != nullptr ? " with deduplication" : "")
+			.c_str());
+}
+
+void flushed_transfer_condition(shared_ptr<value_container> container)
+{
+	if (container == nullptr)
+	{
+		return;
+	}
+
+	// the messaging_server here cannot send to a session, so progress and
+	// completion of every transfer, sent or received, end up in the log
+	log_module::write_sequence(
+		fmt::format("transfer_condition: {}", container->serialize()).c_str());
+}
+
+void sent_bytes(const string& indication_id,
+				const string& target_path,
+				const uint64_t& bytes)
+{
+	flushed_transfer_condition(
+		_file_manager->received_bytes(indication_id, target_path, bytes));
+}
+
+void sent_file(const string& indication_id,
+			   const string& target_path,
+			   const bool& sent,
+			   const uint32_t& digest)
+{
+	if (!sent)
+	{
+		log_module::write_error(
+			fmt::format("cannot send {} of {}", target_path, indication_id)
+				.c_str());
+	}
+
+	// an empty path counts the file as failed
+	auto container = _file_manager->received(
+		indication_id, sent ? string_view(target_path) : string_view(),
+		digest);
+	compressed_transfer(container);
+	flushed_transfer_condition(container);
+}
+
+void compressed_transfer(shared_ptr<value_container> container)
+{
+	if (_chunk_compressor == nullptr || container == nullptr
+		|| !container->get_value("completed")->to_boolean())
+	{
+		return;
+	}
+
+	const string indication_id
+		= container->get_value("indication_id")->to_string();
+	const auto statistics = _chunk_compressor->take(indication_id);
+	if (statistics.original_bytes == 0)
+	{
+		return;
 	}
+
+	container << make_shared<ullong_value>("original_bytes",
+										   statistics.original_bytes);
+	container << make_shared<ullong_value>("compressed_bytes",
+										   statistics.sent_bytes);
+	container << make_shared<llong_value>("compression_saved_us",
+										  statistics.saved_time_us);
+
+	log_module::write_information(
+		fmt::format("compressed {} to {:.1f}% with {} of {} chunks, {} in "
+					"LZ4-HC, saving {} us",
+					indication_id, statistics.ratio() * 100,
+					statistics.compressed_chunks,
+					statistics.compressed_chunks + statistics.skipped_chunks,
+					statistics.high_chunks, statistics.saved_time_us)
+			.c_str());
+}
+
+void received_chunk(const string& indication_id,
+					const string& target_path,
+					const uint64_t& bytes)
+{
+	flushed_transfer_condition(
+		_file_manager->received_bytes(indication_id, target_path, bytes));
+}
+
+void received_chunked_file(const string& indication_id,
+						   const string& target_path,
+						   const bool& received,
+						   const uint32_t& digest)
+{
+	flushed_transfer_condition(_file_manager->received(
+		indication_id, received ? string_view(target_path) : string_view(),
+		digest));
 }
 
 void received_file(const wstring& target_id,
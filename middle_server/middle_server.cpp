@@ -58,6 +58,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "fmt/xchar.h"
 
 #include "file_manager.h"
+#include "chunk_cipher.h"
+#include "chunk_compressor.h"
+#include "chunk_receiver.h"
+#include "receipt_batcher.h"
 
 constexpr auto PROGRAM_NAME = "middle_server";
 
@@ -82,7 +86,10 @@ bool logging_style = false;
 #endif
 unsigned short compress_block_size = 1024;
 
-wstring main_connection_key = L"main_connection_key";
+// chunks are only decrypted under a key set with --main_connection_key,
+// as the default one every build shares protects nothing
+const wstring default_connection_key = L"main_connection_key";
+wstring main_connection_key = default_connection_key;
 wstring middle_connection_key = L"middle_connection_key";
 unsigned short middle_server_port = 8642;
 wstring main_server_ip = L"127.0.0.1";
@@ -90,12 +97,33 @@ unsigned short main_server_port = 9753;
 unsigned short high_priority_count = 4;
 unsigned short normal_priority_count = 4;
 unsigned short low_priority_count = 4;
+unsigned short file_manager_shard_count = 16;
+bool retain_transfer_paths = false;
+unsigned short notification_interval = 0;
+unsigned short notification_step = 1;
+unsigned short transfer_idle_timeout = 0;
+unsigned short transfer_timeout = 0;
+string journal_path = "";
+unsigned short journal_commit_interval = 10;
+unsigned short statistics_interval = 0;
+unsigned short receipt_batch_window = 0;
+unsigned short receipt_batch_limit = 1024;
+string data_host = "127.0.0.1";
+unsigned short data_port = 0;
+// downloads land below it, the working directory when empty
+string data_root = "";
+unsigned short io_queue_depth = 128;
+unsigned short io_worker_count = 4;
+unsigned short io_buffer_count = 64;
 size_t session_limit_count = 0;
 
 map<string, function<void(shared_ptr<value_container>)>>
 	_file_commands;
 
 shared_ptr<file_manager> _file_manager = nullptr;
+shared_ptr<receipt_batcher> _receipt_batcher = nullptr;
+shared_ptr<chunk_receiver> _chunk_receiver = nullptr;
+shared_ptr<chunk_cipher> _chunk_cipher = nullptr;
 shared_ptr<messaging_client> _file_line = nullptr;
 shared_ptr<messaging_server> _middle_server = nullptr;
 
@@ -122,6 +150,15 @@ void received_file_from_file_line(const wstring& source_id,
 								  const wstring& indication_id,
 								  const wstring& target_path);
 
+void flushed_transfer_condition(shared_ptr<value_container> container);
+void received_chunk(const string& indication_id,
+					const string& target_path,
+					const uint64_t& bytes);
+void received_chunked_file(const string& indication_id,
+						   const string& target_path,
+						   const bool& received,
+						   const uint32_t& digest);
+
 void download_files(shared_ptr<value_container> container);
 void upload_files(shared_ptr<value_container> container);
 void uploaded_file(shared_ptr<value_container> container);
@@ -156,7 +193,88 @@ int main(int argc, char* argv[])
 	log_module::file_target(log_level);
 	log_module::start();
 
-	_file_manager = make_shared<file_manager>();
+	if (data_port > 0 && encrypt_mode
+		&& main_connection_key == default_connection_key)
+	{
+		log_module::write_error(
+			"cannot decrypt chunks under the default connection key, set "
+			"--main_connection_key or turn --encrypt_mode off");
+		log_module::stop();
+
+		return 0;
+	}
+
+	file_manager_options options;
+	options.shard_count = file_manager_shard_count;
+	options.retain_paths = retain_transfer_paths;
+	options.notification_interval
+		= chrono::milliseconds(notification_interval);
+	options.notification_step = notification_step;
+	options.idle_timeout = chrono::seconds(transfer_idle_timeout);
+	options.transfer_timeout = chrono::seconds(transfer_timeout);
+	options.journal_path = journal_path;
+	options.journal_commit_interval
+		= chrono::milliseconds(journal_commit_interval);
+	options.statistics_interval = chrono::milliseconds(statistics_interval);
+	_file_manager = make_shared<file_manager>(options);
+	_file_manager->set_notification(&flushed_transfer_condition);
+	if (receipt_batch_window > 0)
+	{
+		_receipt_batcher = make_shared<receipt_batcher>(
+			_file_manager, chrono::milliseconds(receipt_batch_window),
+			receipt_batch_limit, &flushed_transfer_condition);
+	}
+
+	// main_server streams downloaded files to this endpoint, written
+	// through io_uring where the kernel has it
+	if (data_port > 0)
+	{
+		io_options io_option;
+		io_option.queue_depth = io_queue_depth;
+		io_option.worker_count = io_worker_count;
+		io_option.buffer_count = io_buffer_count;
+		_chunk_receiver = make_shared<chunk_receiver>(
+			io_option, &received_chunk, &received_chunked_file);
+		// whichever end compresses, the flag on each chunk says so
+		_chunk_receiver->add_transform(chunk_header::compressed,
+									   &chunk_compressor::decode);
+		// only files of downloads this server requested, below its root,
+		// from peers holding the connection key of main_server
+		_chunk_receiver->set_root(data_root);
+		_chunk_receiver->set_secret(
+			std::get<0>(convert_string::to_string(main_connection_key))
+				.value_or(""));
+		_chunk_receiver->set_registry(
+			[](const string& indication_id, const string& file_path)
+			{ return _file_manager->expects(indication_id, file_path); });
+		// main_server derives its key from the same connection key
+		if (encrypt_mode)
+		{
+			_chunk_cipher = make_shared<chunk_cipher>(
+				std::get<0>(convert_string::to_string(main_connection_key))
+					.value_or(""));
+			_chunk_receiver->add_transform(
+				chunk_header::encrypted,
+				[](vector<char>& payload, const chunk_header& header)
+				{ return _chunk_cipher->decrypt(payload, header); });
+			// a chunk sent in the clear is refused, not taken as it is
+			_chunk_receiver->require(chunk_header::encrypted);
+		}
+		if (!_chunk_receiver->start(data_port))
+		{
+			log_module::write_error(
+				fmt::format("cannot listen for data on port {}", data_port)
+					.c_str());
+			_chunk_receiver.reset();
+		}
+		else
+		{
+			log_module::write_information(
+				fmt::format("receiving data on port {} with {}", data_port,
+							_chunk_receiver->backend())
+					.c_str());
+		}
+	}
 
 	create_middle_server();
 	create_file_line();
@@ -166,8 +284,23 @@ int main(int argc, char* argv[])
 		this_thread::sleep_for(chrono::milliseconds(100));
 	}
 
+	_chunk_receiver.reset();
+	_chunk_cipher.reset();
+	_receipt_batcher.reset();
 	_file_line->stop_client();
 
+	if (statistics_interval > 0)
+	{
+		auto latency = _file_manager->latency();
+		log_module::write_information(
+			fmt::format("transfer latency in us: first file p50 {} p99 {}, "
+						"file gap p50 {} p99 {}, completion p50 {} p99 {}",
+						latency.first_file.p50, latency.first_file.p99,
+						latency.file_gap.p50, latency.file_gap.p99,
+						latency.completion.p50, latency.completion.p99)
+				.c_str());
+	}
+
 	log_module::stop();
 
 	return 0;
@@ -204,6 +337,15 @@ bool parse_arguments(argument_manager& arguments)
 		}
 	}
 
+	string_target = arguments.to_string("--main_connection_key");
+	if (string_target != std::nullopt && !string_target->empty())
+	{
+		auto [wide_str, err] = convert_string::to_wstring(*string_target);
+		if (wide_str.has_value()) {
+			main_connection_key = wide_str.value();
+		}
+	}
+
 	ushort_target = arguments.to_ushort("--main_server_port");
 	if (ushort_target != std::nullopt)
 	{
@@ -234,6 +376,108 @@ bool parse_arguments(argument_manager& arguments)
 		low_priority_count = *ushort_target;
 	}
 
+	ushort_target = arguments.to_ushort("--file_manager_shard_count");
+	if (ushort_target != std::nullopt)
+	{
+		file_manager_shard_count = *ushort_target;
+	}
+
+	bool_target = arguments.to_bool("--retain_transfer_paths");
+	if (bool_target != std::nullopt)
+	{
+		retain_transfer_paths = *bool_target;
+	}
+
+	ushort_target = arguments.to_ushort("--notification_interval");
+	if (ushort_target != std::nullopt)
+	{
+		notification_interval = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--notification_step");
+	if (ushort_target != std::nullopt)
+	{
+		notification_step = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--transfer_idle_timeout");
+	if (ushort_target != std::nullopt)
+	{
+		transfer_idle_timeout = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--transfer_timeout");
+	if (ushort_target != std::nullopt)
+	{
+		transfer_timeout = *ushort_target;
+	}
+
+	auto journal_target = arguments.to_string("--journal_path");
+	if (journal_target != std::nullopt)
+	{
+		journal_path = *journal_target;
+	}
+
+	ushort_target = arguments.to_ushort("--journal_commit_interval");
+	if (ushort_target != std::nullopt)
+	{
+		journal_commit_interval = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--statistics_interval");
+	if (ushort_target != std::nullopt)
+	{
+		statistics_interval = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--receipt_batch_window");
+	if (ushort_target != std::nullopt)
+	{
+		receipt_batch_window = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--receipt_batch_limit");
+	if (ushort_target != std::nullopt)
+	{
+		receipt_batch_limit = *ushort_target;
+	}
+
+	string_target = arguments.to_string("--data_host");
+	if (string_target != std::nullopt)
+	{
+		data_host = *string_target;
+	}
+
+	ushort_target = arguments.to_ushort("--data_port");
+	if (ushort_target != std::nullopt)
+	{
+		data_port = *ushort_target;
+	}
+
+	string_target = arguments.to_string("--data_root");
+	if (string_target != std::nullopt)
+	{
+		data_root = *string_target;
+	}
+
+	ushort_target = arguments.to_ushort("--io_queue_depth");
+	if (ushort_target != std::nullopt && *ushort_target > 0)
+	{
+		io_queue_depth = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--io_worker_count");
+	if (ushort_target != std::nullopt && *ushort_target > 0)
+	{
+		io_worker_count = *ushort_target;
+	}
+
+	ushort_target = arguments.to_ushort("--io_buffer_count");
+	if (ushort_target != std::nullopt && *ushort_target > 0)
+	{
+		io_buffer_count = *ushort_target;
+	}
+
 	auto int_target = arguments.to_int("--log_types");
 	if (int_target != std::nullopt)
 	{
@@ -436,8 +680,15 @@ void received_file_from_file_line(const wstring& target_id,
 					tid_str.value_or(""), tsid_str.value_or(""), iid_str.value_or(""),
 					tp_str.value_or("")).c_str());
 
-	shared_ptr<value_container> container
-		= _file_manager->received(indication_id, target_path);
+	if (_receipt_batcher != nullptr)
+	{
+		_receipt_batcher->push(iid_str.value_or(""), tp_str.value_or(""),
+							   !tp_str.value_or("").empty());
+		return;
+	}
+
+	shared_ptr<value_container> container = _file_manager->received(
+		string_view(iid_str.value_or("")), string_view(tp_str.value_or("")));
 
 	if (container != nullptr)
 	{
@@ -449,6 +700,44 @@ void received_file_from_file_line(const wstring& target_id,
 	}
 }
 
+void received_chunk(const string& indication_id,
+					const string& target_path,
+					const uint64_t& bytes)
+{
+	flushed_transfer_condition(
+		_file_manager->received_bytes(indication_id, target_path, bytes));
+}
+
+void received_chunked_file(const string& indication_id,
+						   const string& target_path,
+						   const bool& received,
+						   const uint32_t& digest)
+{
+	if (_receipt_batcher != nullptr)
+	{
+		_receipt_batcher->push(indication_id, target_path, received, digest);
+		return;
+	}
+
+	flushed_transfer_condition(_file_manager->received(
+		indication_id, received ? string_view(target_path) : string_view(),
+		digest));
+}
+
+void flushed_transfer_condition(shared_ptr<value_container> container)
+{
+	if (container == nullptr)
+	{
+		return;
+	}
+
+	if (_middle_server)
+	{
+		// TODO: _middle_server->send(container) API is not available
+		// Need to implement alternative approach
+	}
+}
+
 void download_files(shared_ptr<value_container> container)
 {
 	if (container == nullptr)
@@ -482,7 +771,11 @@ void download_files(shared_ptr<value_container> container)
 	log_module::write_information(
 		"attempt to prepare downloading files from main_server");
 
-	vector<wstring> target_paths;
+	// the paths go straight into the front coded manifest file_manager
+	// keeps, so a large request never exists as separate strings
+	path_manifest target_paths;
+	vector<uint64_t> target_sizes;
+	bool sized = true;
 	vector<shared_ptr<value>> files
 		= container->value_array("file");
 	if (files.empty())
@@ -515,11 +808,24 @@ void download_files(shared_ptr<value_container> container)
 			continue;
 		}
 
-		auto [wide_str, err] = convert_string::to_wstring(data_array[0]->to_string());
-		if (wide_str.has_value()) {
-			target_paths.push_back(wide_str.value());
+		target_paths.push_back(data_array[0]->to_string());
+
+		// byte weighted progress only when every file announces its size
+		auto size_array = file->value_array("size");
+		if (size_array.empty())
+		{
+			sized = false;
+			continue;
 		}
+
+		target_sizes.push_back(size_array[0]->to_ullong());
+	}
+
+	if (!sized)
+	{
+		target_sizes.clear();
 	}
+	target_paths.shrink_to_fit();
 
 	if (target_paths.empty())
 	{
@@ -539,12 +845,9 @@ void download_files(shared_ptr<value_container> container)
 		return;
 	}
 
-	auto [iid_str, iid_err] = convert_string::to_wstring(container->get_value("indication_id")->to_string());
-	auto [sid_str, sid_err] = convert_string::to_wstring(container->source_id());
-	auto [ssid_str, ssid_err] = convert_string::to_wstring(container->source_sub_id());
-	if (iid_str.has_value() && sid_str.has_value() && ssid_str.has_value()) {
-		_file_manager->set(iid_str.value(), sid_str.value(), ssid_str.value(), target_paths);
-	}
+	_file_manager->set(container->get_value("indication_id")->to_string(),
+					   container->source_id(), container->source_sub_id(),
+					   std::move(target_paths), target_sizes);
 
 	log_module::write_information(
 		"prepared parsing of downloading files from main_server");
@@ -566,6 +869,12 @@ void download_files(shared_ptr<value_container> container)
 
 	shared_ptr<value_container> temp = container->copy();
 	temp->set_message_type("request_files");
+	if (_chunk_receiver != nullptr)
+	{
+		temp << make_shared<string_value>("data_host", data_host);
+		temp << make_shared<numeric_value<unsigned short, value_types::ushort_value>>(
+			"data_port", _chunk_receiver->port());
+	}
 
 	if (_file_line)
 	{
@@ -625,13 +934,18 @@ void uploaded_file(shared_ptr<value_container> container)
 		return;
 	}
 
-	auto [iid_str2, iid_err2] = convert_string::to_wstring(container->get_value("indication_id")->to_string());
-	auto [tp_str2, tp_err2] = convert_string::to_wstring(container->get_value("target_path")->to_string());
-	shared_ptr<value_container> temp;
-	if (iid_str2.has_value() && tp_str2.has_value()) {
-		temp = _file_manager->received(iid_str2.value(), tp_str2.value());
+	string indication_id = container->get_value("indication_id")->to_string();
+	string target_path = container->get_value("target_path")->to_string();
+	if (_receipt_batcher != nullptr)
+	{
+		_receipt_batcher->push(indication_id, target_path,
+							   !target_path.empty());
+		return;
 	}
 
+	shared_ptr<value_container> temp
+		= _file_manager->received(indication_id, target_path);
+
 	if (temp != nullptr)
 	{
 		if (_middle_server)
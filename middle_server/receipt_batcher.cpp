@@ -0,0 +1,126 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "receipt_batcher.h"
+
+receipt_batcher::receipt_batcher(
+	shared_ptr<file_manager> manager,
+	const chrono::milliseconds& window,
+	const size_t& limit,
+	const function<void(shared_ptr<value_container>)>& deliver)
+	: _manager(manager)
+	, _window(window)
+	, _limit(limit == 0 ? 1 : limit)
+	, _deliver(deliver)
+	, _stop(false)
+{
+	_thread = thread(&receipt_batcher::run, this);
+}
+
+receipt_batcher::~receipt_batcher(void)
+{
+	{
+		scoped_lock<mutex> guard(_mutex);
+		_stop = true;
+	}
+
+	_condition.notify_one();
+	_thread.join();
+}
+
+void receipt_batcher::push(const string& indication_id,
+						   const string& file_path,
+						   const bool& transferred,
+						   const uint32_t& digest)
+{
+	bool full = false;
+	{
+		scoped_lock<mutex> guard(_mutex);
+
+		_pending.push_back({ indication_id, file_path, transferred, digest });
+		full = _pending.size() == 1 || _pending.size() >= _limit;
+	}
+
+	// wakes the thread to open a window, or to close it early
+	if (full)
+	{
+		_condition.notify_one();
+	}
+}
+
+void receipt_batcher::run(void)
+{
+	unique_lock<mutex> lock(_mutex);
+	while (true)
+	{
+		_condition.wait(lock, [this]() { return _stop || !_pending.empty(); });
+
+		// the window opens with the first receipt
+		_condition.wait_for(lock, _window, [this]()
+							{ return _stop || _pending.size() >= _limit; });
+
+		_flushing.swap(_pending);
+		const bool stop = _stop;
+
+		lock.unlock();
+		flush();
+		lock.lock();
+
+		if (stop && _pending.empty())
+		{
+			return;
+		}
+	}
+}
+
+void receipt_batcher::flush(void)
+{
+	if (_flushing.empty())
+	{
+		return;
+	}
+
+	vector<file_receipt> receipts;
+	receipts.reserve(_flushing.size());
+	for (auto& pending : _flushing)
+	{
+		receipts.push_back({ pending.indication_id, pending.file_path,
+							 pending.transferred, pending.digest });
+	}
+
+	for (auto& message : _manager->received_batch(receipts))
+	{
+		_deliver(message);
+	}
+
+	_flushing.clear();
+}
@@ -33,45 +33,61 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 
 #include "container/container.h"
-#include "core/value.h"
-#include "values/string_value.h"
 
-#include <map>
+#include "file_manager.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace std;
 using namespace container_module;
 
-class file_manager
+// holds file notifications back for a short window so a burst of small
+// files reaches file_manager as one received_batch() call, and every
+// transfer in it produces at most one transfer_condition per window
+class receipt_batcher
 {
 public:
-	file_manager(void);
-	~file_manager(void);
+	receipt_batcher(shared_ptr<file_manager> manager,
+					const chrono::milliseconds& window,
+					const size_t& limit,
+					const function<void(shared_ptr<value_container>)>& deliver);
+	~receipt_batcher(void);
 
 public:
-	bool set(const wstring& indication_id,
-			 const wstring& source_id,
-			 const wstring& source_sub_id,
-			 const vector<wstring>& file_list);
-
-	shared_ptr<value_container> received(
-		const wstring& indication_id, const wstring& file_path);
+	void push(const string& indication_id,
+			  const string& file_path,
+			  const bool& transferred,
+			  const uint32_t& digest = 0);
 
 private:
-	void clear(const map<wstring, unsigned short>::iterator& percentage_iter,
-			   const map<wstring, pair<wstring, wstring>>::iterator& ids_iter,
-			   const map<wstring, vector<wstring>>::iterator& transferring_iter,
-			   const map<wstring, vector<wstring>>::iterator& transferred_iter,
-			   const map<wstring, vector<wstring>>::iterator& failed_iter);
+	void run(void);
+	void flush(void);
 
 private:
+	struct pending_receipt
+	{
+		string indication_id;
+		string file_path;
+		bool transferred;
+		uint32_t digest;
+	};
+
+	shared_ptr<file_manager> _manager;
+	chrono::milliseconds _window;
+	size_t _limit;
+	function<void(shared_ptr<value_container>)> _deliver;
+
+	bool _stop;
 	mutex _mutex;
-	map<wstring, unsigned short> _transferred_percentage;
-	map<wstring, pair<wstring, wstring>> _transferring_ids;
-	map<wstring, vector<wstring>> _transferring_list;
-	map<wstring, vector<wstring>> _transferred_list;
-	map<wstring, vector<wstring>> _failed_list;
+	condition_variable _condition;
+	vector<pending_receipt> _pending;
+	vector<pending_receipt> _flushing;
+	thread _thread;
 };
@@ -0,0 +1,351 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+
+#include "blob_store.h"
+#include "delta_signature.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+	constexpr uint32_t magic = 0x46524246;
+	constexpr size_t hex_size = 32;
+
+	// names temporary files apart, so two connections putting the same
+	// block never write into one file
+	atomic<uint64_t> temporary_serial{ 0 };
+
+	string to_hex(const uint64_t (&hash)[2])
+	{
+		static constexpr char digits[] = "0123456789abcdef";
+
+		string result(hex_size, '0');
+		for (size_t index = 0; index < hex_size; ++index)
+		{
+			const uint64_t word = hash[index / 16];
+			result[index] = digits[(word >> (60 - (index % 16) * 4)) & 0xF];
+		}
+
+		return result;
+	}
+
+	bool from_hex(const string& text, uint64_t (&hash)[2])
+	{
+		if (text.size() != hex_size)
+		{
+			return false;
+		}
+
+		hash[0] = hash[1] = 0;
+		for (size_t index = 0; index < hex_size; ++index)
+		{
+			const char digit = text[index];
+			uint64_t value = 0;
+			if (digit >= '0' && digit <= '9')
+			{
+				value = (uint64_t)(digit - '0');
+			}
+			else if (digit >= 'a' && digit <= 'f')
+			{
+				value = (uint64_t)(digit - 'a' + 10);
+			}
+			else
+			{
+				return false;
+			}
+
+			hash[index / 16] = (hash[index / 16] << 4) | value;
+		}
+
+		return true;
+	}
+
+	// writes beside path and renames over it, so a reader never sees half
+	bool replace(const string& path, const char* data, const size_t& size)
+	{
+		const string temporary
+			= path + "." + to_string(temporary_serial.fetch_add(1)) + ".tmp";
+
+		{
+			ofstream file(temporary, ios::out | ios::binary | ios::trunc);
+			file.write(data, (streamsize)size);
+			if (!file.good())
+			{
+				file.close();
+				error_code error;
+				filesystem::remove(temporary, error);
+				return false;
+			}
+		}
+
+		error_code error;
+		filesystem::rename(temporary, path, error);
+		if (error)
+		{
+			filesystem::remove(temporary, error);
+			return false;
+		}
+
+		return true;
+	}
+}
+
+blob_store::blob_store(const string& root, const unsigned short& shard_count)
+	: _root(root)
+{
+	for (unsigned short index = 0; index < max<unsigned short>(shard_count, 1);
+		 ++index)
+	{
+		_shards.push_back(make_unique<shard>());
+	}
+}
+
+blob_store::~blob_store(void) {}
+
+bool blob_store::open(void)
+{
+	error_code error;
+	filesystem::create_directories(filesystem::path(_root) / "blobs", error);
+	if (error)
+	{
+		return false;
+	}
+
+	filesystem::create_directories(filesystem::path(_root) / "refs", error);
+	if (error)
+	{
+		return false;
+	}
+
+	// temporary files are what a crash left halfway
+	for (auto iterator = filesystem::recursive_directory_iterator(
+			 filesystem::path(_root) / "blobs", error);
+		 !error && iterator != filesystem::recursive_directory_iterator();
+		 iterator.increment(error))
+	{
+		if (!iterator->is_regular_file())
+		{
+			continue;
+		}
+
+		uint64_t hash[2];
+		if (!from_hex(iterator->path().filename().string(), hash))
+		{
+			error_code ignored;
+			filesystem::remove(iterator->path(), ignored);
+			continue;
+		}
+
+		auto& target = select(hash);
+		scoped_lock<mutex> guard(target._mutex);
+		target._blocks.insert({ hash[0], hash[1] });
+	}
+
+	return !error;
+}
+
+bool blob_store::contains(const uint64_t (&hash)[2]) const
+{
+	auto& target = select(hash);
+	scoped_lock<mutex> guard(target._mutex);
+
+	return target._blocks.count({ hash[0], hash[1] }) > 0;
+}
+
+bool blob_store::put(const char* data,
+					 const uint32_t& size,
+					 uint64_t (&hash)[2])
+{
+	strong_checksum(data, size, hash);
+	if (contains(hash))
+	{
+		return true;
+	}
+
+	const string path = block_path(hash);
+	error_code error;
+	filesystem::create_directories(filesystem::path(path).parent_path(),
+								   error);
+	if (error || !replace(path, data, size))
+	{
+		return false;
+	}
+
+	auto& target = select(hash);
+	scoped_lock<mutex> guard(target._mutex);
+	target._blocks.insert({ hash[0], hash[1] });
+
+	return true;
+}
+
+bool blob_store::read(const blob_entry& entry, char* data) const
+{
+	ifstream file(block_path(entry.hash), ios::in | ios::binary);
+	file.read(data, (streamsize)entry.size);
+
+	if (!file.good())
+	{
+		return false;
+	}
+
+	// a block that rotted on the disk must not be handed out
+	uint64_t hash[2];
+	strong_checksum(data, entry.size, hash);
+
+	return hash[0] == entry.hash[0] && hash[1] == entry.hash[1];
+}
+
+bool blob_store::link(const string& path, const vector<blob_entry>& entries)
+{
+	for (auto& entry : entries)
+	{
+		if (!contains(entry.hash))
+		{
+			return false;
+		}
+	}
+
+	// magic, path size, path, entry count and the entries
+	vector<char> data;
+	auto put_bytes = [&data](const void* bytes, const size_t& size)
+	{
+		data.insert(data.end(), (const char*)bytes, (const char*)bytes + size);
+	};
+
+	const uint32_t path_size = (uint32_t)path.size();
+	const uint64_t count = entries.size();
+	put_bytes(&magic, sizeof(magic));
+	put_bytes(&path_size, sizeof(path_size));
+	put_bytes(path.data(), path.size());
+	put_bytes(&count, sizeof(count));
+	for (auto& entry : entries)
+	{
+		put_bytes(entry.hash, sizeof(entry.hash));
+		put_bytes(&entry.size, sizeof(entry.size));
+		put_bytes(&entry.checksum, sizeof(entry.checksum));
+	}
+
+	const string reference = reference_path(path);
+	error_code error;
+	filesystem::create_directories(filesystem::path(reference).parent_path(),
+								   error);
+
+	return !error && replace(reference, data.data(), data.size());
+}
+
+bool blob_store::find(const string& path, vector<blob_entry>& entries) const
+{
+	entries.clear();
+
+	ifstream file(reference_path(path), ios::in | ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	uint32_t kept_magic = 0;
+	uint32_t path_size = 0;
+	file.read((char*)&kept_magic, sizeof(kept_magic));
+	file.read((char*)&path_size, sizeof(path_size));
+	if (!file.good() || kept_magic != magic || path_size != path.size())
+	{
+		return false;
+	}
+
+	// two paths may share the hash the reference is named by
+	string kept_path(path_size, '\0');
+	uint64_t count = 0;
+	file.read(kept_path.data(), (streamsize)path_size);
+	file.read((char*)&count, sizeof(count));
+	if (!file.good() || kept_path != path || count > UINT32_MAX)
+	{
+		return false;
+	}
+
+	entries.resize((size_t)count);
+	for (auto& entry : entries)
+	{
+		file.read((char*)entry.hash, sizeof(entry.hash));
+		file.read((char*)&entry.size, sizeof(entry.size));
+		file.read((char*)&entry.checksum, sizeof(entry.checksum));
+	}
+
+	if (!file.good())
+	{
+		entries.clear();
+		return false;
+	}
+
+	return true;
+}
+
+uint64_t blob_store::block_count(void) const
+{
+	uint64_t count = 0;
+	for (auto& target : _shards)
+	{
+		scoped_lock<mutex> guard(target->_mutex);
+		count += target->_blocks.size();
+	}
+
+	return count;
+}
+
+const string& blob_store::root(void) const { return _root; }
+
+blob_store::shard& blob_store::select(const uint64_t (&hash)[2]) const
+{
+	return *_shards[(size_t)(hash[0] % _shards.size())];
+}
+
+string blob_store::block_path(const uint64_t (&hash)[2]) const
+{
+	const string name = to_hex(hash);
+
+	return (filesystem::path(_root) / "blobs" / name.substr(0, 2) / name)
+		.string();
+}
+
+string blob_store::reference_path(const string& path) const
+{
+	uint64_t hash[2];
+	strong_checksum(path.data(), path.size(), hash);
+	const string name = to_hex(hash);
+
+	return (filesystem::path(_root) / "refs" / name.substr(0, 2) / name)
+		.string();
+}
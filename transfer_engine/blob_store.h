@@ -0,0 +1,106 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+// one block of a stored file, in file order. hash is its strong_checksum
+// and checksum its crc32c, as the sender gave it for the file digest.
+struct blob_entry
+{
+	uint64_t hash[2] = { 0, 0 };
+	uint32_t size = 0;
+	uint32_t checksum = 0;
+};
+
+// keeps the contents of files once per distinct block. a block lives under
+// root/blobs/xx/ named by the hex of its strong_checksum, where xx is its
+// first byte, and a stored path is only a reference under root/refs/ that
+// lists its blocks. the index of known blocks is split into shards with
+// their own locks, so connections storing at once rarely wait on each other.
+class blob_store
+{
+public:
+	blob_store(const string& root, const unsigned short& shard_count = 16);
+	~blob_store(void);
+
+public:
+	// creates the directories and indexes the blocks already kept
+	bool open(void);
+
+	bool contains(const uint64_t (&hash)[2]) const;
+	// keeps data under the hash it has, never under one a sender claimed,
+	// and hands that hash back. a block kept already is not written again.
+	bool put(const char* data, const uint32_t& size, uint64_t (&hash)[2]);
+	// reads a whole block into data, which holds entry.size bytes
+	bool read(const blob_entry& entry, char* data) const;
+
+	// points path at the blocks of entries, which must all be kept already
+	bool link(const string& path, const vector<blob_entry>& entries);
+	// the blocks path was linked to; false when it is no reference
+	bool find(const string& path, vector<blob_entry>& entries) const;
+
+	uint64_t block_count(void) const;
+	const string& root(void) const;
+
+private:
+	struct hash_key
+	{
+		size_t operator()(const pair<uint64_t, uint64_t>& key) const
+		{
+			return (size_t)key.second;
+		}
+	};
+
+	struct shard
+	{
+		mutable mutex _mutex;
+		unordered_set<pair<uint64_t, uint64_t>, hash_key> _blocks;
+	};
+
+	shard& select(const uint64_t (&hash)[2]) const;
+	string block_path(const uint64_t (&hash)[2]) const;
+	string reference_path(const string& path) const;
+
+private:
+	string _root;
+	vector<unique_ptr<shard>> _shards;
+};
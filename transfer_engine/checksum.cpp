@@ -0,0 +1,291 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "checksum.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CHECKSUM_X86
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define CHECKSUM_ARM
+#include <arm_acle.h>
+#endif
+
+namespace
+{
+	// reflected Castagnoli polynomial
+	constexpr uint32_t polynomial = 0x82F63B78u;
+
+	// below this the shift costs more than the interleaving saves
+	constexpr size_t interleave_minimum = 16 << 10;
+
+	// product of two polynomials modulo the crc polynomial, both reflected
+	uint32_t multiply(uint32_t left, uint32_t right)
+	{
+		uint32_t product = 0;
+		for (uint32_t bit = 1u << 31; bit != 0; bit >>= 1)
+		{
+			if ((left & bit) != 0)
+			{
+				product ^= right;
+			}
+			right = (right >> 1) ^ (polynomial & (0u - (right & 1)));
+		}
+
+		return product;
+	}
+
+	// x^(2^n) modulo the crc polynomial for every n
+	const array<uint32_t, 64>& powers(void)
+	{
+		static const array<uint32_t, 64> table = []()
+		{
+			array<uint32_t, 64> result{};
+			result[0] = 1u << 30;
+			for (size_t index = 1; index < result.size(); ++index)
+			{
+				result[index] = multiply(result[index - 1], result[index - 1]);
+			}
+
+			return result;
+		}();
+
+		return table;
+	}
+
+	// x^(8 * size) modulo the crc polynomial, what shifts a crc over size bytes
+	uint32_t shift(const uint64_t& size)
+	{
+		auto& table = powers();
+		uint32_t result = 1u << 31;
+		size_t power = 3;
+		for (uint64_t bits = size; bits != 0; bits >>= 1, ++power)
+		{
+			if ((bits & 1) != 0)
+			{
+				result = multiply(table[power & 63], result);
+			}
+		}
+
+		return result;
+	}
+
+	using crc_tables = array<array<uint32_t, 256>, 8>;
+
+	const crc_tables& crc_table(void)
+	{
+		static const crc_tables tables = []()
+		{
+			crc_tables result{};
+			for (uint32_t index = 0; index < 256; ++index)
+			{
+				uint32_t crc = index;
+				for (int bit = 0; bit < 8; ++bit)
+				{
+					crc = (crc >> 1) ^ (polynomial & (0u - (crc & 1)));
+				}
+				result[0][index] = crc;
+			}
+
+			for (uint32_t index = 0; index < 256; ++index)
+			{
+				for (size_t slice = 1; slice < 8; ++slice)
+				{
+					const uint32_t previous = result[slice - 1][index];
+					result[slice][index]
+						= (previous >> 8) ^ result[0][previous & 0xFF];
+				}
+			}
+
+			return result;
+		}();
+
+		return tables;
+	}
+
+	uint32_t table_crc(const char* data, size_t size, uint32_t crc)
+	{
+		auto& table = crc_table();
+
+		for (; size >= 8; data += 8, size -= 8)
+		{
+			uint64_t word;
+			memcpy(&word, data, sizeof(word));
+			word ^= crc;
+
+			crc = table[7][word & 0xFF] ^ table[6][(word >> 8) & 0xFF]
+				  ^ table[5][(word >> 16) & 0xFF] ^ table[4][(word >> 24) & 0xFF]
+				  ^ table[3][(word >> 32) & 0xFF] ^ table[2][(word >> 40) & 0xFF]
+				  ^ table[1][(word >> 48) & 0xFF] ^ table[0][word >> 56];
+		}
+
+		for (; size > 0; ++data, --size)
+		{
+			crc = table[0][(crc ^ (uint8_t)*data) & 0xFF] ^ (crc >> 8);
+		}
+
+		return crc;
+	}
+
+#ifdef CHECKSUM_X86
+#ifndef _MSC_VER
+	__attribute__((target("sse4.2")))
+#endif
+	uint32_t hardware_crc(const char* data, size_t size, uint32_t crc)
+	{
+#if defined(__x86_64__) || defined(_M_X64)
+		// three streams at once hide the latency of the instruction, then
+		// the first two are shifted over the bytes that followed them
+		if (size >= interleave_minimum)
+		{
+			const size_t lane = (size / 3) & ~(size_t)7;
+			uint64_t first = crc, second = 0, third = 0;
+			for (size_t position = 0; position < lane; position += 8)
+			{
+				uint64_t words[3];
+				memcpy(&words[0], data + position, 8);
+				memcpy(&words[1], data + lane + position, 8);
+				memcpy(&words[2], data + 2 * lane + position, 8);
+				first = _mm_crc32_u64(first, words[0]);
+				second = _mm_crc32_u64(second, words[1]);
+				third = _mm_crc32_u64(third, words[2]);
+			}
+
+			const uint32_t over = shift(lane);
+			crc = multiply(over, multiply(over, (uint32_t)first)
+									 ^ (uint32_t)second)
+				  ^ (uint32_t)third;
+			data += 3 * lane;
+			size -= 3 * lane;
+		}
+
+		uint64_t wide = crc;
+		for (; size >= 8; data += 8, size -= 8)
+		{
+			uint64_t word;
+			memcpy(&word, data, sizeof(word));
+			wide = _mm_crc32_u64(wide, word);
+		}
+		crc = (uint32_t)wide;
+#endif
+		for (; size >= 4; data += 4, size -= 4)
+		{
+			uint32_t word;
+			memcpy(&word, data, sizeof(word));
+			crc = _mm_crc32_u32(crc, word);
+		}
+		for (; size > 0; ++data, --size)
+		{
+			crc = _mm_crc32_u8(crc, (uint8_t)*data);
+		}
+
+		return crc;
+	}
+
+	bool hardware_support(void)
+	{
+#ifdef _MSC_VER
+		int registers[4];
+		__cpuid(registers, 1);
+		return (registers[2] & (1 << 20)) != 0;
+#else
+		return __builtin_cpu_supports("sse4.2");
+#endif
+	}
+#elif defined(CHECKSUM_ARM)
+	uint32_t hardware_crc(const char* data, size_t size, uint32_t crc)
+	{
+		for (; size >= 8; data += 8, size -= 8)
+		{
+			uint64_t word;
+			memcpy(&word, data, sizeof(word));
+			crc = __crc32cd(crc, word);
+		}
+		for (; size > 0; ++data, --size)
+		{
+			crc = __crc32cb(crc, (uint8_t)*data);
+		}
+
+		return crc;
+	}
+
+	bool hardware_support(void) { return true; }
+#endif
+
+	using crc_function = uint32_t (*)(const char*, size_t, uint32_t);
+
+	crc_function pick(void)
+	{
+#if defined(CHECKSUM_X86) || defined(CHECKSUM_ARM)
+		if (hardware_support())
+		{
+			return &hardware_crc;
+		}
+#endif
+		return &table_crc;
+	}
+
+	const crc_function implementation = pick();
+
+}
+
+uint32_t crc32c(const char* data, const size_t& size, const uint32_t& crc)
+{
+	return ~implementation(data, size, ~crc);
+}
+
+uint32_t crc32c_combine(const uint32_t& first,
+						const uint32_t& second,
+						const uint64_t& second_size)
+{
+	return multiply(shift(second_size), first) ^ second;
+}
+
+const char* crc32c_implementation(void)
+{
+	if (implementation == &table_crc)
+	{
+		return "table";
+	}
+
+#ifdef CHECKSUM_ARM
+	return "armv8";
+#else
+	return "sse4.2";
+#endif
+}
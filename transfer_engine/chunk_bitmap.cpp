@@ -0,0 +1,199 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "chunk_bitmap.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+
+namespace
+{
+	constexpr uint32_t magic = 0x42434d46;
+	// magic, chunk size and file size
+	constexpr size_t prefix_size = sizeof(uint32_t) * 2 + sizeof(uint64_t);
+}
+
+chunk_bitmap::chunk_bitmap(void) : _file_size(0), _chunk_size(0), _marked(0)
+{
+}
+
+chunk_bitmap::~chunk_bitmap(void) {}
+
+bool chunk_bitmap::open(const string& target_path,
+						const uint64_t& file_size,
+						const uint32_t& chunk_size,
+						const bool& resumable)
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	if (chunk_size == 0)
+	{
+		return false;
+	}
+
+	_path = path(target_path);
+	_file_size = file_size;
+	_chunk_size = chunk_size;
+	_bits.assign((size_t)((count() + 7) / 8), 0);
+	_marked = 0;
+
+	if (resumable)
+	{
+		_file.open(_path, ios::in | ios::out | ios::binary);
+
+		uint32_t kept_magic = 0;
+		uint32_t kept_chunk_size = 0;
+		uint64_t kept_file_size = 0;
+		_file.read((char*)&kept_magic, sizeof(kept_magic));
+		_file.read((char*)&kept_chunk_size, sizeof(kept_chunk_size));
+		_file.read((char*)&kept_file_size, sizeof(kept_file_size));
+		_file.read((char*)_bits.data(), (streamsize)_bits.size());
+
+		if (_file.good() && kept_magic == magic
+			&& kept_chunk_size == chunk_size && kept_file_size == file_size)
+		{
+			// eight bytes at a time keeps this cheap for millions of chunks
+			size_t position = 0;
+			for (; position + sizeof(uint64_t) <= _bits.size();
+				 position += sizeof(uint64_t))
+			{
+				uint64_t word;
+				memcpy(&word, _bits.data() + position, sizeof(word));
+				_marked += (uint64_t)popcount(word);
+			}
+			for (; position < _bits.size(); ++position)
+			{
+				_marked += (uint64_t)popcount(_bits[position]);
+			}
+
+			return true;
+		}
+
+		_file.close();
+		fill(_bits.begin(), _bits.end(), 0);
+	}
+
+	_file.open(_path, ios::in | ios::out | ios::binary | ios::trunc);
+	_file.write((const char*)&magic, sizeof(magic));
+	_file.write((const char*)&_chunk_size, sizeof(_chunk_size));
+	_file.write((const char*)&_file_size, sizeof(_file_size));
+	_file.write((const char*)_bits.data(), (streamsize)_bits.size());
+	_file.flush();
+
+	return _file.good();
+}
+
+bool chunk_bitmap::set(const uint64_t& index)
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	if (index >= count())
+	{
+		return false;
+	}
+
+	uint8_t& target = _bits[(size_t)(index >> 3)];
+	const uint8_t bit = (uint8_t)(1 << (index & 7));
+	if ((target & bit) != 0)
+	{
+		return false;
+	}
+
+	// the byte goes out once the chunk itself was written, so a kept bit
+	// never claims a chunk the target does not hold
+	target |= bit;
+	++_marked;
+	_file.seekp((streamoff)(prefix_size + (index >> 3)));
+	_file.write((const char*)&target, 1);
+	_file.flush();
+
+	return true;
+}
+
+uint32_t chunk_bitmap::chunk_size(void) const { return _chunk_size; }
+
+uint64_t chunk_bitmap::received_bytes(void) const
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	const uint64_t chunks = _marked;
+	if (chunks == 0)
+	{
+		return 0;
+	}
+
+	// only the last chunk may be short
+	const uint64_t last = count() - 1;
+	const uint64_t bytes = chunks * _chunk_size;
+	if ((_bits[(size_t)(last >> 3)] & (1 << (last & 7))) == 0)
+	{
+		return bytes;
+	}
+
+	return bytes - (last + 1) * _chunk_size + _file_size;
+}
+
+bool chunk_bitmap::complete(void) const
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	return _marked == count();
+}
+
+vector<uint8_t> chunk_bitmap::bits(void) const
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	return _bits;
+}
+
+void chunk_bitmap::remove(void)
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	_file.close();
+
+	error_code error;
+	filesystem::remove(_path, error);
+}
+
+string chunk_bitmap::path(const string& target_path)
+{
+	return target_path + ".chunks";
+}
+
+uint64_t chunk_bitmap::count(void) const
+{
+	return (_file_size + _chunk_size - 1) / _chunk_size;
+}
@@ -0,0 +1,84 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// chunks of a partially received file that already reached the disk, kept
+// in a file beside the target so a later transfer of the same file only
+// sends the rest. bit i stands for the chunk at i * chunk_size.
+class chunk_bitmap
+{
+public:
+	chunk_bitmap(void);
+	~chunk_bitmap(void);
+
+public:
+	// picks up the bits kept for the same file and chunk size when
+	// resumable is set, or starts over. false when they cannot be kept.
+	bool open(const string& target_path,
+			  const uint64_t& file_size,
+			  const uint32_t& chunk_size,
+			  const bool& resumable);
+	// false when the chunk was already marked
+	bool set(const uint64_t& index);
+
+	uint32_t chunk_size(void) const;
+	uint64_t received_bytes(void) const;
+	bool complete(void) const;
+	vector<uint8_t> bits(void) const;
+
+	// drops the kept bits once the target is complete
+	void remove(void);
+
+	static string path(const string& target_path);
+
+private:
+	uint64_t count(void) const;
+
+private:
+	mutable mutex _mutex;
+	fstream _file;
+	string _path;
+	uint64_t _file_size;
+	uint32_t _chunk_size;
+	vector<uint8_t> _bits;
+	// bits set, so complete() costs nothing per chunk
+	uint64_t _marked;
+};
@@ -0,0 +1,236 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "chunk_channel.h"
+#include "chunk_frame.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+chunk_channel::~chunk_channel(void) {}
+
+int chunk_channel::descriptor(void) const { return -1; }
+
+bool chunk_channel::read(char*, const size_t&) { return false; }
+
+bool set_socket_timeout(const int& socket, const unsigned int& seconds)
+{
+#ifdef _WIN32
+	const DWORD value = (DWORD)seconds * 1000;
+#else
+	timeval value{};
+	value.tv_sec = (time_t)seconds;
+#endif
+
+	return setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, (const char*)&value,
+					  sizeof(value))
+			   == 0
+		   && setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&value,
+						 sizeof(value))
+				  == 0;
+}
+
+socket_channel::socket_channel(const unsigned int& timeout,
+							   const string& secret)
+	: _timeout(timeout), _secret(secret), _socket(-1)
+{
+}
+
+socket_channel::~socket_channel(void) { close(); }
+
+bool socket_channel::connect(const string& host, const unsigned short& port)
+{
+	close();
+
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo* addresses = nullptr;
+	if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &addresses)
+		!= 0)
+	{
+		return false;
+	}
+
+	for (addrinfo* address = addresses; address != nullptr;
+		 address = address->ai_next)
+	{
+		int target = (int)socket(address->ai_family, address->ai_socktype,
+								 address->ai_protocol);
+		if (target < 0)
+		{
+			continue;
+		}
+
+		// linux also bounds connect() by the send timeout
+		if (_timeout > 0)
+		{
+			set_socket_timeout(target, _timeout);
+		}
+
+		if (::connect(target, address->ai_addr, (int)address->ai_addrlen) == 0)
+		{
+			_socket = target;
+			break;
+		}
+
+#ifdef _WIN32
+		closesocket(target);
+#else
+		::close(target);
+#endif
+	}
+
+	freeaddrinfo(addresses);
+
+	if (_socket < 0)
+	{
+		return false;
+	}
+
+	// a receiver with a secret challenges the connection before any frame
+	if (!_secret.empty())
+	{
+		uint8_t challenge[challenge_size];
+		uint8_t proof[proof_size];
+		if (!read((char*)challenge, sizeof(challenge)))
+		{
+			close();
+			return false;
+		}
+
+		prove_challenge(_secret, challenge, proof);
+		if (!write((const char*)proof, sizeof(proof)))
+		{
+			close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void socket_channel::close(void)
+{
+	if (_socket < 0)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	closesocket(_socket);
+#else
+	::close(_socket);
+#endif
+	_socket = -1;
+}
+
+int socket_channel::descriptor(void) const
+{
+#ifdef _WIN32
+	// a SOCKET is no file descriptor, so windows always writes through
+	return -1;
+#else
+	return _socket;
+#endif
+}
+
+bool socket_channel::write(const char* data, const size_t& size)
+{
+	size_t written = 0;
+	while (written < size)
+	{
+#ifdef _WIN32
+		int result = send(_socket, data + written,
+						  (int)min(size - written, (size_t)INT32_MAX), 0);
+#else
+		ssize_t result
+			= send(_socket, data + written, size - written, MSG_NOSIGNAL);
+		if (result < 0 && errno == EINTR)
+		{
+			continue;
+		}
+#endif
+		if (result <= 0)
+		{
+			return false;
+		}
+
+		written += (size_t)result;
+	}
+
+	return true;
+}
+
+bool socket_channel::read(char* data, const size_t& size)
+{
+	size_t done = 0;
+	while (done < size)
+	{
+#ifdef _WIN32
+		int result = recv(_socket, data + done,
+						  (int)min(size - done, (size_t)INT32_MAX), 0);
+#else
+		ssize_t result = recv(_socket, data + done, size - done, 0);
+		if (result < 0 && errno == EINTR)
+		{
+			continue;
+		}
+#endif
+		if (result <= 0)
+		{
+			return false;
+		}
+
+		done += (size_t)result;
+	}
+
+	return true;
+}
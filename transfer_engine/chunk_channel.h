@@ -0,0 +1,83 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+// byte stream the transfer engine writes chunk frames into
+class chunk_channel
+{
+public:
+	virtual ~chunk_channel(void);
+
+public:
+	// a socket the kernel can copy file pages into directly, or -1 when the
+	// bytes have to pass through write()
+	virtual int descriptor(void) const;
+	virtual bool write(const char* data, const size_t& size) = 0;
+	// reads exactly size bytes the peer answered, where the channel has a
+	// way back
+	virtual bool read(char* data, const size_t& size);
+};
+
+// a send or receive on socket that waits longer than seconds fails, so a
+// stalled peer cannot hold the thread; 0 waits forever
+bool set_socket_timeout(const int& socket, const unsigned int& seconds);
+
+// blocking TCP connection to the data endpoint of a peer
+class socket_channel : public chunk_channel
+{
+public:
+	// timeout bounds connect and every send or receive, in seconds, see
+	// set_socket_timeout. with a secret, connect() answers the challenge
+	// of the receiver, see prove_challenge
+	socket_channel(const unsigned int& timeout = 0,
+				   const string& secret = "");
+	~socket_channel(void) override;
+
+public:
+	bool connect(const string& host, const unsigned short& port);
+	void close(void);
+
+	int descriptor(void) const override;
+	bool write(const char* data, const size_t& size) override;
+	bool read(char* data, const size_t& size) override;
+
+private:
+	unsigned int _timeout;
+	string _secret;
+	int _socket;
+};
@@ -0,0 +1,211 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+
+#include "chunk_cipher.h"
+
+#include <cstring>
+
+#include <cryptopp/aes.h>
+#include <cryptopp/cpu.h>
+#include <cryptopp/gcm.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/sha.h>
+
+namespace
+{
+	constexpr size_t nonce_size = 12;
+	constexpr size_t tag_size = 16;
+
+	atomic<uint64_t> next_serial{ 1 };
+
+	// GCM objects are not shared between threads, and setting a key costs
+	// more than a small chunk, so each thread keeps the schedules of the
+	// instance it used last
+	struct cipher_context
+	{
+		uint64_t serial = 0;
+		CryptoPP::GCM<CryptoPP::AES>::Encryption encryption;
+		CryptoPP::GCM<CryptoPP::AES>::Decryption decryption;
+	};
+
+	thread_local cipher_context context;
+	thread_local vector<char> scratch;
+	thread_local vector<char> associated;
+
+	// the header fields a chunk is bound to, length prefixed so that no two
+	// headers encode alike
+	const vector<char>& associated_data(const chunk_header& header)
+	{
+		auto put = [](const void* data, const size_t& size)
+		{
+			associated.insert(associated.end(), (const char*)data,
+							  (const char*)data + size);
+		};
+
+		const uint32_t id_size = (uint32_t)header.indication_id.size();
+		const uint32_t path_size = (uint32_t)header.file_path.size();
+
+		associated.clear();
+		put(&header.offset, sizeof(header.offset));
+		put(&id_size, sizeof(id_size));
+		put(header.indication_id.data(), id_size);
+		put(&path_size, sizeof(path_size));
+		put(header.file_path.data(), path_size);
+
+		return associated;
+	}
+
+	cipher_context& prepare(const uint64_t& serial, const uint8_t* key)
+	{
+		if (context.serial != serial)
+		{
+			// the nonce is replaced on every chunk
+			const uint8_t nonce[nonce_size] = { 0 };
+			context.encryption.SetKeyWithIV(key, 32, nonce, nonce_size);
+			context.decryption.SetKeyWithIV(key, 32, nonce, nonce_size);
+			context.serial = serial;
+		}
+
+		return context;
+	}
+}
+
+chunk_cipher::chunk_cipher(const string& secret)
+	: _serial(next_serial.fetch_add(1)), _count(0)
+{
+	static const char info[] = "file_manager chunk key";
+
+	CryptoPP::HKDF<CryptoPP::SHA256> kdf;
+	kdf.DeriveKey(_key, sizeof(_key), (const CryptoPP::byte*)secret.data(),
+				  secret.size(), nullptr, 0, (const CryptoPP::byte*)info,
+				  sizeof(info) - 1);
+
+	CryptoPP::AutoSeededRandomPool random;
+	random.GenerateBlock(_salt, sizeof(_salt));
+}
+
+chunk_cipher::~chunk_cipher(void)
+{
+	memset(_key, 0, sizeof(_key));
+}
+
+bool chunk_cipher::encrypt(vector<char>& payload, chunk_header& header)
+{
+	// the count fills the last 4 bytes of the nonce and must not wrap
+	const uint64_t count = _count.fetch_add(1);
+	if (count > UINT32_MAX)
+	{
+		return false;
+	}
+
+	uint8_t nonce[nonce_size];
+	memcpy(nonce, _salt, sizeof(_salt));
+	const uint32_t counter = (uint32_t)count;
+	memcpy(nonce + sizeof(_salt), &counter, sizeof(counter));
+
+	scratch.resize(nonce_size + payload.size() + tag_size);
+	memcpy(scratch.data(), nonce, nonce_size);
+
+	auto& data = associated_data(header);
+	auto& cipher = prepare(_serial, _key).encryption;
+	try
+	{
+		auto* target = (CryptoPP::byte*)scratch.data() + nonce_size;
+		cipher.EncryptAndAuthenticate(
+			target, target + payload.size(), tag_size, nonce, nonce_size,
+			(const CryptoPP::byte*)data.data(), data.size(),
+			(const CryptoPP::byte*)payload.data(), payload.size());
+	}
+	catch (const CryptoPP::Exception&)
+	{
+		return false;
+	}
+
+	payload.swap(scratch);
+	header.flags |= chunk_header::encrypted;
+
+	return true;
+}
+
+bool chunk_cipher::decrypt(vector<char>& payload,
+						   const chunk_header& header) const
+{
+	if (payload.size() < nonce_size + tag_size)
+	{
+		return false;
+	}
+
+	const size_t size = payload.size() - nonce_size - tag_size;
+	const auto* source = (const CryptoPP::byte*)payload.data();
+	scratch.resize(size);
+
+	auto& data = associated_data(header);
+	auto& cipher = prepare(_serial, _key).decryption;
+	try
+	{
+		if (!cipher.DecryptAndVerify((CryptoPP::byte*)scratch.data(),
+									 source + nonce_size + size, tag_size,
+									 source, nonce_size,
+									 (const CryptoPP::byte*)data.data(),
+									 data.size(), source + nonce_size, size))
+		{
+			return false;
+		}
+	}
+	catch (const CryptoPP::Exception&)
+	{
+		return false;
+	}
+
+	payload.swap(scratch);
+
+	return true;
+}
+
+string chunk_cipher::implementation(void)
+{
+#if (CRYPTOPP_BOOL_X86 || CRYPTOPP_BOOL_X32 || CRYPTOPP_BOOL_X64)
+	if (CryptoPP::HasAESNI() && CryptoPP::HasCLMUL())
+	{
+		return "AES-NI and PCLMUL";
+	}
+#elif (CRYPTOPP_BOOL_ARM32 || CRYPTOPP_BOOL_ARMV8)
+	if (CryptoPP::HasAES() && CryptoPP::HasPMULL())
+	{
+		return "ARMv8 AES and PMULL";
+	}
+#endif
+
+	return "portable AES and GHASH";
+}
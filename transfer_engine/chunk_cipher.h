@@ -0,0 +1,79 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+
+#pragma once
+
+#include "chunk_frame.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// authenticated encryption of chunks with AES-256-GCM. Crypto++ picks
+// AES-NI and PCLMUL, or the ARMv8 AES and PMULL instructions, at runtime
+// where the processor has them. every chunk carries its own nonce ahead
+// of the ciphertext and its tag behind, so chunks are encrypted and
+// decrypted on any thread and in any order, as the pipeline, stripes and
+// resumed transfers need. the indication id, path and offset of the
+// header are authenticated along with each chunk, so a chunk cannot be
+// replayed into another file or position.
+class chunk_cipher
+{
+public:
+	// the key is derived from secret with HKDF-SHA256, so both ends of a
+	// data connection only have to share the secret
+	chunk_cipher(const string& secret);
+	~chunk_cipher(void);
+
+public:
+	// a chunk_encoder for file_sender, marking chunk_header::encrypted
+	bool encrypt(vector<char>& payload, chunk_header& header);
+	// a chunk_decoder for chunk_receiver; fails on a chunk whose tag does
+	// not match its payload and header, whatever its checksum says
+	bool decrypt(vector<char>& payload, const chunk_header& header) const;
+
+	// names the instructions in use, for the log
+	static string implementation(void);
+
+private:
+	// tells the key schedules each thread keeps apart per instance
+	uint64_t _serial;
+	uint8_t _key[32];
+	// nonces are a random salt per instance and a count of its chunks, so
+	// no two chunks under one key share one
+	uint8_t _salt[8];
+	atomic<uint64_t> _count;
+};
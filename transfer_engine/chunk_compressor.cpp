@@ -0,0 +1,372 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+
+#include "chunk_compressor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#include <lz4.h>
+#include <lz4hc.h>
+
+namespace
+{
+	// the largest chunk decode accepts, well above any chunk_size in use
+	constexpr uint32_t maximum_original = 64 << 20;
+	constexpr double weight = 0.125;
+	// the other mode is taken only when it is this much cheaper, so a noisy
+	// link does not flip the mode on every chunk
+	constexpr double hysteresis = 0.9;
+
+	thread_local vector<char> scratch;
+
+	uint64_t elapsed_ns(const chrono::steady_clock::time_point& start)
+	{
+		return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+				   chrono::steady_clock::now() - start)
+			.count();
+	}
+
+	double blend(const double& average, const double& sample)
+	{
+		return average + (sample - average) * weight;
+	}
+}
+
+double compression_statistics::ratio(void) const
+{
+	if (original_bytes == 0)
+	{
+		return 1;
+	}
+
+	return (double)sent_bytes / (double)original_bytes;
+}
+
+chunk_compressor::chunk_compressor(const compression_options& options)
+	: _options(options)
+	, _cores(max(thread::hardware_concurrency(), 1u))
+	, _active(0)
+	, _chunks(0)
+	, _high(false)
+	, _link_rate(0)
+{
+}
+
+chunk_compressor::~chunk_compressor(void) {}
+
+bool chunk_compressor::encode(vector<char>& payload, chunk_header& header)
+{
+	const uint64_t original = payload.size();
+
+	++_active;
+
+	compression_statistics chunk;
+	chunk.original_bytes = original;
+	chunk.sent_bytes = original;
+
+	if (original > 0 && original <= maximum_original
+		&& entropy(payload) <= _options.entropy_limit)
+	{
+		const modes chosen = _high ? modes::high : modes::fast;
+		const bool probe
+			= _options.probe_interval > 0
+			  && _chunks.fetch_add(1) % _options.probe_interval == 0;
+
+		vector<char> result;
+		uint64_t nanoseconds = 0;
+		if (compress(payload, chosen, result, nanoseconds))
+		{
+			measure(chosen, original, result.size(), nanoseconds);
+			chunk.compress_time_us += nanoseconds / 1000;
+
+			if (probe)
+			{
+				const modes other
+					= chosen == modes::high ? modes::fast : modes::high;
+				vector<char> trial;
+				uint64_t trial_ns = 0;
+				if (compress(payload, other, trial, trial_ns))
+				{
+					measure(other, original, trial.size(), trial_ns);
+					chunk.compress_time_us += trial_ns / 1000;
+				}
+			}
+			choose();
+
+			if (result.size() <= original * _options.keep_limit)
+			{
+				payload.swap(result);
+				header.flags |= chunk_header::compressed;
+
+				chunk.sent_bytes = payload.size();
+				chunk.compressed_chunks = 1;
+				chunk.high_chunks = chosen == modes::high ? 1 : 0;
+			}
+		}
+	}
+
+	if (chunk.compressed_chunks == 0)
+	{
+		chunk.skipped_chunks = 1;
+	}
+
+	--_active;
+
+	{
+		scoped_lock<mutex> guard(_mutex);
+
+		if (_link_rate > 0)
+		{
+			chunk.saved_time_us
+				= (int64_t)((double)(original - chunk.sent_bytes) * 1e6
+							/ _link_rate)
+				  - (int64_t)chunk.compress_time_us;
+		}
+
+		auto& transfer = _transfers[header.indication_id];
+		transfer.original_bytes += chunk.original_bytes;
+		transfer.sent_bytes += chunk.sent_bytes;
+		transfer.compressed_chunks += chunk.compressed_chunks;
+		transfer.skipped_chunks += chunk.skipped_chunks;
+		transfer.high_chunks += chunk.high_chunks;
+		transfer.compress_time_us += chunk.compress_time_us;
+		transfer.saved_time_us += chunk.saved_time_us;
+	}
+
+	return true;
+}
+
+void chunk_compressor::transmitted(const uint64_t& bytes,
+								   const uint64_t& nanoseconds)
+{
+	if (bytes == 0 || nanoseconds == 0)
+	{
+		return;
+	}
+
+	const double rate = (double)bytes * 1e9 / (double)nanoseconds;
+
+	scoped_lock<mutex> guard(_mutex);
+	_link_rate = _link_rate == 0 ? rate : blend(_link_rate, rate);
+}
+
+bool chunk_compressor::decode(vector<char>& payload)
+{
+	uint32_t original = 0;
+	if (payload.size() < sizeof(original))
+	{
+		return false;
+	}
+
+	memcpy(&original, payload.data(), sizeof(original));
+	if (original > maximum_original)
+	{
+		return false;
+	}
+
+	scratch.resize(original);
+	const int size = LZ4_decompress_safe(
+		payload.data() + sizeof(original), scratch.data(),
+		(int)(payload.size() - sizeof(original)), (int)original);
+	if (size < 0 || (uint32_t)size != original)
+	{
+		return false;
+	}
+
+	payload.swap(scratch);
+
+	return true;
+}
+
+compression_statistics chunk_compressor::statistics(
+	const string& indication_id) const
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	auto target = _transfers.find(indication_id);
+	if (target == _transfers.end())
+	{
+		return compression_statistics();
+	}
+
+	return target->second;
+}
+
+compression_statistics chunk_compressor::take(const string& indication_id)
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	auto target = _transfers.find(indication_id);
+	if (target == _transfers.end())
+	{
+		return compression_statistics();
+	}
+
+	compression_statistics result = target->second;
+	_transfers.erase(target);
+
+	return result;
+}
+
+bool chunk_compressor::high_compression(void) const { return _high; }
+
+uint64_t chunk_compressor::link_rate(void) const
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	return (uint64_t)_link_rate;
+}
+
+double chunk_compressor::entropy(const vector<char>& payload) const
+{
+	// pieces spread over the chunk, so a compressible header in front of
+	// media does not pass for the whole chunk
+	constexpr size_t piece = 256;
+	const size_t sample = min<size_t>(_options.sample_size, payload.size());
+	const size_t pieces = max<size_t>(sample / piece, 1);
+	const size_t stride = payload.size() / pieces;
+
+	uint32_t counts[256] = { 0 };
+	size_t total = 0;
+	for (size_t index = 0; index < pieces; ++index)
+	{
+		const size_t start = index * stride;
+		const size_t end = min(start + piece, payload.size());
+		for (size_t position = start; position < end; ++position)
+		{
+			++counts[(uint8_t)payload[position]];
+		}
+		total += end - start;
+	}
+
+	double bits = 0;
+	for (const auto& count : counts)
+	{
+		if (count == 0)
+		{
+			continue;
+		}
+
+		const double share = (double)count / (double)total;
+		bits -= share * log2(share);
+	}
+
+	return bits;
+}
+
+bool chunk_compressor::compress(const vector<char>& payload,
+								const modes& mode,
+								vector<char>& result,
+								uint64_t& nanoseconds) const
+{
+	const auto started = chrono::steady_clock::now();
+	const uint32_t original = (uint32_t)payload.size();
+	const int bound = LZ4_compressBound((int)original);
+
+	// a u32 original size goes in front, so decode sizes its buffer without
+	// the chunk header
+	result.resize(sizeof(original) + bound);
+	memcpy(result.data(), &original, sizeof(original));
+
+	const int size
+		= mode == modes::high
+			  ? LZ4_compress_HC(payload.data(), result.data() + sizeof(original),
+								(int)original, bound, _options.high_level)
+			  : LZ4_compress_default(payload.data(),
+									 result.data() + sizeof(original),
+									 (int)original, bound);
+	nanoseconds = elapsed_ns(started);
+	if (size <= 0)
+	{
+		return false;
+	}
+
+	result.resize(sizeof(original) + size);
+
+	return true;
+}
+
+void chunk_compressor::measure(const modes& mode,
+							   const uint64_t& original,
+							   const uint64_t& sent,
+							   const uint64_t& nanoseconds)
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	auto& model = _models[(int)mode];
+	const double cost = (double)nanoseconds / (double)original;
+	const double ratio = (double)sent / (double)original;
+	if (!model.measured)
+	{
+		model.cost = cost;
+		model.ratio = ratio;
+		model.measured = true;
+
+		return;
+	}
+
+	model.cost = blend(model.cost, cost);
+	model.ratio = blend(model.ratio, ratio);
+}
+
+void chunk_compressor::choose(void)
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	const auto& fast = _models[(int)modes::fast];
+	const auto& high = _models[(int)modes::high];
+	if (!fast.measured || !high.measured || _link_rate == 0)
+	{
+		return;
+	}
+
+	// compressing on more threads than cores makes every byte wait for a
+	// core as well
+	const double contention
+		= max(1.0, (double)_active.load() / (double)_cores);
+	const double link_ns = 1e9 / _link_rate;
+	auto cost = [&](const mode_model& model)
+	{ return model.cost * contention + model.ratio * link_ns; };
+
+	const bool high_now = _high;
+	const double current = cost(high_now ? high : fast);
+	const double other = cost(high_now ? fast : high);
+	if (other < current * hysteresis)
+	{
+		_high = !high_now;
+	}
+}
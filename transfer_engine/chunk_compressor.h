@@ -0,0 +1,144 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+
+#pragma once
+
+#include "chunk_frame.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+struct compression_options
+{
+	// a chunk whose sample holds more bits per byte than this goes out as
+	// it is, without a trial
+	double entropy_limit = 7.5;
+	uint32_t sample_size = 4 << 10;
+	// a trial keeping more than this share of the bytes is thrown away
+	double keep_limit = 0.9;
+	int high_level = 9;
+	// one compressible chunk in probe_interval is compressed both ways, so
+	// the mode not in use stays measured
+	uint32_t probe_interval = 32;
+};
+
+// what the chunks of one transfer came to
+struct compression_statistics
+{
+	uint64_t original_bytes = 0;
+	// compressed chunks as sent, incompressible ones as they were
+	uint64_t sent_bytes = 0;
+	uint64_t compressed_chunks = 0;
+	uint64_t skipped_chunks = 0;
+	uint64_t high_chunks = 0;
+	uint64_t compress_time_us = 0;
+	// link time the smaller payloads saved at the measured link rate, less
+	// the time spent compressing; negative when compressing cost more
+	int64_t saved_time_us = 0;
+
+	double ratio(void) const;
+};
+
+// compresses chunks with LZ4 where it pays. a sample of each chunk is
+// checked for entropy first, so media and archives are not compressed in
+// vain, and a trial that barely shrinks is dropped. the link rate is taken
+// from the frames the senders write, see transmitted(), and LZ4-HC is
+// picked over the fast mode while its extra CPU time, spread over the
+// cores left, costs less than the link time it saves.
+class chunk_compressor
+{
+public:
+	chunk_compressor(const compression_options& options = compression_options());
+	~chunk_compressor(void);
+
+public:
+	// a chunk_encoder for file_sender, marking chunk_header::compressed
+	bool encode(vector<char>& payload, chunk_header& header);
+	// a chunk_transform for chunk_receiver
+	static bool decode(vector<char>& payload);
+	// a write_observer for file_sender, timing the link
+	void transmitted(const uint64_t& bytes, const uint64_t& nanoseconds);
+
+	compression_statistics statistics(const string& indication_id) const;
+	// the statistics of a finished transfer, which are forgotten
+	compression_statistics take(const string& indication_id);
+
+	bool high_compression(void) const;
+	// bytes per second, 0 until measured
+	uint64_t link_rate(void) const;
+
+private:
+	enum class modes
+	{
+		fast = 0,
+		high = 1
+	};
+
+	struct mode_model
+	{
+		// nanoseconds per original byte, and sent share of the bytes
+		double cost = 0;
+		double ratio = 1;
+		bool measured = false;
+	};
+
+	double entropy(const vector<char>& payload) const;
+	bool compress(const vector<char>& payload,
+				  const modes& mode,
+				  vector<char>& result,
+				  uint64_t& nanoseconds) const;
+	void measure(const modes& mode,
+				 const uint64_t& original,
+				 const uint64_t& sent,
+				 const uint64_t& nanoseconds);
+	void choose(void);
+
+private:
+	compression_options _options;
+	unsigned int _cores;
+
+	atomic<uint32_t> _active;
+	atomic<uint64_t> _chunks;
+	atomic<bool> _high;
+
+	mutable mutex _mutex;
+	mode_model _models[2];
+	double _link_rate;
+	unordered_map<string, compression_statistics> _transfers;
+};
@@ -0,0 +1,139 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "chunk_frame.h"
+
+#include <cstring>
+
+#include <cryptopp/hmac.h>
+#include <cryptopp/misc.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/sha.h>
+
+namespace
+{
+	template <typename value_type>
+	void put(vector<char>& frame, const value_type& value)
+	{
+		const char* source = (const char*)&value;
+		frame.insert(frame.end(), source, source + sizeof(value_type));
+	}
+
+	void put(vector<char>& frame, const string& value)
+	{
+		put(frame, (uint32_t)value.size());
+		frame.insert(frame.end(), value.begin(), value.end());
+	}
+
+	template <typename value_type>
+	bool get(const char*& data, const char* end, value_type& value)
+	{
+		if ((size_t)(end - data) < sizeof(value_type))
+		{
+			return false;
+		}
+
+		memcpy(&value, data, sizeof(value_type));
+		data += sizeof(value_type);
+
+		return true;
+	}
+
+	bool get(const char*& data, const char* end, string& value)
+	{
+		uint32_t size = 0;
+		if (!get(data, end, size) || (size_t)(end - data) < size)
+		{
+			return false;
+		}
+
+		value.assign(data, size);
+		data += size;
+
+		return true;
+	}
+}
+
+void encode_header(const chunk_header& header, vector<char>& frame)
+{
+	const size_t prefix = frame.size();
+	put(frame, (uint32_t)0);
+	put(frame, header.flags);
+	put(frame, header.file_size);
+	put(frame, header.offset);
+	put(frame, header.original_size);
+	put(frame, header.size);
+	put(frame, header.checksum);
+	put(frame, header.indication_id);
+	put(frame, header.file_path);
+
+	const uint32_t size = (uint32_t)(frame.size() - prefix - sizeof(uint32_t));
+	memcpy(frame.data() + prefix, &size, sizeof(uint32_t));
+}
+
+bool decode_header(const char* data, const size_t& size, chunk_header& header)
+{
+	const char* end = data + size;
+
+	return get(data, end, header.flags) && get(data, end, header.file_size)
+		   && get(data, end, header.offset)
+		   && get(data, end, header.original_size)
+		   && get(data, end, header.size)
+		   && get(data, end, header.checksum)
+		   && get(data, end, header.indication_id)
+		   && get(data, end, header.file_path) && data == end;
+}
+
+void create_challenge(uint8_t* challenge)
+{
+	CryptoPP::AutoSeededRandomPool random;
+	random.GenerateBlock(challenge, challenge_size);
+}
+
+void prove_challenge(const string& secret,
+					 const uint8_t* challenge,
+					 uint8_t* proof)
+{
+	CryptoPP::HMAC<CryptoPP::SHA256> mac(
+		(const CryptoPP::byte*)secret.data(), secret.size());
+	mac.CalculateDigest(proof, challenge, challenge_size);
+}
+
+bool check_challenge(const string& secret,
+					 const uint8_t* challenge,
+					 const uint8_t* proof)
+{
+	uint8_t expected[proof_size];
+	prove_challenge(secret, challenge, expected);
+
+	return CryptoPP::VerifyBufsEqual(expected, proof, proof_size);
+}
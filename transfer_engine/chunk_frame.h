@@ -0,0 +1,109 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// every chunk on a data connection is framed as a u32 header size, the
+// header and then size bytes of payload. integers are little endian.
+struct chunk_header
+{
+	static constexpr uint8_t compressed = 1;
+	static constexpr uint8_t encrypted = 2;
+	// asks which chunks the receiver already holds. it carries no payload;
+	// size is the chunk size of the sender, and the receiver answers with
+	// a u64 byte count and its chunk_bitmap bits
+	static constexpr uint8_t resume = 4;
+	// asks for the block_signature of the copy the receiver already holds
+	// at file_path. size is the average block size to cut with, and the
+	// receiver answers with a u64 count and the signatures. a copy it can
+	// sign is rebuilt from frames of the two kinds and replaced at the end
+	static constexpr uint8_t signatures = 8;
+	// takes original_size bytes from that copy instead of a payload; the
+	// payload is the u64 offset to take them from
+	static constexpr uint8_t copied = 16;
+	// checksum holds the crc32c of the file bytes of the chunk, before any
+	// transform. a chunk that does not match is dropped, and named in the
+	// answer to the next rejected query of its connection
+	static constexpr uint8_t checked = 32;
+	// asks which chunks of file_path the connection dropped since the last
+	// ask. it carries no payload; the receiver answers with a u64 count and
+	// a u64 offset and u64 size for each
+	static constexpr uint8_t rejected = 64;
+	// with resume, offers file_path as the blob_entry list of its content
+	// defined blocks. the payload is a u64 count and, for each block, its
+	// two u64 hash halves, u32 size and u32 checksum. the receiver answers
+	// with a u64 count and the u64 index of each block its blob_store
+	// lacks, or with UINT64_MAX without a store. once it lacks none, the
+	// path becomes a reference to them and the file is complete.
+	// without resume, the payload is one such block, kept in the store
+	// rather than written to file_path.
+	static constexpr uint8_t stored = 128;
+
+	string indication_id;
+	// where the receiver stores the file, relative to its root
+	string file_path;
+	uint64_t file_size = 0;
+	// position of the chunk in the file and the file bytes it covers
+	uint64_t offset = 0;
+	uint32_t original_size = 0;
+	// payload bytes that follow the header, after any transform
+	uint32_t size = 0;
+	uint32_t checksum = 0;
+	uint8_t flags = 0;
+};
+
+// appends the size prefix and the header to frame
+void encode_header(const chunk_header& header, vector<char>& frame);
+
+// reads a header without its size prefix
+bool decode_header(const char* data, const size_t& size, chunk_header& header);
+
+// a receiver given a secret opens every data connection with
+// challenge_size random bytes and reads no frame before the sender answers
+// with the proof of them under the same secret, an HMAC-SHA256
+constexpr size_t challenge_size = 32;
+constexpr size_t proof_size = 32;
+
+void create_challenge(uint8_t* challenge);
+void prove_challenge(const string& secret,
+					 const uint8_t* challenge,
+					 uint8_t* proof);
+// compares in constant time
+bool check_challenge(const string& secret,
+					 const uint8_t* challenge,
+					 const uint8_t* proof);
@@ -0,0 +1,101 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+
+#include "chunk_pipeline.h"
+
+#include <algorithm>
+
+chunk_pipeline::chunk_pipeline(const unsigned short& worker_count)
+	: _stop(false)
+{
+	const unsigned int count
+		= worker_count > 0 ? worker_count
+						   : max(thread::hardware_concurrency(), 1u);
+	for (unsigned int index = 0; index < count; ++index)
+	{
+		_workers.emplace_back(&chunk_pipeline::run, this);
+	}
+}
+
+chunk_pipeline::~chunk_pipeline(void)
+{
+	{
+		scoped_lock<mutex> guard(_mutex);
+		_stop = true;
+	}
+
+	_condition.notify_all();
+	for (auto& worker : _workers)
+	{
+		worker.join();
+	}
+}
+
+void chunk_pipeline::push(function<void(void)>&& task)
+{
+	{
+		scoped_lock<mutex> guard(_mutex);
+		_tasks.push_back(std::move(task));
+	}
+
+	_condition.notify_one();
+}
+
+unsigned short chunk_pipeline::worker_count(void) const
+{
+	return (unsigned short)_workers.size();
+}
+
+void chunk_pipeline::run(void)
+{
+	while (true)
+	{
+		function<void(void)> task;
+		{
+			unique_lock<mutex> lock(_mutex);
+			_condition.wait(lock,
+							[this]() { return _stop || !_tasks.empty(); });
+
+			// queued tasks still run, as their senders wait for them
+			if (_tasks.empty())
+			{
+				return;
+			}
+
+			task = std::move(_tasks.front());
+			_tasks.pop_front();
+		}
+
+		task();
+	}
+}
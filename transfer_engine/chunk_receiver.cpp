@@ -0,0 +1,1383 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "chunk_receiver.h"
+#include "checksum.h"
+#include "delta_signature.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace
+{
+	// frame headers only carry ids and a path
+	constexpr uint32_t header_limit = 64 * 1024;
+	// seconds a new connection has to answer its challenge
+	constexpr unsigned int challenge_timeout = 10;
+	// room for what compression and encryption add to a chunk
+	constexpr uint32_t transform_overhead = 4096;
+	// longest pause of the accept loop after failing accepts
+	constexpr unsigned int accept_backoff = 1000;
+	// an offer lists every block of a file in 24 bytes, so this covers
+	// about 170 GB at the default 64 KB store blocks
+	constexpr uint32_t offer_limit = 64 << 20;
+
+	void close_socket(const int& target)
+	{
+#ifdef _WIN32
+		closesocket(target);
+#else
+		close(target);
+#endif
+	}
+
+	void shutdown_socket(const int& target)
+	{
+#ifdef _WIN32
+		shutdown(target, SD_BOTH);
+#else
+		shutdown(target, SHUT_RDWR);
+#endif
+	}
+
+	// 1 once size bytes arrived, 0 when the peer closed before the first
+	// byte and -1 on errors or a frame cut short
+	int receive(const int& connection, char* data, const size_t& size)
+	{
+		size_t done = 0;
+		while (done < size)
+		{
+#ifdef _WIN32
+			int result = recv(connection, data + done,
+							  (int)min(size - done, (size_t)INT32_MAX), 0);
+#else
+			ssize_t result = recv(connection, data + done, size - done, 0);
+			if (result < 0 && errno == EINTR)
+			{
+				continue;
+			}
+#endif
+			if (result == 0 && done == 0)
+			{
+				return 0;
+			}
+
+			if (result <= 0)
+			{
+				return -1;
+			}
+
+			done += (size_t)result;
+		}
+
+		return 1;
+	}
+
+	bool transmit(const int& connection, const char* data, const size_t& size)
+	{
+		size_t done = 0;
+		while (done < size)
+		{
+#ifdef _WIN32
+			int result = send(connection, data + done,
+							  (int)min(size - done, (size_t)INT32_MAX), 0);
+#else
+			ssize_t result
+				= send(connection, data + done, size - done, MSG_NOSIGNAL);
+			if (result < 0 && errno == EINTR)
+			{
+				continue;
+			}
+#endif
+			if (result <= 0)
+			{
+				return false;
+			}
+
+			done += (size_t)result;
+		}
+
+		return true;
+	}
+
+	int open_target(const string& path, const uint64_t& size)
+	{
+		error_code error;
+		filesystem::create_directories(filesystem::path(path).parent_path(),
+									   error);
+
+		// the size is set up front, so chunks can land in any order
+#ifdef _WIN32
+		int result = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_BINARY,
+						   _S_IREAD | _S_IWRITE);
+		if (result >= 0 && _chsize_s(result, (__int64)size) != 0)
+		{
+			_close(result);
+			return -1;
+		}
+#else
+		int result = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+		if (result >= 0 && ftruncate(result, (off_t)size) != 0)
+		{
+			close(result);
+			return -1;
+		}
+#endif
+
+		return result;
+	}
+
+	int open_base(const string& path)
+	{
+#ifdef _WIN32
+		return _open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+		return ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+	}
+
+	bool read_base(const int& base, char* data, const uint64_t& size,
+				   const uint64_t& offset)
+	{
+#ifdef _WIN32
+		if (_lseeki64(base, (__int64)offset, SEEK_SET) < 0)
+		{
+			return false;
+		}
+#endif
+
+		uint64_t done = 0;
+		while (done < size)
+		{
+#ifdef _WIN32
+			int result = _read(base, data + done,
+							   (unsigned int)min<uint64_t>(size - done, INT32_MAX));
+#else
+			ssize_t result = pread(base, data + done, size - done,
+								   (off_t)(offset + done));
+			if (result < 0 && errno == EINTR)
+			{
+				continue;
+			}
+#endif
+			if (result <= 0)
+			{
+				return false;
+			}
+
+			done += (uint64_t)result;
+		}
+
+		return true;
+	}
+
+	string file_key(const string& indication_id, const string& file_path)
+	{
+		string key = indication_id;
+		key.push_back('\0');
+		key.append(file_path);
+
+		return key;
+	}
+
+	void close_target(const int& descriptor)
+	{
+#ifdef _WIN32
+		_close(descriptor);
+#else
+		close(descriptor);
+#endif
+	}
+}
+
+chunk_receiver::chunk_receiver(
+	const io_options& options,
+	const function<void(const string&, const string&, const uint64_t&)>&
+		progress,
+	const function<void(const string&, const string&, const bool&,
+						const uint32_t&)>& completion)
+	: _backend(io_backend::create(options))
+	, _progress(progress)
+	, _completion(completion)
+	, _required(0)
+	, _chunk_limit(64 << 20)
+	, _listener(-1)
+	, _port(0)
+	, _stop(false)
+	, _active(0)
+{
+}
+
+chunk_receiver::~chunk_receiver(void)
+{
+	stop();
+
+	// outstanding writes complete before the file table goes away
+	_backend.reset();
+
+	vector<shared_ptr<open_file>> remained;
+	{
+		scoped_lock<mutex> guard(_file_mutex);
+
+		for (auto& [key, target] : _files)
+		{
+			remained.push_back(target);
+		}
+	}
+
+	for (auto& target : remained)
+	{
+		settle(target, false);
+	}
+}
+
+void chunk_receiver::add_transform(const uint8_t& flag,
+								   const chunk_transform& transform)
+{
+	_transforms.push_back(
+		{ flag, [transform](vector<char>& payload, const chunk_header&)
+		  { return transform(payload); } });
+}
+
+void chunk_receiver::add_transform(const uint8_t& flag,
+								   const chunk_decoder& decoder)
+{
+	_transforms.push_back({ flag, decoder });
+}
+
+void chunk_receiver::require(const uint8_t& flags) { _required = flags; }
+
+void chunk_receiver::set_store(shared_ptr<blob_store> store)
+{
+	scoped_lock<mutex> guard(_connection_mutex);
+
+	_store = store;
+}
+
+void chunk_receiver::set_root(const string& root) { _root = root; }
+
+void chunk_receiver::set_secret(const string& secret) { _secret = secret; }
+
+void chunk_receiver::set_chunk_limit(const uint32_t& limit)
+{
+	_chunk_limit = limit;
+}
+
+void chunk_receiver::set_registry(
+	const function<bool(const string&, const string&)>& registered)
+{
+	_registry = registered;
+}
+
+bool chunk_receiver::start(const unsigned short& port)
+{
+	stop();
+
+	// links in the root itself are resolved once, so resolve() compares
+	// the resolved paths below it
+	error_code error;
+	if (_root.empty())
+	{
+		_root = filesystem::current_path(error);
+	}
+	filesystem::create_directories(_root, error);
+	_root = filesystem::weakly_canonical(_root, error);
+	if (error)
+	{
+		return false;
+	}
+
+	_listener = (int)socket(AF_INET6, SOCK_STREAM, 0);
+	if (_listener < 0)
+	{
+		return false;
+	}
+
+	// dual stack, so IPv4 peers connect as well
+	int option = 0;
+	setsockopt(_listener, IPPROTO_IPV6, IPV6_V6ONLY, (const char*)&option,
+			   sizeof(option));
+	option = 1;
+	setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&option,
+			   sizeof(option));
+
+	sockaddr_in6 address{};
+	address.sin6_family = AF_INET6;
+	address.sin6_addr = in6addr_any;
+	address.sin6_port = htons(port);
+	socklen_t length = sizeof(address);
+	if (bind(_listener, (sockaddr*)&address, sizeof(address)) != 0
+		|| listen(_listener, SOMAXCONN) != 0
+		|| getsockname(_listener, (sockaddr*)&address, &length) != 0)
+	{
+		close_socket(_listener);
+		_listener = -1;
+		return false;
+	}
+
+	_port = ntohs(address.sin6_port);
+	_stop.store(false);
+	_accept_thread = thread(&chunk_receiver::accept_connections, this);
+
+	return true;
+}
+
+void chunk_receiver::stop(void)
+{
+	if (_listener < 0)
+	{
+		return;
+	}
+
+	_stop.store(true);
+	shutdown_socket(_listener);
+	_accept_thread.join();
+	close_socket(_listener);
+	_listener = -1;
+
+	unique_lock<mutex> lock(_connection_mutex);
+	for (auto& connection : _connections)
+	{
+		shutdown_socket(connection);
+	}
+	_connection_condition.wait(lock, [this]() { return _active == 0; });
+}
+
+unsigned short chunk_receiver::port(void) const { return _port; }
+
+string chunk_receiver::backend(void) const { return _backend->name(); }
+
+void chunk_receiver::accept_connections(void)
+{
+	// out of descriptors or memory accept fails at once, so the loop backs
+	// off instead of spinning until it succeeds again
+	unsigned int backoff = 0;
+	while (!_stop.load())
+	{
+		int connection = (int)accept(_listener, nullptr, nullptr);
+		if (connection < 0)
+		{
+			if (_stop.load())
+			{
+				return;
+			}
+
+			backoff = min(accept_backoff, max(backoff * 2, 1u));
+			this_thread::sleep_for(chrono::milliseconds(backoff));
+			continue;
+		}
+		backoff = 0;
+
+		scoped_lock<mutex> guard(_connection_mutex);
+
+		_connections.push_back(connection);
+		++_active;
+		thread(&chunk_receiver::serve, this, connection, _store).detach();
+	}
+}
+
+void chunk_receiver::serve(const int& connection,
+							shared_ptr<blob_store> blobs)
+{
+	// files whose frames this connection carried, released when it ends
+	touched_files touched;
+	vector<char> header_data;
+	chunk_header header;
+	inflight chunks;
+	rejected_chunks rejected;
+
+	const bool admitted = _secret.empty() || authenticate(connection);
+	while (admitted && !_stop.load())
+	{
+		uint32_t header_size = 0;
+		if (receive(connection, (char*)&header_size, sizeof(header_size)) != 1
+			|| header_size > header_limit)
+		{
+			break;
+		}
+
+		header_data.resize(header_size);
+		if (receive(connection, header_data.data(), header_size) != 1
+			|| !decode_header(header_data.data(), header_size, header))
+		{
+			break;
+		}
+
+		if ((header.flags & chunk_header::signatures) != 0)
+		{
+			if (!sign(connection, header, touched))
+			{
+				break;
+			}
+			continue;
+		}
+
+		if ((header.flags & chunk_header::rejected) != 0)
+		{
+			if (!report(connection, header, rejected))
+			{
+				break;
+			}
+			continue;
+		}
+
+		if ((header.flags & chunk_header::stored) != 0)
+		{
+			if (!store(connection, header, blobs))
+			{
+				break;
+			}
+			continue;
+		}
+
+		const bool query = (header.flags & chunk_header::resume) != 0;
+		if (!query
+			&& (!bounded(header) || header.original_size > header.file_size
+				|| header.offset > header.file_size - header.original_size))
+		{
+			break;
+		}
+
+		// file bytes have to carry every transform the receiver insists on,
+		// checked before the file is opened
+		const uint8_t flags
+			= (uint8_t)(header.flags & ~chunk_header::checked);
+		if (!query && header.file_size > 0 && flags != chunk_header::copied
+			&& (flags & _required) != _required)
+		{
+			break;
+		}
+
+		auto target = open(header);
+		if (target == nullptr)
+		{
+			break;
+		}
+
+		touch(touched, target);
+
+		if (query)
+		{
+			if (!answer(connection, target))
+			{
+				break;
+			}
+			continue;
+		}
+
+		if (header.file_size == 0)
+		{
+			settle(target, true);
+			continue;
+		}
+
+		if (flags == chunk_header::copied)
+		{
+			if (!copy(connection, header, target, chunks, rejected))
+			{
+				break;
+			}
+			continue;
+		}
+
+		if (flags == 0 && header.size == header.original_size
+			&& header.size <= _backend->buffer_size())
+		{
+			const int buffer = _backend->acquire();
+			char* data = _backend->buffer(buffer);
+			if (receive(connection, data, header.size) != 1)
+			{
+				_backend->release(buffer);
+				break;
+			}
+
+			if (!verify(header, target, data, rejected))
+			{
+				_backend->release(buffer);
+				continue;
+			}
+
+			// the backend may be going away while the write completes
+			io_backend* backend = _backend.get();
+			chunks.add();
+			write(target, header.offset, data, header.size, buffer,
+				  [backend, buffer, &chunks]()
+				  {
+					  backend->release(buffer);
+					  chunks.remove();
+				  });
+			continue;
+		}
+
+		auto payload = make_shared<vector<char>>(header.size);
+		if (receive(connection, payload->data(), header.size) != 1)
+		{
+			break;
+		}
+
+		if (!undo(flags, header, *payload)
+			|| payload->size() != header.original_size)
+		{
+			break;
+		}
+
+		if (!verify(header, target, payload->data(), rejected))
+		{
+			continue;
+		}
+
+		chunks.add();
+		write(target, header.offset, payload->data(), header.original_size,
+			  -1, [payload, &chunks]() { chunks.remove(); });
+	}
+
+	chunks.wait();
+
+	// whether this connection ended cleanly or was cut off, a file still
+	// incomplete once no connection carries it any more has failed
+	for (auto& target : touched)
+	{
+		if (target->connections.fetch_sub(1) == 1)
+		{
+			settle(target, false);
+		}
+	}
+
+	scoped_lock<mutex> guard(_connection_mutex);
+
+	erase(_connections, connection);
+	close_socket(connection);
+	--_active;
+	_connection_condition.notify_all();
+}
+
+bool chunk_receiver::authenticate(const int& connection) const
+{
+	uint8_t challenge[challenge_size];
+	uint8_t proof[proof_size];
+	create_challenge(challenge);
+
+	// a peer that never answers does not hold the thread
+	return set_socket_timeout(connection, challenge_timeout)
+		   && transmit(connection, (const char*)challenge, sizeof(challenge))
+		   && receive(connection, (char*)proof, sizeof(proof)) == 1
+		   && check_challenge(_secret, challenge, proof)
+		   && set_socket_timeout(connection, 0);
+}
+
+bool chunk_receiver::resolve(const chunk_header& header,
+							 string& local_path) const
+{
+	const filesystem::path path(header.file_path);
+	if (path.empty() || path.has_root_path())
+	{
+		return false;
+	}
+
+	for (auto& part : path)
+	{
+		if (part == "..")
+		{
+			return false;
+		}
+	}
+
+	if (_registry != nullptr
+		&& !_registry(header.indication_id, header.file_path))
+	{
+		return false;
+	}
+
+	// a link below the root may still lead out of it
+	error_code error;
+	const auto resolved = filesystem::weakly_canonical(_root / path, error);
+	if (error)
+	{
+		return false;
+	}
+
+	auto [root_end, resolved_end] = mismatch(_root.begin(), _root.end(),
+											 resolved.begin(), resolved.end());
+	if (root_end != _root.end() || resolved_end == resolved.end())
+	{
+		return false;
+	}
+
+	local_path = resolved.string();
+
+	return true;
+}
+
+bool chunk_receiver::bounded(const chunk_header& header) const
+{
+	// compression may grow a chunk a little, as lz4 does by 1/255
+	return header.original_size <= _chunk_limit
+		   && header.size <= (uint64_t)_chunk_limit + _chunk_limit / 255
+								 + transform_overhead;
+}
+
+void chunk_receiver::touch(touched_files& touched,
+						   const shared_ptr<open_file>& target)
+{
+	if (touched.insert(target).second)
+	{
+		target->connections.fetch_add(1);
+	}
+}
+
+void chunk_receiver::inflight::add(void)
+{
+	scoped_lock<mutex> guard(lock);
+	++count;
+}
+
+void chunk_receiver::inflight::remove(void)
+{
+	// notified under the lock, as the waiter destroys this right after
+	scoped_lock<mutex> guard(lock);
+	--count;
+	condition.notify_all();
+}
+
+void chunk_receiver::inflight::wait(void)
+{
+	unique_lock<mutex> guard(lock);
+	condition.wait(guard, [this]() { return count == 0; });
+}
+
+shared_ptr<chunk_receiver::open_file> chunk_receiver::open(
+	const chunk_header& header)
+{
+	const string key = file_key(header.indication_id, header.file_path);
+
+	auto target = make_shared<open_file>();
+	{
+		scoped_lock<mutex> guard(_file_mutex);
+
+		auto found = _files.find(key);
+		if (found != _files.end())
+		{
+			return found->second;
+		}
+
+		// only the first frame of a file is checked, the table vouches for
+		// the rest
+		if (!resolve(header, target->local_path))
+		{
+			return nullptr;
+		}
+
+		// kept bits only hold while the partial target is still there
+		error_code error;
+		const bool resumable = filesystem::file_size(target->local_path, error)
+								   == header.file_size
+							   && !error;
+
+		target->indication_id = header.indication_id;
+		target->file_path = header.file_path;
+		target->size = header.file_size;
+		target->checked = (header.flags & chunk_header::checked) != 0;
+		if ((header.flags & chunk_header::signatures) != 0)
+		{
+			target->temporary = target->local_path + ".delta";
+			target->base = open_base(target->local_path);
+			if (target->base < 0)
+			{
+				return nullptr;
+			}
+		}
+
+		target->descriptor = open_target(target->temporary.empty()
+											 ? target->local_path
+											 : target->temporary,
+										 header.file_size);
+		if (target->descriptor < 0)
+		{
+			finish(target);
+			return nullptr;
+		}
+
+		target->handle = _backend->attach(target->descriptor);
+		if (target->handle < 0)
+		{
+			finish(target);
+			return nullptr;
+		}
+
+		if ((header.flags & chunk_header::resume) != 0)
+		{
+			auto chunks = make_unique<chunk_bitmap>();
+			if (chunks->open(target->local_path, header.file_size, header.size,
+							 resumable))
+			{
+				target->chunks = std::move(chunks);
+			}
+		}
+
+		_files.insert({ key, target });
+	}
+
+	if (target->chunks == nullptr)
+	{
+		return target;
+	}
+
+	// chunks kept from an earlier attempt count as received right away
+	const uint64_t resumed = target->chunks->received_bytes();
+	if (resumed > 0 && _progress != nullptr)
+	{
+		_progress(target->indication_id, target->file_path, resumed);
+	}
+
+	if (target->chunks->complete())
+	{
+		settle(target, true);
+	}
+
+	return target;
+}
+
+bool chunk_receiver::answer(const int& connection,
+							const shared_ptr<open_file>& target)
+{
+	vector<uint8_t> bits;
+	if (target->chunks != nullptr)
+	{
+		bits = target->chunks->bits();
+	}
+
+	const uint64_t size = bits.size();
+
+	return transmit(connection, (const char*)&size, sizeof(size))
+		   && transmit(connection, (const char*)bits.data(), bits.size());
+}
+
+bool chunk_receiver::sign(const int& connection,
+						  const chunk_header& header,
+						  touched_files& touched)
+{
+	// only a file a transfer expects below the root is signed
+	string local_path;
+	if (!resolve(header, local_path))
+	{
+		return false;
+	}
+
+	bool busy = false;
+	{
+		scoped_lock<mutex> guard(_file_mutex);
+
+		busy = _files.count(file_key(header.indication_id, header.file_path))
+			   > 0;
+	}
+
+	// a copy still being received is no base to build on, and a copy that
+	// cannot be signed is sent whole
+	vector<block_signature> signatures;
+	if (!busy && header.file_size > 0 && header.size > 0
+		&& sign_file(local_path, content_chunker(header.size), signatures)
+		&& !signatures.empty())
+	{
+		auto target = open(header);
+		if (target == nullptr)
+		{
+			signatures.clear();
+		}
+		else
+		{
+			touch(touched, target);
+		}
+	}
+
+	const uint64_t count = signatures.size();
+
+	return transmit(connection, (const char*)&count, sizeof(count))
+		   && transmit(connection, (const char*)signatures.data(),
+					   signatures.size() * sizeof(block_signature));
+}
+
+bool chunk_receiver::copy(const int& connection,
+						  const chunk_header& header,
+						  const shared_ptr<open_file>& target,
+						  inflight& chunks,
+						  rejected_chunks& rejected)
+{
+	uint64_t source = 0;
+	if (header.size != sizeof(source) || target->base < 0
+		|| receive(connection, (char*)&source, sizeof(source)) != 1)
+	{
+		return false;
+	}
+
+	auto payload = make_shared<vector<char>>(header.original_size);
+	{
+#ifdef _WIN32
+		scoped_lock<mutex> guard(target->base_mutex);
+#endif
+		if (!read_base(target->base, payload->data(), payload->size(),
+					   source))
+		{
+			return false;
+		}
+	}
+
+	// the old copy changed since it was signed
+	if (!verify(header, target, payload->data(), rejected))
+	{
+		return true;
+	}
+
+	chunks.add();
+	write(target, header.offset, payload->data(), header.original_size, -1,
+		  [payload, &chunks]() { chunks.remove(); });
+
+	return true;
+}
+
+bool chunk_receiver::verify(const chunk_header& header,
+							const shared_ptr<open_file>& target,
+							const char* data,
+							rejected_chunks& rejected)
+{
+	if ((header.flags & chunk_header::checked) == 0)
+	{
+		return true;
+	}
+
+	const uint32_t checksum = crc32c(data, header.original_size);
+	if (checksum != header.checksum)
+	{
+		rejected[file_key(header.indication_id, header.file_path)].push_back(
+			{ header.offset, header.original_size });
+		return false;
+	}
+
+	target->checked = true;
+
+	scoped_lock<mutex> guard(target->checksum_mutex);
+	target->checksums.push_back(
+		{ header.offset, header.original_size, checksum });
+
+	return true;
+}
+
+bool chunk_receiver::report(const int& connection,
+							const chunk_header& header,
+							rejected_chunks& rejected)
+{
+	vector<uint64_t> ranges;
+	auto found = rejected.find(file_key(header.indication_id, header.file_path));
+	if (found != rejected.end())
+	{
+		for (auto& [offset, size] : found->second)
+		{
+			ranges.push_back(offset);
+			ranges.push_back(size);
+		}
+		rejected.erase(found);
+	}
+
+	const uint64_t count = ranges.size() / 2;
+
+	return transmit(connection, (const char*)&count, sizeof(count))
+		   && transmit(connection, (const char*)ranges.data(),
+					   ranges.size() * sizeof(uint64_t));
+}
+
+bool chunk_receiver::store(const int& connection,
+						   const chunk_header& header,
+						   const shared_ptr<blob_store>& blobs)
+{
+	// blocks are only taken for a file a transfer expects, and the path
+	// linked to them is the one the file would have had below the root
+	string local_path;
+	if (!resolve(header, local_path))
+	{
+		return false;
+	}
+
+	// a block is bounded like any chunk, an offer by its block count
+	const bool offer = (header.flags & chunk_header::resume) != 0;
+	if (offer ? header.size > offer_limit : !bounded(header))
+	{
+		return false;
+	}
+
+	vector<char> payload(header.size);
+	if (receive(connection, payload.data(), header.size) != 1)
+	{
+		return false;
+	}
+
+	if (!offer)
+	{
+		const uint8_t flags = (uint8_t)(header.flags
+										& ~(chunk_header::stored
+											| chunk_header::checked));
+		if (blobs == nullptr || (flags & _required) != _required
+			|| !undo(flags, header, payload)
+			|| payload.size() != header.original_size
+			|| header.original_size > header.file_size
+			|| header.offset > header.file_size - header.original_size)
+		{
+			return false;
+		}
+
+		// a block failing its checksum is not kept, so the next offer of
+		// the file names it again
+		if ((header.flags & chunk_header::checked) != 0
+			&& crc32c(payload.data(), header.original_size)
+				   != header.checksum)
+		{
+			return true;
+		}
+
+		uint64_t hash[2];
+		if (!blobs->put(payload.data(), header.original_size, hash))
+		{
+			return false;
+		}
+
+		if (_progress != nullptr)
+		{
+			_progress(header.indication_id, header.file_path,
+					  header.original_size);
+		}
+
+		return true;
+	}
+
+	// a sender offering to a receiver without a store sends the file again
+	// the usual way
+	if (blobs == nullptr)
+	{
+		const uint64_t declined = UINT64_MAX;
+		return transmit(connection, (const char*)&declined, sizeof(declined));
+	}
+
+	uint64_t count = 0;
+	if (payload.size() < sizeof(count))
+	{
+		return false;
+	}
+	memcpy(&count, payload.data(), sizeof(count));
+
+	constexpr size_t entry_size = sizeof(uint64_t) * 2 + sizeof(uint32_t) * 2;
+	if (count > (payload.size() - sizeof(count)) / entry_size
+		|| payload.size() != sizeof(count) + count * entry_size)
+	{
+		return false;
+	}
+
+	vector<blob_entry> entries((size_t)count);
+	const char* position = payload.data() + sizeof(count);
+	uint64_t total = 0;
+	for (auto& entry : entries)
+	{
+		memcpy(entry.hash, position, sizeof(entry.hash));
+		memcpy(&entry.size, position + 16, sizeof(entry.size));
+		memcpy(&entry.checksum, position + 20, sizeof(entry.checksum));
+		position += entry_size;
+		total += entry.size;
+	}
+
+	if (total != header.file_size)
+	{
+		return false;
+	}
+
+	vector<uint64_t> missing;
+	for (size_t index = 0; index < entries.size(); ++index)
+	{
+		if (!blobs->contains(entries[index].hash))
+		{
+			missing.push_back(index);
+		}
+	}
+
+	if (missing.empty())
+	{
+		const bool linked = blobs->link(local_path, entries);
+
+		uint32_t digest = 0;
+		if (linked && (header.flags & chunk_header::checked) != 0)
+		{
+			for (auto& entry : entries)
+			{
+				digest = crc32c_combine(digest, entry.checksum, entry.size);
+			}
+		}
+
+		if (_completion != nullptr)
+		{
+			_completion(header.indication_id, header.file_path, linked,
+						digest);
+		}
+
+		// the sender takes a cut connection for a failed file
+		if (!linked)
+		{
+			return false;
+		}
+	}
+
+	const uint64_t missing_count = missing.size();
+
+	return transmit(connection, (const char*)&missing_count,
+					sizeof(missing_count))
+		   && transmit(connection, (const char*)missing.data(),
+					   missing.size() * sizeof(uint64_t));
+}
+
+bool chunk_receiver::undo(const uint8_t& flags,
+						  const chunk_header& header,
+						  vector<char>& payload) const
+{
+	uint8_t undone = flags;
+	for (auto transform = _transforms.rbegin();
+		 transform != _transforms.rend(); ++transform)
+	{
+		if ((undone & transform->first) == 0)
+		{
+			continue;
+		}
+
+		if (!transform->second(payload, header))
+		{
+			return false;
+		}
+		undone &= (uint8_t)~transform->first;
+	}
+
+	return undone == 0;
+}
+
+bool chunk_receiver::write(const shared_ptr<open_file>& target,
+						   const uint64_t& offset,
+						   char* data,
+						   const uint32_t& size,
+						   const int& buffer,
+						   const function<void(void)>& release)
+{
+	target->pending.fetch_add(1);
+
+	io_request request;
+	request.file = target->handle;
+	request.write = true;
+	request.offset = offset;
+	request.data = data;
+	request.size = size;
+	request.buffer = buffer;
+	request.completion = [this, target, offset, data, size, buffer,
+						  release](const int64_t& result)
+	{
+		// a short write is carried on from where it stopped
+		// a failed write leaves a hole, so the file fails once its last
+		// connection ends
+		const bool carried = result > 0 && result < (int64_t)size;
+		if (result > 0)
+		{
+			// the last piece of a chunk marks it, before written() may
+			// complete the file
+			if (!carried && target->chunks != nullptr)
+			{
+				target->chunks->set(offset / target->chunks->chunk_size());
+			}
+
+			written(target, offset, (uint64_t)result);
+
+			if (carried)
+			{
+				write(target, offset + result, data + result,
+					  size - (uint32_t)result, buffer, release);
+			}
+		}
+
+		if (target->pending.fetch_sub(1) == 1)
+		{
+			finish(target);
+		}
+
+		// released last, so the connection waiting on it sees the file done
+		if (!carried)
+		{
+			release();
+		}
+	};
+
+	if (_backend->submit(std::move(request)))
+	{
+		return true;
+	}
+
+	if (target->pending.fetch_sub(1) == 1)
+	{
+		finish(target);
+	}
+	release();
+
+	return false;
+}
+
+void chunk_receiver::written(const shared_ptr<open_file>& target,
+							 const uint64_t& offset,
+							 const uint64_t& bytes)
+{
+	if (_progress != nullptr)
+	{
+		_progress(target->indication_id, target->file_path, bytes);
+	}
+
+	// bytes written twice count once, so only a file without holes
+	// completes
+	const bool complete = target->chunks != nullptr
+							  ? target->chunks->complete()
+							  : cover(target, offset, bytes);
+	if (complete)
+	{
+		settle(target, true);
+	}
+}
+
+bool chunk_receiver::cover(const shared_ptr<open_file>& target,
+						   const uint64_t& offset,
+						   const uint64_t& bytes)
+{
+	scoped_lock<mutex> guard(target->range_mutex);
+
+	auto& ranges = target->ranges;
+	uint64_t start = offset;
+	uint64_t end = offset + bytes;
+
+	// ranges touching the new one are merged into it
+	auto next = ranges.upper_bound(start);
+	if (next != ranges.begin())
+	{
+		auto previous = prev(next);
+		if (previous->second >= start)
+		{
+			start = previous->first;
+			end = max(end, previous->second);
+			target->covered -= previous->second - previous->first;
+			ranges.erase(previous);
+		}
+	}
+
+	while (next != ranges.end() && next->first <= end)
+	{
+		end = max(end, next->second);
+		target->covered -= next->second - next->first;
+		next = ranges.erase(next);
+	}
+
+	ranges.insert({ start, end });
+	target->covered += end - start;
+
+	return target->covered >= target->size;
+}
+
+void chunk_receiver::settle(const shared_ptr<open_file>& target,
+							const bool& received)
+{
+	if (target->settled.exchange(true))
+	{
+		return;
+	}
+
+	{
+		const string key = file_key(target->indication_id, target->file_path);
+
+		scoped_lock<mutex> guard(_file_mutex);
+
+		auto found = _files.find(key);
+		if (found != _files.end() && found->second == target)
+		{
+			_files.erase(found);
+		}
+	}
+
+	// a file that cannot be read back for its digest counts as failed
+	uint32_t checksum = 0;
+	bool replaced
+		= received && (!target->checked.load() || digest(target, checksum));
+
+	if (replaced && target->chunks != nullptr)
+	{
+		target->chunks->remove();
+	}
+
+	if (replaced && !target->temporary.empty())
+	{
+		error_code error;
+		filesystem::rename(target->temporary, target->local_path, error);
+		replaced = !error;
+	}
+
+	if (_completion != nullptr)
+	{
+		_completion(target->indication_id, target->file_path, replaced,
+					checksum);
+	}
+
+	// the table no longer hands the file out, so its own hold goes
+	if (target->pending.fetch_sub(1) == 1)
+	{
+		finish(target);
+	}
+}
+
+bool chunk_receiver::digest(const shared_ptr<open_file>& target,
+							uint32_t& result)
+{
+	scoped_lock<mutex> guard(target->checksum_mutex);
+
+	auto& checksums = target->checksums;
+	sort(checksums.begin(), checksums.end(),
+		 [](const checked_chunk& left, const checked_chunk& right)
+		 { return left.offset < right.offset; });
+
+	// chunks kept from an earlier attempt, or sent without a checksum,
+	// are read back from the disk
+	int source = -1;
+	vector<char> buffer;
+	auto read_back = [&](uint64_t offset, uint64_t size)
+	{
+		if (size > 0 && source < 0)
+		{
+			source = open_base(target->temporary.empty() ? target->local_path
+														  : target->temporary);
+			buffer.resize(1 << 20);
+		}
+
+		while (size > 0)
+		{
+			const uint64_t length = min<uint64_t>(size, buffer.size());
+			if (source < 0
+				|| !read_base(source, buffer.data(), length, offset))
+			{
+				return false;
+			}
+
+			result = crc32c(buffer.data(), length, result);
+			offset += length;
+			size -= length;
+		}
+
+		return true;
+	};
+
+	result = 0;
+	uint64_t position = 0;
+	bool folded = true;
+	for (auto& chunk : checksums)
+	{
+		const uint64_t end = chunk.offset + chunk.size;
+		if (end <= position)
+		{
+			continue;
+		}
+
+		// a chunk overlapping the ones folded already is read back past them
+		if (chunk.offset < position)
+		{
+			folded = read_back(position, end - position);
+		}
+		else
+		{
+			folded = read_back(position, chunk.offset - position);
+			result = crc32c_combine(result, chunk.checksum, chunk.size);
+		}
+
+		if (!folded)
+		{
+			break;
+		}
+
+		position = end;
+	}
+
+	if (folded && position < target->size)
+	{
+		folded = read_back(position, target->size - position);
+	}
+
+	if (source >= 0)
+	{
+		close_target(source);
+	}
+
+	return folded;
+}
+
+void chunk_receiver::finish(const shared_ptr<open_file>& target)
+{
+	if (_backend != nullptr && target->handle >= 0)
+	{
+		_backend->detach(target->handle);
+	}
+	if (target->descriptor >= 0)
+	{
+		close_target(target->descriptor);
+	}
+	if (target->base >= 0)
+	{
+		close_target(target->base);
+	}
+
+	// left behind only by a rebuild that failed
+	if (!target->temporary.empty())
+	{
+		error_code error;
+		filesystem::remove(target->temporary, error);
+	}
+}
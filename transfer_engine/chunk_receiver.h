@@ -0,0 +1,258 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#pragma once
+
+#include "blob_store.h"
+#include "chunk_bitmap.h"
+#include "chunk_frame.h"
+#include "file_sender.h"
+#include "io_backend.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+// undoes a transform of the sender on the payload of the frame header
+// leads, e.g. to check what an authenticated cipher bound to the header
+using chunk_decoder
+	= function<bool(vector<char>& payload, const chunk_header& header)>;
+
+// accepts data connections and writes the chunk frames arriving on them at
+// their offsets through an io_backend, so a handful of threads keep the
+// disk busy however many files are open. chunks of one file may arrive on
+// several connections at once. a file that fails keeps its chunk_bitmap,
+// so the next transfer of it resumes, and a copy the receiver holds already
+// can be rebuilt from the blocks the sender lacks. chunks failing their
+// checksum are dropped until the sender asks for them and sends them again.
+// with a blob_store, files offered by their blocks are kept in it instead,
+// and a file whose blocks are all known completes without any data.
+// frames only reach files under the root, and with a registry only those
+// of transfers it expects, so a peer cannot write or read anything else.
+class chunk_receiver
+{
+public:
+	// progress(indication_id, file_path, bytes) follows every written chunk
+	// and completion(indication_id, file_path, received, digest) every file.
+	// digest is the crc32c of the whole file, or 0 when the sender checked
+	// none of its chunks.
+	chunk_receiver(
+		const io_options& options,
+		const function<void(const string&, const string&, const uint64_t&)>&
+			progress,
+		const function<void(const string&, const string&, const bool&,
+							const uint32_t&)>& completion);
+	~chunk_receiver(void);
+
+public:
+	// undoes what the sender's transform with the same flag did; applied
+	// in the reverse order of adding
+	void add_transform(const uint8_t& flag, const chunk_transform& transform);
+	void add_transform(const uint8_t& flag, const chunk_decoder& decoder);
+	// set before start(). frames carrying file bytes without every flag of
+	// flags cut their connection, so a peer cannot skip a transform such as
+	// encryption
+	void require(const uint8_t& flags);
+	// applies to the connections accepted afterwards, see
+	// chunk_header::stored
+	void set_store(shared_ptr<blob_store> store);
+	// set before start(). file paths of frames are relative to root, the
+	// working directory without one, and a path that is absolute, holds
+	// .. or leads out of root through a link is refused
+	void set_root(const string& root);
+	// set before start(). connections have to answer a challenge under
+	// secret before their first frame, see prove_challenge
+	void set_secret(const string& secret);
+	// set before start(). registered(indication_id, file_path) tells
+	// whether a transfer expects the file; frames of any other file cut
+	// their connection
+	void set_registry(
+		const function<bool(const string&, const string&)>& registered);
+	// set before start(). frames with a chunk above limit, before or after
+	// their transforms, cut their connection before anything is allocated
+	// for them. has to cover the chunk_size of the senders; 64 MB without,
+	// the largest chunk the servers send
+	void set_chunk_limit(const uint32_t& limit);
+
+	bool start(const unsigned short& port);
+	void stop(void);
+
+	unsigned short port(void) const;
+	string backend(void) const;
+
+private:
+	struct checked_chunk
+	{
+		uint64_t offset = 0;
+		uint32_t size = 0;
+		uint32_t checksum = 0;
+	};
+
+	struct open_file
+	{
+		string indication_id;
+		string file_path;
+		// file_path resolved under the root, where the bytes go
+		string local_path;
+		uint64_t size = 0;
+		int descriptor = -1;
+		int handle = -1;
+		// requests in flight, plus one held while the file is registered
+		atomic<uint32_t> pending{ 1 };
+		atomic<bool> settled{ false };
+		// connections that carried frames of the file. the last of them to
+		// end fails the file if it is still incomplete, so a stripe cut off
+		// neither fails it under the others nor leaves it open
+		atomic<uint32_t> connections{ 0 };
+		// kept for files opened by a resume query, whose chunks complete
+		// the file once all are marked
+		unique_ptr<chunk_bitmap> chunks;
+		// any other file completes once its written ranges, end by start,
+		// cover it, as delta frames are not cut on chunk boundaries
+		mutex range_mutex;
+		map<uint64_t, uint64_t> ranges;
+		uint64_t covered = 0;
+		// a file rebuilt from a signed copy is written beside it, and
+		// replaces it once complete
+		string temporary;
+		int base = -1;
+		mutex base_mutex;
+		// chunks that matched their checksum, folded into the digest once
+		// the file is complete
+		atomic<bool> checked{ false };
+		mutex checksum_mutex;
+		vector<checked_chunk> checksums;
+	};
+
+	// offset and size of the chunks a connection dropped, by file
+	using rejected_chunks
+		= unordered_map<string, vector<pair<uint64_t, uint64_t>>>;
+	using touched_files = unordered_set<shared_ptr<open_file>>;
+
+	// chunks of one connection still being written. io_uring cancels the
+	// requests of a thread that exits, so a connection thread outlives them
+	struct inflight
+	{
+		mutex lock;
+		condition_variable condition;
+		uint32_t count = 0;
+
+		void add(void);
+		void remove(void);
+		void wait(void);
+	};
+
+	void accept_connections(void);
+	void serve(const int& connection, shared_ptr<blob_store> blobs);
+	bool authenticate(const int& connection) const;
+	bool resolve(const chunk_header& header, string& local_path) const;
+	bool bounded(const chunk_header& header) const;
+	shared_ptr<open_file> open(const chunk_header& header);
+	bool answer(const int& connection, const shared_ptr<open_file>& target);
+	bool sign(const int& connection,
+			  const chunk_header& header,
+			  touched_files& touched);
+	bool copy(const int& connection,
+			  const chunk_header& header,
+			  const shared_ptr<open_file>& target,
+			  inflight& chunks,
+			  rejected_chunks& rejected);
+	bool verify(const chunk_header& header,
+				const shared_ptr<open_file>& target,
+				const char* data,
+				rejected_chunks& rejected);
+	bool report(const int& connection,
+				const chunk_header& header,
+				rejected_chunks& rejected);
+	bool store(const int& connection,
+			   const chunk_header& header,
+			   const shared_ptr<blob_store>& blobs);
+	bool undo(const uint8_t& flags,
+			  const chunk_header& header,
+			  vector<char>& payload) const;
+	bool write(const shared_ptr<open_file>& target,
+			   const uint64_t& offset,
+			   char* data,
+			   const uint32_t& size,
+			   const int& buffer,
+			   const function<void(void)>& release);
+	void written(const shared_ptr<open_file>& target,
+				 const uint64_t& offset,
+				 const uint64_t& bytes);
+	bool cover(const shared_ptr<open_file>& target,
+			   const uint64_t& offset,
+			   const uint64_t& bytes);
+	void touch(touched_files& touched, const shared_ptr<open_file>& target);
+	void settle(const shared_ptr<open_file>& target, const bool& received);
+	bool digest(const shared_ptr<open_file>& target, uint32_t& result);
+	void finish(const shared_ptr<open_file>& target);
+
+private:
+	unique_ptr<io_backend> _backend;
+	function<void(const string&, const string&, const uint64_t&)> _progress;
+	function<void(const string&, const string&, const bool&, const uint32_t&)>
+		_completion;
+	vector<pair<uint8_t, chunk_decoder>> _transforms;
+	uint8_t _required;
+	shared_ptr<blob_store> _store;
+	filesystem::path _root;
+	string _secret;
+	function<bool(const string&, const string&)> _registry;
+	uint32_t _chunk_limit;
+
+	int _listener;
+	unsigned short _port;
+	atomic<bool> _stop;
+	thread _accept_thread;
+
+	// connections are served by detached threads, counted so that stop()
+	// can wait for them
+	mutex _connection_mutex;
+	condition_variable _connection_condition;
+	vector<int> _connections;
+	size_t _active;
+
+	mutex _file_mutex;
+	unordered_map<string, shared_ptr<open_file>> _files;
+};
@@ -0,0 +1,316 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "delta_signature.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <fstream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DELTA_SSE2
+#endif
+
+namespace
+{
+	constexpr array<uint64_t, 256> make_gear(void)
+	{
+		// splitmix64, so the table is fixed for every build and both ends
+		// cut at the same places
+		array<uint64_t, 256> table{};
+		uint64_t state = 0;
+		for (auto& entry : table)
+		{
+			state += 0x9e3779b97f4a7c15ull;
+			uint64_t value = state;
+			value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+			value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+			entry = value ^ (value >> 31);
+		}
+
+		return table;
+	}
+
+	constexpr array<uint64_t, 256> gear = make_gear();
+
+	// the top bits of the gear hash cover the last 64 bytes
+	uint64_t top_bits(const int& count)
+	{
+		return count <= 0 ? 0 : ~0ull << (64 - min(count, 63));
+	}
+
+	uint64_t fetch(const uint8_t* data)
+	{
+		uint64_t value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	uint64_t mix(uint64_t value)
+	{
+		value ^= value >> 33;
+		value *= 0xff51afd7ed558ccdull;
+		value ^= value >> 33;
+		value *= 0xc4ceb9fe1a85ec53ull;
+		value ^= value >> 33;
+		return value;
+	}
+}
+
+content_chunker::content_chunker(const uint32_t& average_size)
+	: _average(bit_ceil(max<uint32_t>(average_size, 256)))
+{
+	_minimum = _average / 4;
+	_maximum = _average * 8;
+
+	// a stricter mask before the average and a looser one after it keep
+	// block sizes close to the average
+	const int bits = countr_zero(_average);
+	_strict = top_bits(bits + 2);
+	_loose = top_bits(bits - 2);
+}
+
+size_t content_chunker::cut(const char* data, const size_t& size) const
+{
+	if (size <= _minimum)
+	{
+		return size;
+	}
+
+	const uint8_t* bytes = (const uint8_t*)data;
+	const size_t limit = min<size_t>(size, _maximum);
+	const size_t normal = min<size_t>(limit, _average);
+
+	uint64_t hash = 0;
+	size_t position = _minimum;
+	for (; position < normal; ++position)
+	{
+		hash = (hash << 1) + gear[bytes[position]];
+		if ((hash & _strict) == 0)
+		{
+			return position + 1;
+		}
+	}
+	for (; position < limit; ++position)
+	{
+		hash = (hash << 1) + gear[bytes[position]];
+		if ((hash & _loose) == 0)
+		{
+			return position + 1;
+		}
+	}
+
+	return limit;
+}
+
+uint32_t content_chunker::average(void) const { return _average; }
+
+uint32_t content_chunker::maximum(void) const { return _maximum; }
+
+uint32_t weak_checksum(const char* data, const size_t& size)
+{
+	// both sums only matter modulo 2^16, so they may wrap freely
+	const uint8_t* bytes = (const uint8_t*)data;
+	uint32_t sum = 0;
+	uint32_t weighted = 0;
+	size_t position = 0;
+
+#ifdef DELTA_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i high_weights = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+	const __m128i low_weights = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+	for (; position + 16 <= size; position += 16)
+	{
+		const __m128i block
+			= _mm_loadu_si128((const __m128i*)(bytes + position));
+
+		// every byte of the block adds to the weighted sum by its distance
+		// from the end, and the earlier bytes once more per byte here
+		const __m128i sums = _mm_sad_epu8(block, zero);
+		const __m128i products = _mm_add_epi32(
+			_mm_madd_epi16(_mm_unpacklo_epi8(block, zero), high_weights),
+			_mm_madd_epi16(_mm_unpackhi_epi8(block, zero), low_weights));
+		const __m128i folded = _mm_add_epi32(
+			products, _mm_shuffle_epi32(products, _MM_SHUFFLE(1, 0, 3, 2)));
+
+		weighted += sum * 16
+					+ (uint32_t)_mm_cvtsi128_si32(_mm_add_epi32(
+						folded, _mm_shuffle_epi32(folded, _MM_SHUFFLE(2, 3, 0, 1))));
+		sum += (uint32_t)_mm_cvtsi128_si32(sums)
+			   + (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+	}
+#endif
+
+	for (; position < size; ++position)
+	{
+		sum += bytes[position];
+		weighted += sum;
+	}
+
+	return (sum & 0xffff) | (weighted << 16);
+}
+
+void strong_checksum(const char* data, const size_t& size, uint64_t (&hash)[2])
+{
+	constexpr uint64_t c1 = 0x87c37b91114253d5ull;
+	constexpr uint64_t c2 = 0x4cf5ad432745937full;
+
+	const uint8_t* bytes = (const uint8_t*)data;
+	const size_t blocks = size / 16;
+	uint64_t h1 = 0;
+	uint64_t h2 = 0;
+
+	for (size_t index = 0; index < blocks; ++index)
+	{
+		uint64_t k1 = fetch(bytes + index * 16);
+		uint64_t k2 = fetch(bytes + index * 16 + 8);
+
+		k1 *= c1;
+		k1 = rotl(k1, 31);
+		k1 *= c2;
+		h1 ^= k1;
+		h1 = rotl(h1, 27);
+		h1 += h2;
+		h1 = h1 * 5 + 0x52dce729;
+
+		k2 *= c2;
+		k2 = rotl(k2, 33);
+		k2 *= c1;
+		h2 ^= k2;
+		h2 = rotl(h2, 31);
+		h2 += h1;
+		h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	const uint8_t* tail = bytes + blocks * 16;
+	uint64_t k1 = 0;
+	uint64_t k2 = 0;
+	switch (size & 15)
+	{
+	case 15: k2 ^= (uint64_t)tail[14] << 48; [[fallthrough]];
+	case 14: k2 ^= (uint64_t)tail[13] << 40; [[fallthrough]];
+	case 13: k2 ^= (uint64_t)tail[12] << 32; [[fallthrough]];
+	case 12: k2 ^= (uint64_t)tail[11] << 24; [[fallthrough]];
+	case 11: k2 ^= (uint64_t)tail[10] << 16; [[fallthrough]];
+	case 10: k2 ^= (uint64_t)tail[9] << 8; [[fallthrough]];
+	case 9:
+		k2 ^= (uint64_t)tail[8];
+		k2 *= c2;
+		k2 = rotl(k2, 33);
+		k2 *= c1;
+		h2 ^= k2;
+		[[fallthrough]];
+	case 8: k1 ^= (uint64_t)tail[7] << 56; [[fallthrough]];
+	case 7: k1 ^= (uint64_t)tail[6] << 48; [[fallthrough]];
+	case 6: k1 ^= (uint64_t)tail[5] << 40; [[fallthrough]];
+	case 5: k1 ^= (uint64_t)tail[4] << 32; [[fallthrough]];
+	case 4: k1 ^= (uint64_t)tail[3] << 24; [[fallthrough]];
+	case 3: k1 ^= (uint64_t)tail[2] << 16; [[fallthrough]];
+	case 2: k1 ^= (uint64_t)tail[1] << 8; [[fallthrough]];
+	case 1:
+		k1 ^= (uint64_t)tail[0];
+		k1 *= c1;
+		k1 = rotl(k1, 31);
+		k1 *= c2;
+		h1 ^= k1;
+	}
+
+	h1 ^= size;
+	h2 ^= size;
+	h1 += h2;
+	h2 += h1;
+	h1 = mix(h1);
+	h2 = mix(h2);
+	h1 += h2;
+	h2 += h1;
+
+	hash[0] = h1;
+	hash[1] = h2;
+}
+
+bool sign_file(const string& path,
+			   const content_chunker& chunker,
+			   vector<block_signature>& signatures)
+{
+	signatures.clear();
+
+	ifstream file(path, ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	// the window always holds a whole block ahead unless the file ends
+	vector<char> window(max<size_t>(chunker.maximum() * 2, 4 << 20));
+	size_t begin = 0;
+	size_t end = 0;
+	bool ended = false;
+	uint64_t offset = 0;
+
+	while (true)
+	{
+		if (!ended && end - begin < chunker.maximum())
+		{
+			memmove(window.data(), window.data() + begin, end - begin);
+			end -= begin;
+			begin = 0;
+
+			file.read(window.data() + end, (streamsize)(window.size() - end));
+			end += (size_t)file.gcount();
+			ended = !file.good();
+			if (file.bad())
+			{
+				return false;
+			}
+		}
+
+		if (begin == end)
+		{
+			return true;
+		}
+
+		block_signature signature;
+		signature.offset = offset;
+		signature.size
+			= (uint32_t)chunker.cut(window.data() + begin, end - begin);
+		signature.weak = weak_checksum(window.data() + begin, signature.size);
+		strong_checksum(window.data() + begin, signature.size,
+						signature.strong);
+		signatures.push_back(signature);
+
+		begin += signature.size;
+		offset += signature.size;
+	}
+}
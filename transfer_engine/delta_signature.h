@@ -0,0 +1,85 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// one content defined block of the copy a receiver already holds
+struct block_signature
+{
+	uint64_t offset = 0;
+	uint64_t strong[2] = { 0, 0 };
+	uint32_t size = 0;
+	uint32_t weak = 0;
+};
+
+// cuts blocks where a gear hash rolling over the data hits a mask, so an
+// insertion only moves the boundaries next to it. blocks average about
+// average_size bytes, between a quarter and eight times of it.
+class content_chunker
+{
+public:
+	content_chunker(const uint32_t& average_size);
+
+public:
+	// length of the block at the front of data. data holds at least
+	// maximum() bytes unless it ends the file.
+	size_t cut(const char* data, const size_t& size) const;
+
+	uint32_t average(void) const;
+	uint32_t maximum(void) const;
+
+private:
+	uint32_t _minimum;
+	uint32_t _average;
+	uint32_t _maximum;
+	uint64_t _strict;
+	uint64_t _loose;
+};
+
+// the rsync block checksum, a plain sum in the low half and a position
+// weighted one in the high half. sixteen bytes at a time with SSE2.
+uint32_t weak_checksum(const char* data, const size_t& size);
+
+// 128 bit MurmurHash3, confirming blocks whose weak checksums matched
+void strong_checksum(const char* data, const size_t& size, uint64_t (&hash)[2]);
+
+// signs the file at path block by block; false when it cannot be read
+bool sign_file(const string& path,
+			   const content_chunker& chunker,
+			   vector<block_signature>& signatures);
@@ -0,0 +1,1420 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "file_sender.h"
+#include "checksum.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+namespace
+{
+	int open_source(const string& path)
+	{
+#ifdef _WIN32
+		return _open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+		return open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+	}
+
+	void close_source(const int& source)
+	{
+#ifdef _WIN32
+		_close(source);
+#else
+		close(source);
+#endif
+	}
+
+	bool size_of(const int& source, uint64_t& size)
+	{
+#ifdef _WIN32
+		struct _stat64 status;
+		if (_fstat64(source, &status) != 0)
+#else
+		struct stat status;
+		if (fstat(source, &status) != 0)
+#endif
+		{
+			return false;
+		}
+
+		size = (uint64_t)status.st_size;
+
+		return true;
+	}
+
+	// reads exactly size bytes unless the file ends or fails first
+	bool read_at(const int& source,
+				 char* data,
+				 const uint64_t& size,
+				 const uint64_t& offset)
+	{
+#ifdef _WIN32
+		if (_lseeki64(source, (__int64)offset, SEEK_SET) < 0)
+		{
+			return false;
+		}
+#endif
+
+		uint64_t done = 0;
+		while (done < size)
+		{
+#ifdef _WIN32
+			int result = _read(source, data + done,
+							   (unsigned int)min<uint64_t>(size - done, INT32_MAX));
+#else
+			ssize_t result = pread(source, data + done, size - done,
+								   (off_t)(offset + done));
+			if (result < 0 && errno == EINTR)
+			{
+				continue;
+			}
+#endif
+			if (result <= 0)
+			{
+				return false;
+			}
+
+			done += (uint64_t)result;
+		}
+
+		return true;
+	}
+}
+
+chunk_encoder flagged(const uint8_t& flag, const chunk_transform& transform)
+{
+	return [flag, transform](vector<char>& payload, chunk_header& header)
+	{
+		if (!transform(payload))
+		{
+			return false;
+		}
+
+		header.flags |= flag;
+		return true;
+	};
+}
+
+file_sender::file_sender(const send_options& options)
+	: _options(options)
+	, _broken(false)
+	, _declined(false)
+	, _digest(0)
+	, _copy(copy_modes::buffered)
+	, _pipe{ -1, -1 }
+{
+	if (_options.chunk_size == 0)
+	{
+		_options.chunk_size = send_options().chunk_size;
+	}
+}
+
+file_sender::~file_sender(void) { release(); }
+
+void file_sender::add_transform(const uint8_t& flag,
+								const chunk_transform& transform)
+{
+	_transforms.push_back(flagged(flag, transform));
+}
+
+void file_sender::add_transform(const chunk_encoder& encoder)
+{
+	_transforms.push_back(encoder);
+}
+
+void file_sender::set_pipeline(shared_ptr<chunk_pipeline> pipeline)
+{
+	_pipeline = pipeline;
+}
+
+void file_sender::set_observer(const write_observer& observer)
+{
+	_observer = observer;
+}
+
+void file_sender::set_store(shared_ptr<blob_store> store) { _store = store; }
+
+bool file_sender::send(chunk_channel& channel,
+					   const string& indication_id,
+					   const string& source_path,
+					   const string& target_path,
+					   const function<void(const uint64_t&)>& progress)
+{
+	_present.clear();
+
+	// a receiver links an upload at its path resolved below its root, so
+	// the source is looked up the same way
+	error_code lookup;
+	vector<blob_entry> entries;
+	if (_store != nullptr && !filesystem::exists(source_path)
+		&& _store->find(
+			filesystem::weakly_canonical(source_path, lookup).string(),
+			entries))
+	{
+		return send_reference(channel, indication_id, target_path, progress,
+							  entries);
+	}
+
+	if (_options.deduplicate && !_declined)
+	{
+		bool declined = false;
+		const bool sent = send_stored(channel, indication_id, source_path,
+									  target_path, progress, declined);
+		if (!declined)
+		{
+			return sent;
+		}
+
+		_declined = true;
+	}
+	if (_options.resume || _options.delta)
+	{
+		error_code error;
+		const uint64_t file_size = filesystem::file_size(source_path, error);
+		if (error)
+		{
+			return false;
+		}
+
+		// a receiver without a copy to sign gets the whole file
+		if (_options.delta && file_size > 0)
+		{
+			vector<block_signature> signatures;
+			if (!sign(channel, indication_id, target_path, file_size,
+					  signatures))
+			{
+				return false;
+			}
+
+			if (!signatures.empty())
+			{
+				return send_delta(channel, indication_id, source_path,
+								  target_path, progress, signatures);
+			}
+		}
+
+		if (_options.resume && file_size > 0
+			&& !query(channel, indication_id, target_path, file_size,
+					  _present))
+		{
+			return false;
+		}
+	}
+
+	return send(channel, indication_id, source_path, target_path, progress, 0,
+				UINT64_MAX, _present);
+}
+
+bool file_sender::send(chunk_channel& channel,
+					   const string& indication_id,
+					   const string& source_path,
+					   const string& target_path,
+					   const function<void(const uint64_t&)>& progress,
+					   const uint64_t& offset,
+					   const uint64_t& size,
+					   const vector<uint8_t>& present)
+{
+	const int source = open_source(source_path);
+	if (source < 0)
+	{
+		return false;
+	}
+
+	chunk_header header;
+	header.indication_id = indication_id;
+	header.file_path = target_path;
+	if (!size_of(source, header.file_size))
+	{
+		close_source(source);
+		return false;
+	}
+
+	choose_copy(channel);
+	_digest = 0;
+
+	uint64_t position = min(offset, header.file_size);
+	const uint64_t end = position + min(size, header.file_size - position);
+
+	// only transformed chunks have work worth handing to other cores
+	if (_pipeline != nullptr && _copy == copy_modes::buffered
+		&& !_transforms.empty())
+	{
+		bool result = pipelined(channel, source, header, position, end,
+								present, progress);
+		if (result && _options.verify)
+		{
+			result = resend(channel, source, header);
+		}
+
+		close_source(source);
+
+		return result;
+	}
+
+	// an empty file still gets one frame, so the receiver creates it
+	bool result = true;
+	do
+	{
+		const uint64_t length
+			= min<uint64_t>(_options.chunk_size, end - position);
+
+		// counted as sent, since the receiver holds them already
+		if (skip(present, position, length, header.file_size))
+		{
+			uint32_t crc = 0;
+			if (_options.verify && !checksum(source, position, length, crc))
+			{
+				result = false;
+				break;
+			}
+
+			_digest = crc32c_combine(_digest, crc, length);
+			position += length;
+			if (progress != nullptr)
+			{
+				progress(length);
+			}
+			continue;
+		}
+
+		result = chunk(channel, source, header, position, length);
+		if (!result)
+		{
+			_broken = true;
+			break;
+		}
+
+		_digest = crc32c_combine(_digest, header.checksum, length);
+		position += length;
+		if (length > 0 && progress != nullptr)
+		{
+			progress(length);
+		}
+	} while (position < end);
+
+	if (result && _options.verify)
+	{
+		result = resend(channel, source, header);
+	}
+
+	close_source(source);
+
+	return result;
+}
+
+bool file_sender::broken(void) const { return _broken; }
+
+uint32_t file_sender::digest(void) const { return _digest; }
+
+void file_sender::choose_copy(chunk_channel& channel)
+{
+	// every file starts over, as it may live on another file system
+	_copy = copy_modes::buffered;
+#ifdef __linux__
+	if (_options.zero_copy && _transforms.empty() && channel.descriptor() >= 0)
+	{
+		_copy = copy_modes::sendfile;
+	}
+#endif
+}
+
+bool file_sender::chunk(chunk_channel& channel,
+						const int& source,
+						chunk_header& header,
+						const uint64_t& offset,
+						const uint64_t& size)
+{
+	header.offset = offset;
+	header.original_size = (uint32_t)size;
+	header.checksum = 0;
+	header.flags = 0;
+
+	if (_copy == copy_modes::buffered)
+	{
+		return buffered(channel, source, offset, size, header);
+	}
+
+	// the bytes are read once for the checksum, still sparing the copy
+	// into the socket
+	if (_options.verify)
+	{
+		if (!checksum(source, offset, size, header.checksum))
+		{
+			return false;
+		}
+		header.flags = chunk_header::checked;
+	}
+
+	header.size = (uint32_t)size;
+	_frame.clear();
+	encode_header(header, _frame);
+
+	return channel.write(_frame.data(), _frame.size())
+		   && transmit(channel, source, offset, size);
+}
+
+bool file_sender::transmit(chunk_channel& channel,
+						   const int& source,
+						   uint64_t offset,
+						   uint64_t size)
+{
+#ifdef __linux__
+	while (size > 0 && _copy == copy_modes::sendfile)
+	{
+		off_t position = (off_t)offset;
+		ssize_t sent
+			= sendfile(channel.descriptor(), source, &position, size);
+		if (sent > 0)
+		{
+			offset += (uint64_t)sent;
+			size -= (uint64_t)sent;
+			continue;
+		}
+
+		if (sent < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		// the file system cannot sendfile, so the pages go over a pipe
+		if (sent < 0 && (errno == EINVAL || errno == ENOSYS))
+		{
+			_copy = _pipe[0] >= 0 || pipe2(_pipe, O_CLOEXEC) == 0
+						? copy_modes::splice
+						: copy_modes::buffered;
+			break;
+		}
+
+		return false;
+	}
+
+	while (size > 0 && _copy == copy_modes::splice)
+	{
+		loff_t position = (loff_t)offset;
+		ssize_t moved = splice(source, &position, _pipe[1], nullptr, size,
+							   SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (moved < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (moved < 0 && errno == EINVAL)
+		{
+			_copy = copy_modes::buffered;
+			break;
+		}
+
+		if (moved <= 0)
+		{
+			return false;
+		}
+
+		// the pipe must be drained before the next read, or it keeps
+		// bytes that belong to the socket
+		for (ssize_t left = moved; left > 0;)
+		{
+			ssize_t sent = splice(_pipe[0], nullptr, channel.descriptor(),
+								  nullptr, (size_t)left,
+								  SPLICE_F_MOVE | SPLICE_F_MORE);
+			if (sent < 0 && errno == EINTR)
+			{
+				continue;
+			}
+
+			// whatever is left in the pipe would lead the next chunk
+			if (sent <= 0)
+			{
+				release();
+				return false;
+			}
+
+			left -= sent;
+		}
+
+		offset += (uint64_t)moved;
+		size -= (uint64_t)moved;
+	}
+#endif
+
+	if (size == 0)
+	{
+		return true;
+	}
+
+	_buffer.resize(size);
+
+	return read_at(source, _buffer.data(), size, offset)
+		   && channel.write(_buffer.data(), _buffer.size());
+}
+
+bool file_sender::query(chunk_channel& channel,
+						const string& indication_id,
+						const string& target_path,
+						const uint64_t& file_size,
+						vector<uint8_t>& present)
+{
+	chunk_header request;
+	request.indication_id = indication_id;
+	request.file_path = target_path;
+	request.file_size = file_size;
+	request.flags = chunk_header::resume;
+	if (_options.verify)
+	{
+		request.flags |= chunk_header::checked;
+	}
+	request.size = _options.chunk_size;
+
+	_frame.clear();
+	encode_header(request, _frame);
+
+	// nothing kept, or the bits of every chunk of the file
+	const uint64_t chunks
+		= (file_size + _options.chunk_size - 1) / _options.chunk_size;
+	uint64_t size = 0;
+	if (!channel.write(_frame.data(), _frame.size())
+		|| !channel.read((char*)&size, sizeof(size))
+		|| (size != 0 && size != (chunks + 7) / 8))
+	{
+		_broken = true;
+		return false;
+	}
+
+	present.resize((size_t)size);
+	if (size > 0 && !channel.read((char*)present.data(), present.size()))
+	{
+		_broken = true;
+		return false;
+	}
+
+	return true;
+}
+
+bool file_sender::sign(chunk_channel& channel,
+					   const string& indication_id,
+					   const string& target_path,
+					   const uint64_t& file_size,
+					   vector<block_signature>& signatures)
+{
+	chunk_header request;
+	request.indication_id = indication_id;
+	request.file_path = target_path;
+	request.file_size = file_size;
+	request.flags = chunk_header::signatures;
+	if (_options.verify)
+	{
+		request.flags |= chunk_header::checked;
+	}
+	request.size = _options.delta_block_size;
+
+	_frame.clear();
+	encode_header(request, _frame);
+
+	uint64_t count = 0;
+	if (!channel.write(_frame.data(), _frame.size())
+		|| !channel.read((char*)&count, sizeof(count))
+		|| count > UINT32_MAX)
+	{
+		_broken = true;
+		return false;
+	}
+
+	signatures.resize((size_t)count);
+	if (count > 0
+		&& !channel.read((char*)signatures.data(),
+						 signatures.size() * sizeof(block_signature)))
+	{
+		_broken = true;
+		return false;
+	}
+
+	return true;
+}
+
+bool file_sender::send_delta(chunk_channel& channel,
+							 const string& indication_id,
+							 const string& source_path,
+							 const string& target_path,
+							 const function<void(const uint64_t&)>& progress,
+							 const vector<block_signature>& signatures)
+{
+	const int source = open_source(source_path);
+	if (source < 0)
+	{
+		return false;
+	}
+
+	chunk_header header;
+	header.indication_id = indication_id;
+	header.file_path = target_path;
+	if (!size_of(source, header.file_size))
+	{
+		close_source(source);
+		return false;
+	}
+
+	choose_copy(channel);
+	_digest = 0;
+
+	// looked up by weak checksum; the strong one only settles a match
+	vector<uint32_t> order(signatures.size());
+	for (uint32_t index = 0; index < order.size(); ++index)
+	{
+		order[index] = index;
+	}
+	sort(order.begin(), order.end(),
+		 [&](const uint32_t& left, const uint32_t& right)
+		 { return signatures[left].weak < signatures[right].weak; });
+
+	// literal bytes go out as plain chunks, runs of matched blocks as
+	// copied frames
+	uint64_t literal_offset = 0;
+	uint64_t literal_size = 0;
+	uint64_t copy_offset = 0;
+	uint64_t copy_source = 0;
+	uint64_t copy_size = 0;
+	uint32_t copy_checksum = 0;
+
+	auto flush_literal = [&]()
+	{
+		for (uint64_t done = 0; done < literal_size;)
+		{
+			const uint64_t length
+				= min<uint64_t>(_options.chunk_size, literal_size - done);
+			if (!chunk(channel, source, header, literal_offset + done, length))
+			{
+				return false;
+			}
+
+			_digest = crc32c_combine(_digest, header.checksum, length);
+			done += length;
+			if (progress != nullptr)
+			{
+				progress(length);
+			}
+		}
+
+		literal_size = 0;
+		return true;
+	};
+
+	auto flush_copy = [&]()
+	{
+		if (copy_size == 0)
+		{
+			return true;
+		}
+
+		header.offset = copy_offset;
+		header.original_size = (uint32_t)copy_size;
+		header.size = sizeof(copy_source);
+		header.checksum = copy_checksum;
+		header.flags = chunk_header::copied;
+		if (_options.verify)
+		{
+			header.flags |= chunk_header::checked;
+		}
+		_frame.clear();
+		encode_header(header, _frame);
+		_frame.insert(_frame.end(), (const char*)&copy_source,
+					  (const char*)&copy_source + sizeof(copy_source));
+		if (!channel.write(_frame.data(), _frame.size()))
+		{
+			return false;
+		}
+
+		if (progress != nullptr)
+		{
+			progress(copy_size);
+		}
+
+		_digest = crc32c_combine(_digest, copy_checksum, copy_size);
+		copy_size = 0;
+		return true;
+	};
+
+	content_chunker chunker(_options.delta_block_size);
+	vector<char> window(max<size_t>(chunker.maximum() * 2, 4 << 20));
+	size_t begin = 0;
+	size_t end = 0;
+	uint64_t position = 0;
+	uint64_t loaded = 0;
+	bool result = true;
+
+	while (result && position < header.file_size)
+	{
+		if (loaded < header.file_size && end - begin < chunker.maximum())
+		{
+			memmove(window.data(), window.data() + begin, end - begin);
+			end -= begin;
+			begin = 0;
+
+			const uint64_t size
+				= min<uint64_t>(window.size() - end, header.file_size - loaded);
+			if (!read_at(source, window.data() + end, size, loaded))
+			{
+				result = false;
+				break;
+			}
+
+			end += (size_t)size;
+			loaded += size;
+		}
+
+		const char* block = window.data() + begin;
+		const uint32_t size = (uint32_t)chunker.cut(block, end - begin);
+		const uint32_t weak = weak_checksum(block, size);
+
+		const block_signature* found = nullptr;
+		uint64_t strong[2];
+		bool hashed = false;
+		auto candidate = lower_bound(
+			order.begin(), order.end(), weak,
+			[&](const uint32_t& index, const uint32_t& value)
+			{ return signatures[index].weak < value; });
+		for (; candidate != order.end() && signatures[*candidate].weak == weak;
+			 ++candidate)
+		{
+			const block_signature& signature = signatures[*candidate];
+			if (signature.size != size)
+			{
+				continue;
+			}
+
+			if (!hashed)
+			{
+				strong_checksum(block, size, strong);
+				hashed = true;
+			}
+
+			if (signature.strong[0] == strong[0]
+				&& signature.strong[1] == strong[1])
+			{
+				found = &signature;
+				break;
+			}
+		}
+
+		if (found == nullptr)
+		{
+			if (!flush_copy())
+			{
+				result = false;
+				break;
+			}
+
+			if (literal_size == 0)
+			{
+				literal_offset = position;
+			}
+			literal_size += size;
+		}
+		else
+		{
+			// neighbouring blocks of the old copy travel as one frame
+			const bool extends = copy_size > 0
+								 && copy_source + copy_size == found->offset
+								 && copy_size + size <= _options.chunk_size;
+			if (!flush_literal() || (!extends && !flush_copy()))
+			{
+				result = false;
+				break;
+			}
+
+			if (copy_size == 0)
+			{
+				copy_offset = position;
+				copy_source = found->offset;
+				copy_checksum = 0;
+			}
+			copy_size += size;
+			if (_options.verify)
+			{
+				copy_checksum = crc32c(block, size, copy_checksum);
+			}
+		}
+
+		begin += size;
+		position += size;
+	}
+
+	result = result && flush_literal() && flush_copy();
+	if (!result)
+	{
+		_broken = true;
+	}
+
+	// blocks the old copy no longer matches come back as plain chunks
+	if (result && _options.verify)
+	{
+		result = resend(channel, source, header);
+	}
+
+	close_source(source);
+
+	return result;
+}
+
+bool file_sender::send_stored(chunk_channel& channel,
+							  const string& indication_id,
+							  const string& source_path,
+							  const string& target_path,
+							  const function<void(const uint64_t&)>& progress,
+							  bool& declined)
+{
+	declined = false;
+
+	const int source = open_source(source_path);
+	if (source < 0)
+	{
+		return false;
+	}
+
+	chunk_header header;
+	header.indication_id = indication_id;
+	header.file_path = target_path;
+	if (!size_of(source, header.file_size))
+	{
+		close_source(source);
+		return false;
+	}
+
+	_digest = 0;
+
+	// the whole file is cut and hashed before the offer, so a receiver
+	// holding every block answers once and no byte of it moves
+	content_chunker chunker(_options.store_block_size);
+	vector<char> window(max<size_t>(chunker.maximum() * 2, 4 << 20));
+	vector<blob_entry> entries;
+	vector<uint64_t> offsets;
+	size_t begin = 0;
+	size_t end = 0;
+	uint64_t position = 0;
+	uint64_t loaded = 0;
+	bool result = true;
+
+	while (position < header.file_size)
+	{
+		if (loaded < header.file_size && end - begin < chunker.maximum())
+		{
+			memmove(window.data(), window.data() + begin, end - begin);
+			end -= begin;
+			begin = 0;
+
+			const uint64_t size
+				= min<uint64_t>(window.size() - end, header.file_size - loaded);
+			if (!read_at(source, window.data() + end, size, loaded))
+			{
+				result = false;
+				break;
+			}
+
+			end += (size_t)size;
+			loaded += size;
+		}
+
+		const char* block = window.data() + begin;
+		blob_entry entry;
+		entry.size = (uint32_t)chunker.cut(block, end - begin);
+		strong_checksum(block, entry.size, entry.hash);
+		entry.checksum = crc32c(block, entry.size);
+		entries.push_back(entry);
+		offsets.push_back(position);
+
+		begin += entry.size;
+		position += entry.size;
+	}
+
+	for (unsigned short attempt = 0; result; ++attempt)
+	{
+		vector<uint64_t> missing;
+		if (!offer(channel, header, entries, missing, declined))
+		{
+			result = false;
+			break;
+		}
+
+		if (declined)
+		{
+			close_source(source);
+			return false;
+		}
+
+		if (missing.empty())
+		{
+			break;
+		}
+
+		// blocks that keep failing their checksum, as in resend()
+		if (attempt == _options.retries)
+		{
+			_broken = true;
+			result = false;
+			break;
+		}
+
+		// a block repeated in the file goes once per round
+		unordered_set<uint64_t> sent;
+		for (auto& index : missing)
+		{
+			auto& entry = entries[(size_t)index];
+			if (!sent.insert(entry.hash[0]).second)
+			{
+				continue;
+			}
+
+			header.offset = offsets[(size_t)index];
+			header.original_size = entry.size;
+			header.checksum = 0;
+			header.flags = chunk_header::stored;
+			if (!buffered(channel, source, header.offset, entry.size, header))
+			{
+				_broken = true;
+				result = false;
+				break;
+			}
+
+			if (progress != nullptr)
+			{
+				progress(entry.size);
+			}
+		}
+	}
+
+	close_source(source);
+
+	if (result && _options.verify)
+	{
+		for (auto& entry : entries)
+		{
+			_digest = crc32c_combine(_digest, entry.checksum, entry.size);
+		}
+	}
+
+	return result;
+}
+
+bool file_sender::offer(chunk_channel& channel,
+						const chunk_header& header,
+						const vector<blob_entry>& entries,
+						vector<uint64_t>& missing,
+						bool& declined)
+{
+	chunk_header request;
+	request.indication_id = header.indication_id;
+	request.file_path = header.file_path;
+	request.file_size = header.file_size;
+	request.flags = chunk_header::stored | chunk_header::resume;
+	if (_options.verify)
+	{
+		request.flags |= chunk_header::checked;
+	}
+
+	_buffer.clear();
+	const uint64_t count = entries.size();
+	auto append = [this](const void* data, const size_t& size)
+	{
+		_buffer.insert(_buffer.end(), (const char*)data,
+					   (const char*)data + size);
+	};
+	append(&count, sizeof(count));
+	for (auto& entry : entries)
+	{
+		append(entry.hash, sizeof(entry.hash));
+		append(&entry.size, sizeof(entry.size));
+		append(&entry.checksum, sizeof(entry.checksum));
+	}
+	request.size = (uint32_t)_buffer.size();
+
+	_frame.clear();
+	encode_header(request, _frame);
+
+	uint64_t answer = 0;
+	if (_buffer.size() > UINT32_MAX
+		|| !channel.write(_frame.data(), _frame.size())
+		|| !channel.write(_buffer.data(), _buffer.size())
+		|| !channel.read((char*)&answer, sizeof(answer)))
+	{
+		_broken = true;
+		return false;
+	}
+
+	if (answer == UINT64_MAX)
+	{
+		declined = true;
+		return true;
+	}
+
+	if (answer > count)
+	{
+		_broken = true;
+		return false;
+	}
+
+	missing.resize((size_t)answer);
+	if (answer > 0
+		&& !channel.read((char*)missing.data(),
+						 missing.size() * sizeof(uint64_t)))
+	{
+		_broken = true;
+		return false;
+	}
+
+	for (auto& index : missing)
+	{
+		if (index >= count)
+		{
+			_broken = true;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool file_sender::send_reference(chunk_channel& channel,
+								 const string& indication_id,
+								 const string& target_path,
+								 const function<void(const uint64_t&)>& progress,
+								 const vector<blob_entry>& entries)
+{
+	chunk_header header;
+	header.indication_id = indication_id;
+	header.file_path = target_path;
+	for (auto& entry : entries)
+	{
+		header.file_size += entry.size;
+	}
+
+	_digest = 0;
+
+	// blocks are read from the store into memory, so the copy is buffered
+	auto send_block = [&](const uint64_t& offset, const blob_entry& entry)
+	{
+		_buffer.resize(entry.size);
+		if (entry.size > 0 && !_store->read(entry, _buffer.data()))
+		{
+			return false;
+		}
+
+		header.offset = offset;
+		header.original_size = entry.size;
+		header.checksum = 0;
+		header.flags = 0;
+		if (!frame(channel, header))
+		{
+			_broken = true;
+			return false;
+		}
+
+		return true;
+	};
+
+	// an empty file still gets one frame, so the receiver creates it
+	if (entries.empty())
+	{
+		return send_block(0, blob_entry());
+	}
+
+	uint64_t position = 0;
+	for (auto& entry : entries)
+	{
+		if (!send_block(position, entry))
+		{
+			return false;
+		}
+
+		_digest = crc32c_combine(_digest, header.checksum, entry.size);
+		position += entry.size;
+		if (progress != nullptr)
+		{
+			progress(entry.size);
+		}
+	}
+
+	// dropped chunks are blocks of the reference, found again by offset
+	auto send_range = [&](const uint64_t& offset, const uint64_t& size)
+	{
+		uint64_t start = 0;
+		for (auto& entry : entries)
+		{
+			if (start + entry.size > offset && start < offset + size
+				&& !send_block(start, entry))
+			{
+				return false;
+			}
+
+			start += entry.size;
+		}
+
+		return true;
+	};
+
+	return !_options.verify || resend(channel, header, send_range);
+}
+
+bool file_sender::resend(chunk_channel& channel,
+						 const int& source,
+						 chunk_header& header)
+{
+	return resend(channel, header,
+				  [&](const uint64_t& offset, const uint64_t& size)
+				  {
+					  for (uint64_t done = 0; done < size;)
+					  {
+						  const uint64_t length
+							  = min<uint64_t>(_options.chunk_size, size - done);
+						  if (!chunk(channel, source, header, offset + done,
+									 length))
+						  {
+							  return false;
+						  }
+
+						  done += length;
+					  }
+
+					  return true;
+				  });
+}
+
+bool file_sender::resend(
+	chunk_channel& channel,
+	const chunk_header& header,
+	const function<bool(const uint64_t&, const uint64_t&)>& again)
+{
+	chunk_header request;
+	request.indication_id = header.indication_id;
+	request.file_path = header.file_path;
+	request.file_size = header.file_size;
+	request.flags = chunk_header::rejected;
+
+	vector<uint64_t> ranges;
+	for (unsigned short attempt = 0;; ++attempt)
+	{
+		_frame.clear();
+		encode_header(request, _frame);
+
+		uint64_t count = 0;
+		if (!channel.write(_frame.data(), _frame.size())
+			|| !channel.read((char*)&count, sizeof(count))
+			|| count > UINT32_MAX)
+		{
+			_broken = true;
+			return false;
+		}
+
+		ranges.resize((size_t)count * 2);
+		if (count > 0
+			&& !channel.read((char*)ranges.data(),
+							 ranges.size() * sizeof(uint64_t)))
+		{
+			_broken = true;
+			return false;
+		}
+
+		if (count == 0)
+		{
+			return true;
+		}
+
+		// chunks that keep failing point at the link or at a source that
+		// changes underneath. the connection goes, so the receiver fails
+		// the file and keeps what it has for a later resume.
+		if (attempt == _options.retries)
+		{
+			_broken = true;
+			return false;
+		}
+
+		for (size_t index = 0; index < ranges.size(); index += 2)
+		{
+			const uint64_t offset = ranges[index];
+			const uint64_t size = ranges[index + 1];
+			if (offset > header.file_size || size > header.file_size - offset)
+			{
+				_broken = true;
+				return false;
+			}
+
+			if (!again(offset, size))
+			{
+				_broken = true;
+				return false;
+			}
+		}
+	}
+}
+
+bool file_sender::checksum(const int& source,
+						   const uint64_t& offset,
+						   const uint64_t& size,
+						   uint32_t& crc)
+{
+	_buffer.resize(size);
+	if (!read_at(source, _buffer.data(), size, offset))
+	{
+		return false;
+	}
+
+	crc = crc32c(_buffer.data(), _buffer.size());
+
+	return true;
+}
+
+bool file_sender::skip(const vector<uint8_t>& present,
+					   const uint64_t& offset,
+					   const uint64_t& size,
+					   const uint64_t& file_size) const
+{
+	// a range that does not start on a chunk cannot use the bits
+	if (offset % _options.chunk_size != 0
+		|| (size != _options.chunk_size && offset + size != file_size))
+	{
+		return false;
+	}
+
+	const uint64_t index = offset / _options.chunk_size;
+	if ((index >> 3) >= present.size())
+	{
+		return false;
+	}
+
+	return (present[(size_t)(index >> 3)] & (1 << (index & 7))) != 0;
+}
+
+void file_sender::release(void)
+{
+#ifdef __linux__
+	if (_pipe[0] >= 0)
+	{
+		close(_pipe[0]);
+		close(_pipe[1]);
+	}
+#endif
+	_pipe[0] = -1;
+	_pipe[1] = -1;
+}
+
+bool file_sender::buffered(chunk_channel& channel,
+						   const int& source,
+						   const uint64_t& offset,
+						   const uint64_t& size,
+						   chunk_header& header)
+{
+	_buffer.resize(size);
+	if (!read_at(source, _buffer.data(), size, offset))
+	{
+		return false;
+	}
+
+	return frame(channel, header);
+}
+
+bool file_sender::frame(chunk_channel& channel, chunk_header& header)
+{
+	return encode(_buffer, header) && write(channel, header, _buffer);
+}
+
+bool file_sender::encode(vector<char>& payload, chunk_header& header) const
+{
+	if (_options.verify)
+	{
+		header.checksum = crc32c(payload.data(), payload.size());
+		header.flags |= chunk_header::checked;
+	}
+
+	for (auto& transform : _transforms)
+	{
+		if (!transform(payload, header))
+		{
+			return false;
+		}
+	}
+
+	header.size = (uint32_t)payload.size();
+
+	return true;
+}
+
+bool file_sender::write(chunk_channel& channel,
+						const chunk_header& header,
+						const vector<char>& payload)
+{
+	_frame.clear();
+	encode_header(header, _frame);
+
+	const auto started = chrono::steady_clock::now();
+	if (!channel.write(_frame.data(), _frame.size())
+		|| !channel.write(payload.data(), payload.size()))
+	{
+		return false;
+	}
+
+	if (_observer != nullptr)
+	{
+		_observer(_frame.size() + payload.size(),
+				  (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+					  chrono::steady_clock::now() - started)
+					  .count());
+	}
+
+	return true;
+}
+
+bool file_sender::pipelined(chunk_channel& channel,
+							const int& source,
+							const chunk_header& header,
+							uint64_t position,
+							const uint64_t& end,
+							const vector<uint8_t>& present,
+							const function<void(const uint64_t&)>& progress)
+{
+	const size_t depth
+		= _options.pipeline_depth > 0
+			  ? _options.pipeline_depth
+			  : max<size_t>((size_t)_pipeline->worker_count() * 2, 1);
+
+	// chunks finish on the workers in any order; the window keeps the
+	// order they were read in, and only its front is written
+	deque<shared_ptr<pipeline_chunk>> window;
+	bool result = true;
+	bool first = true;
+	while (!window.empty() || (result && (first || position < end)))
+	{
+		while (result && window.size() < depth && (first || position < end))
+		{
+			// an empty file still gets one frame, so the receiver creates it
+			first = false;
+
+			const uint64_t length
+				= min<uint64_t>(_options.chunk_size, end - position);
+			auto chunk = make_shared<pipeline_chunk>();
+			chunk->header = header;
+			chunk->header.offset = position;
+			chunk->header.original_size = (uint32_t)length;
+			chunk->header.checksum = 0;
+			chunk->header.flags = 0;
+			chunk->skipped = skip(present, position, length, header.file_size);
+			if (!chunk->skipped || _options.verify)
+			{
+				chunk->payload.resize(length);
+				if (!read_at(source, chunk->payload.data(), length, position))
+				{
+					_broken = true;
+					result = false;
+					break;
+				}
+			}
+
+			position += length;
+			window.push_back(chunk);
+			_pipeline->push([this, chunk]() { process(*chunk); });
+		}
+
+		if (window.empty())
+		{
+			break;
+		}
+
+		auto chunk = window.front();
+		{
+			unique_lock<mutex> lock(_pipeline_mutex);
+			_pipeline_condition.wait(lock, [&chunk]() { return chunk->done; });
+		}
+		window.pop_front();
+
+		// after a failure the rest of the window is only waited for, as
+		// the workers still hold it
+		if (!result)
+		{
+			continue;
+		}
+
+		if (!chunk->encoded
+			|| (!chunk->skipped
+				&& !write(channel, chunk->header, chunk->payload)))
+		{
+			_broken = true;
+			result = false;
+			continue;
+		}
+
+		const uint64_t length = chunk->header.original_size;
+		_digest = crc32c_combine(_digest, chunk->header.checksum, length);
+		if (length > 0 && progress != nullptr)
+		{
+			progress(length);
+		}
+	}
+
+	return result;
+}
+
+void file_sender::process(pipeline_chunk& chunk)
+{
+	bool encoded = true;
+	if (!chunk.skipped)
+	{
+		encoded = encode(chunk.payload, chunk.header);
+	}
+	else if (_options.verify)
+	{
+		chunk.header.checksum
+			= crc32c(chunk.payload.data(), chunk.payload.size());
+	}
+
+	// notified under the lock, as the sender may return and go away as
+	// soon as it sees its last chunk done
+	scoped_lock<mutex> guard(_pipeline_mutex);
+	chunk.encoded = encoded;
+	chunk.done = true;
+	_pipeline_condition.notify_all();
+}
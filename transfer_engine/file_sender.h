@@ -0,0 +1,276 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#pragma once
+
+#include "blob_store.h"
+#include "chunk_channel.h"
+#include "chunk_frame.h"
+#include "chunk_pipeline.h"
+#include "delta_signature.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct send_options
+{
+	uint32_t chunk_size = 1 << 20;
+	// seconds a data connection may stall on connect, a write or a read
+	// before it counts as broken, see set_socket_timeout
+	unsigned short timeout = 60;
+	// answers the challenge of a receiver that has one, see
+	// chunk_receiver::set_secret
+	string secret;
+	// lets the kernel copy file pages straight into the socket. only used
+	// while no transform is set, as transforms need the bytes in memory.
+	bool zero_copy = true;
+	// a file gets one stripe per stripe_size bytes, up to max_stripes. each
+	// stripe sends its own byte range over its own connection.
+	uint64_t stripe_size = 64ull << 20;
+	unsigned short max_stripes = 4;
+	// queries the receiver before every file, see file_sender::query. needs
+	// a channel that can read the answer back.
+	bool resume = true;
+	// asks the receiver to sign a copy it already holds of every file, and
+	// sends only the blocks that copy lacks, see chunk_header::signatures
+	bool delta = false;
+	uint32_t delta_block_size = 8 << 10;
+	// marks every chunk with a crc32c the receiver checks it against, see
+	// chunk_header::checked. a file is asked for the chunks that failed and
+	// sends them again, up to retries times. needs a readable channel too.
+	bool verify = true;
+	unsigned short retries = 3;
+	// offers every file to the blob_store of the receiver by its content
+	// defined blocks and sends only the blocks it lacks, see
+	// chunk_header::stored. a receiver without a store gets whole files.
+	bool deduplicate = false;
+	uint32_t store_block_size = 64 << 10;
+	// chunks a sender with a chunk_pipeline reads ahead of the one it
+	// writes, bounding its memory to as many chunk buffers. 0 takes twice
+	// the workers of the pipeline.
+	unsigned short pipeline_depth = 0;
+};
+
+// rewrites the payload of one chunk in place, e.g. to compress or encrypt it
+using chunk_transform = function<bool(vector<char>& payload)>;
+// a chunk_transform that decides per chunk whether to touch it, and marks
+// header.flags itself when it does
+using chunk_encoder
+	= function<bool(vector<char>& payload, chunk_header& header)>;
+
+// the encoder running transform on every chunk and marking each with flag
+chunk_encoder flagged(const uint8_t& flag, const chunk_transform& transform);
+// observer(bytes, nanoseconds) follows every frame written, so the time
+// the link took for it is known
+using write_observer
+	= function<void(const uint64_t& bytes, const uint64_t& nanoseconds)>;
+
+// streams one file at a time as chunk frames. on linux an untransformed
+// chunk goes through sendfile, or splice over a pipe where the file system
+// cannot sendfile, so its bytes never enter user space; everything else is
+// read into a buffer, transformed and written.
+class file_sender
+{
+public:
+	file_sender(const send_options& options = send_options());
+	~file_sender(void);
+
+public:
+	// transforms run in the order they were added; flag marks the chunks
+	// they touched, see chunk_header
+	void add_transform(const uint8_t& flag, const chunk_transform& transform);
+	void add_transform(const chunk_encoder& encoder);
+	// transforms of whole files then run on the workers of pipeline, on
+	// several chunks at once, so they must be safe to call concurrently.
+	// chunks still go out in order.
+	void set_pipeline(shared_ptr<chunk_pipeline> pipeline);
+	void set_observer(const write_observer& observer);
+	// a source path with no file that store keeps as a reference is sent
+	// from its blocks
+	void set_store(shared_ptr<blob_store> store);
+
+	// progress receives the file bytes of every chunk once it was written
+	bool send(chunk_channel& channel,
+			  const string& indication_id,
+			  const string& source_path,
+			  const string& target_path,
+			  const function<void(const uint64_t&)>& progress);
+	// sends the size bytes from offset on, as one stripe of a file whose
+	// other stripes travel over other channels. chunks marked in present,
+	// as answered by query(), are left out.
+	bool send(chunk_channel& channel,
+			  const string& indication_id,
+			  const string& source_path,
+			  const string& target_path,
+			  const function<void(const uint64_t&)>& progress,
+			  const uint64_t& offset,
+			  const uint64_t& size,
+			  const vector<uint8_t>& present);
+
+	// asks the receiver which chunks of the file it kept from an earlier
+	// attempt; present is left empty when it keeps no bits for the file. a
+	// receiver that holds every chunk completes the file on the spot.
+	bool query(chunk_channel& channel,
+			   const string& indication_id,
+			   const string& target_path,
+			   const uint64_t& file_size,
+			   vector<uint8_t>& present);
+
+	// a send that failed halfway leaves a partial frame in the channel, so
+	// nothing else can follow on it. a source that could not be opened
+	// leaves the channel intact.
+	bool broken(void) const;
+	// crc32c of every byte the last send covered, skipped chunks as well,
+	// or 0 without verify. stripes of a file add up with crc32c_combine.
+	uint32_t digest(void) const;
+
+private:
+	enum class copy_modes
+	{
+		sendfile,
+		splice,
+		buffered
+	};
+
+	// one chunk of a file in the pipeline, in the order it was read
+	struct pipeline_chunk
+	{
+		chunk_header header;
+		vector<char> payload;
+		// held by the receiver, so only its checksum is needed
+		bool skipped = false;
+		bool encoded = false;
+		bool done = false;
+	};
+
+	void choose_copy(chunk_channel& channel);
+	bool chunk(chunk_channel& channel,
+			   const int& source,
+			   chunk_header& header,
+			   const uint64_t& offset,
+			   const uint64_t& size);
+	bool transmit(chunk_channel& channel,
+				  const int& source,
+				  uint64_t offset,
+				  uint64_t size);
+	bool buffered(chunk_channel& channel,
+				  const int& source,
+				  const uint64_t& offset,
+				  const uint64_t& size,
+				  chunk_header& header);
+	// checks, transforms and writes the chunk held in _buffer
+	bool frame(chunk_channel& channel, chunk_header& header);
+	bool encode(vector<char>& payload, chunk_header& header) const;
+	bool write(chunk_channel& channel,
+			   const chunk_header& header,
+			   const vector<char>& payload);
+	// reads the chunks from position to end and writes them in order while
+	// the pipeline transforms the ones read ahead
+	bool pipelined(chunk_channel& channel,
+				   const int& source,
+				   const chunk_header& header,
+				   uint64_t position,
+				   const uint64_t& end,
+				   const vector<uint8_t>& present,
+				   const function<void(const uint64_t&)>& progress);
+	void process(pipeline_chunk& chunk);
+	bool sign(chunk_channel& channel,
+			  const string& indication_id,
+			  const string& target_path,
+			  const uint64_t& file_size,
+			  vector<block_signature>& signatures);
+	bool send_delta(chunk_channel& channel,
+					const string& indication_id,
+					const string& source_path,
+					const string& target_path,
+					const function<void(const uint64_t&)>& progress,
+					const vector<block_signature>& signatures);
+	bool send_stored(chunk_channel& channel,
+					 const string& indication_id,
+					 const string& source_path,
+					 const string& target_path,
+					 const function<void(const uint64_t&)>& progress,
+					 bool& declined);
+	bool offer(chunk_channel& channel,
+			   const chunk_header& header,
+			   const vector<blob_entry>& entries,
+			   vector<uint64_t>& missing,
+			   bool& declined);
+	bool send_reference(chunk_channel& channel,
+						const string& indication_id,
+						const string& target_path,
+						const function<void(const uint64_t&)>& progress,
+						const vector<blob_entry>& entries);
+	bool resend(chunk_channel& channel,
+				const int& source,
+				chunk_header& header);
+	// again(offset, size) sends a range the receiver dropped once more
+	bool resend(chunk_channel& channel,
+				const chunk_header& header,
+				const function<bool(const uint64_t&, const uint64_t&)>& again);
+	bool checksum(const int& source,
+				  const uint64_t& offset,
+				  const uint64_t& size,
+				  uint32_t& crc);
+	bool skip(const vector<uint8_t>& present,
+			  const uint64_t& offset,
+			  const uint64_t& size,
+			  const uint64_t& file_size) const;
+	void release(void);
+
+private:
+	send_options _options;
+	vector<chunk_encoder> _transforms;
+	shared_ptr<blob_store> _store;
+	shared_ptr<chunk_pipeline> _pipeline;
+	write_observer _observer;
+
+	bool _broken;
+	// the receiver has no store, so the rest of its files skip the offer
+	bool _declined;
+	uint32_t _digest;
+	copy_modes _copy;
+	int _pipe[2];
+	vector<char> _frame;
+	vector<char> _buffer;
+	vector<uint8_t> _present;
+	mutex _pipeline_mutex;
+	condition_variable _pipeline_condition;
+};
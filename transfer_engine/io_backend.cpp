@@ -0,0 +1,227 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "io_backend.h"
+
+#include "uring_backend.h"
+
+#include <cerrno>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+io_backend::io_backend(const io_options& options) : _options(options)
+{
+	if (_options.buffer_size == 0)
+	{
+		_options.buffer_size = io_options().buffer_size;
+	}
+
+	if (_options.buffer_count == 0)
+	{
+		_options.buffer_count = io_options().buffer_count;
+	}
+
+	_buffers.resize((size_t)_options.buffer_size * _options.buffer_count);
+	for (uint32_t index = _options.buffer_count; index > 0; --index)
+	{
+		_free_buffers.push_back((int)index - 1);
+	}
+}
+
+io_backend::~io_backend(void) {}
+
+unique_ptr<io_backend> io_backend::create(const io_options& options)
+{
+	if (options.uring)
+	{
+		auto result = make_unique<uring_backend>(options);
+		if (result->available())
+		{
+			return result;
+		}
+	}
+
+	return make_unique<pool_backend>(options);
+}
+
+int io_backend::acquire(void)
+{
+	unique_lock<mutex> lock(_buffer_mutex);
+	_buffer_condition.wait(lock, [this]() { return !_free_buffers.empty(); });
+
+	int result = _free_buffers.back();
+	_free_buffers.pop_back();
+
+	return result;
+}
+
+void io_backend::release(const int& buffer)
+{
+	{
+		scoped_lock<mutex> guard(_buffer_mutex);
+		_free_buffers.push_back(buffer);
+	}
+
+	_buffer_condition.notify_one();
+}
+
+char* io_backend::buffer(const int& index)
+{
+	return _buffers.data() + (size_t)index * _options.buffer_size;
+}
+
+uint32_t io_backend::buffer_size(void) const { return _options.buffer_size; }
+
+pool_backend::pool_backend(const io_options& options)
+	: io_backend(options), _stop(false)
+{
+	for (unsigned short index = 0;
+		 index < max<unsigned short>(_options.worker_count, 1); ++index)
+	{
+		_workers.emplace_back(&pool_backend::run, this);
+	}
+}
+
+pool_backend::~pool_backend(void)
+{
+	{
+		scoped_lock<mutex> guard(_mutex);
+		_stop = true;
+	}
+
+	_condition.notify_all();
+	for (auto& worker : _workers)
+	{
+		worker.join();
+	}
+}
+
+int pool_backend::attach(const int& descriptor) { return descriptor; }
+
+void pool_backend::detach(const int&) {}
+
+bool pool_backend::submit(io_request&& request)
+{
+	{
+		scoped_lock<mutex> guard(_mutex);
+		if (_stop)
+		{
+			return false;
+		}
+
+		_requests.push_back(std::move(request));
+	}
+
+	_condition.notify_one();
+
+	return true;
+}
+
+string pool_backend::name(void) const { return "thread pool"; }
+
+void pool_backend::run(void)
+{
+	while (true)
+	{
+		io_request request;
+		{
+			unique_lock<mutex> lock(_mutex);
+			_condition.wait(lock,
+							[this]() { return _stop || !_requests.empty(); });
+
+			// queued requests still complete, so no buffer is left acquired
+			if (_requests.empty())
+			{
+				return;
+			}
+
+			request = std::move(_requests.front());
+			_requests.pop_front();
+		}
+
+		int64_t done = 0;
+		while (done < (int64_t)request.size)
+		{
+#ifdef _WIN32
+			// descriptors have no positional I/O here, so the seek and the
+			// transfer must not interleave with another worker's
+			scoped_lock<mutex> seek_guard(_seek_mutex);
+			int64_t result = -ENOSYS;
+			if (_lseeki64(request.file, (__int64)(request.offset + done),
+						  SEEK_SET)
+				>= 0)
+			{
+				const unsigned int size
+					= (unsigned int)(request.size - done);
+				result = request.write
+							 ? _write(request.file, request.data + done, size)
+							 : _read(request.file, request.data + done, size);
+			}
+#else
+			int64_t result
+				= request.write
+					  ? pwrite(request.file, request.data + done,
+							   request.size - done,
+							   (off_t)(request.offset + done))
+					  : pread(request.file, request.data + done,
+							  request.size - done,
+							  (off_t)(request.offset + done));
+			if (result < 0 && errno == EINTR)
+			{
+				continue;
+			}
+#endif
+			if (result < 0)
+			{
+				done = -errno;
+				break;
+			}
+
+			// end of file
+			if (result == 0)
+			{
+				break;
+			}
+
+			done += result;
+		}
+
+		if (request.completion != nullptr)
+		{
+			request.completion(done);
+		}
+	}
+}
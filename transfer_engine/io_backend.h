@@ -0,0 +1,133 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+struct io_options
+{
+	// requests kept outstanding per device before submit() waits
+	unsigned int queue_depth = 128;
+	// pread/pwrite threads of the fallback backend
+	unsigned short worker_count = 4;
+	// chunk buffers shared by every request, registered with the kernel
+	// where the backend supports it
+	uint32_t buffer_size = 1 << 20;
+	uint32_t buffer_count = 64;
+	bool uring = true;
+};
+
+struct io_request
+{
+	// a handle returned by io_backend::attach
+	int file = -1;
+	bool write = false;
+	uint64_t offset = 0;
+	char* data = nullptr;
+	uint32_t size = 0;
+	// the index from acquire() when data lies in a shared buffer, or -1
+	int buffer = -1;
+	// receives the bytes moved, or a negative errno. io_uring may move
+	// fewer bytes than asked, so callers resubmit the rest.
+	function<void(const int64_t&)> completion;
+};
+
+// asynchronous positional reads and writes. create() returns an io_uring
+// backend where the kernel offers one and a pread/pwrite thread pool
+// everywhere else.
+class io_backend
+{
+public:
+	io_backend(const io_options& options);
+	virtual ~io_backend(void);
+
+public:
+	static unique_ptr<io_backend> create(const io_options& options);
+
+	// waits until one of the shared buffers is free
+	int acquire(void);
+	void release(const int& buffer);
+	char* buffer(const int& index);
+	uint32_t buffer_size(void) const;
+
+	// makes an open descriptor usable by submit() and returns its handle,
+	// or -1. a file is only detached once its requests have completed.
+	virtual int attach(const int& descriptor) = 0;
+	virtual void detach(const int& file) = 0;
+	virtual bool submit(io_request&& request) = 0;
+	virtual string name(void) const = 0;
+
+protected:
+	io_options _options;
+	vector<char> _buffers;
+
+private:
+	mutex _buffer_mutex;
+	condition_variable _buffer_condition;
+	vector<int> _free_buffers;
+};
+
+// blocking pread/pwrite on a fixed set of worker threads
+class pool_backend : public io_backend
+{
+public:
+	pool_backend(const io_options& options);
+	~pool_backend(void) override;
+
+public:
+	int attach(const int& descriptor) override;
+	void detach(const int& file) override;
+	bool submit(io_request&& request) override;
+	string name(void) const override;
+
+private:
+	void run(void);
+
+private:
+	mutex _mutex;
+	condition_variable _condition;
+	bool _stop;
+	deque<io_request> _requests;
+	vector<thread> _workers;
+	mutex _seek_mutex;
+};
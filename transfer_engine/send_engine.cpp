@@ -0,0 +1,337 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "send_engine.h"
+#include "checksum.h"
+
+#include <algorithm>
+#include <filesystem>
+
+send_engine::send_engine(
+	const unsigned short& worker_count,
+	const send_options& options,
+	const function<void(const string&, const string&, const uint64_t&)>&
+		progress,
+	const function<void(const string&, const string&, const bool&,
+						const uint32_t&)>& completion)
+	: _options(options)
+	, _progress(progress)
+	, _completion(completion)
+	, _stop(false)
+{
+	for (unsigned short index = 0; index < max<unsigned short>(worker_count, 1);
+		 ++index)
+	{
+		_workers.emplace_back(&send_engine::run, this);
+	}
+}
+
+send_engine::~send_engine(void)
+{
+	{
+		scoped_lock<mutex> guard(_mutex);
+		_stop = true;
+	}
+
+	_condition.notify_all();
+	for (auto& worker : _workers)
+	{
+		worker.join();
+	}
+
+	// jobs that never started fail file by file, so their transfers
+	// complete rather than wait for an expiry
+	for (auto& job : _jobs)
+	{
+		fail(job);
+	}
+}
+
+void send_engine::add_transform(const uint8_t& flag,
+								const chunk_transform& transform)
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	_transforms.push_back(flagged(flag, transform));
+}
+
+void send_engine::add_transform(const chunk_encoder& encoder)
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	_transforms.push_back(encoder);
+}
+
+void send_engine::set_store(shared_ptr<blob_store> store)
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	_store = store;
+}
+
+void send_engine::set_pipeline(shared_ptr<chunk_pipeline> pipeline)
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	_pipeline = pipeline;
+}
+
+void send_engine::set_observer(const write_observer& observer)
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	_observer = observer;
+}
+
+void send_engine::push(send_job&& job)
+{
+	{
+		scoped_lock<mutex> guard(_mutex);
+		_jobs.push_back(std::move(job));
+	}
+
+	_condition.notify_one();
+}
+
+void send_engine::run(void)
+{
+	while (true)
+	{
+		send_job job;
+		{
+			unique_lock<mutex> lock(_mutex);
+			_condition.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+
+			// jobs still queued on shutdown are failed by the destructor
+			if (_stop)
+			{
+				return;
+			}
+
+			job = std::move(_jobs.front());
+			_jobs.pop_front();
+		}
+
+		execute(job);
+	}
+}
+
+void send_engine::fail(const send_job& job)
+{
+	for (auto& file : job.files)
+	{
+		_completion(job.indication_id, file.target_path, false, 0);
+	}
+}
+
+void send_engine::execute(const send_job& job)
+{
+	auto sender = make_unique<file_sender>(_options);
+	prepare(*sender);
+
+	socket_channel channel(_options.timeout, _options.secret);
+	bool connected = channel.connect(job.host, job.port);
+	bool reconnected = false;
+	vector<unique_ptr<stripe>> stripes;
+
+	for (auto& file : job.files)
+	{
+		// a job connects once more after its connection broke; after that
+		// the rest of its files fail without further attempts
+		if ((!connected || sender->broken()) && !reconnected)
+		{
+			reconnected = true;
+			sender = make_unique<file_sender>(_options);
+			prepare(*sender);
+			connected = channel.connect(job.host, job.port);
+		}
+
+		if (!connected || sender->broken())
+		{
+			_completion(job.indication_id, file.target_path, false, 0);
+			continue;
+		}
+
+		error_code error;
+		const uint64_t file_size
+			= filesystem::file_size(file.source_path, error);
+		// a delta or an offer to a store goes over one connection, as it
+		// follows content defined blocks rather than byte ranges
+		uint32_t digest = 0;
+		bool sent = false;
+		if (!error && !_options.delta && !_options.deduplicate
+			&& stripe_count(file_size) > 1)
+		{
+			sent = send_striped(job, file, file_size, *sender, channel,
+								stripes, digest);
+		}
+		else
+		{
+			sent = sender->send(channel, job.indication_id, file.source_path,
+								file.target_path,
+								[&](const uint64_t& bytes)
+								{
+									_progress(job.indication_id,
+											  file.target_path, bytes);
+								});
+			digest = sender->digest();
+		}
+
+		_completion(job.indication_id, file.target_path, sent, digest);
+	}
+}
+
+void send_engine::prepare(file_sender& sender)
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	for (auto& transform : _transforms)
+	{
+		sender.add_transform(transform);
+	}
+	sender.set_store(_store);
+	sender.set_pipeline(_pipeline);
+	sender.set_observer(_observer);
+}
+
+unsigned short send_engine::stripe_count(const uint64_t& file_size) const
+{
+	if (_options.stripe_size == 0)
+	{
+		return 1;
+	}
+
+	// a stripe never holds less than one chunk
+	const uint64_t chunk_size = max<uint32_t>(_options.chunk_size, 1);
+	const uint64_t limit = min<uint64_t>(
+		_options.max_stripes, (file_size + chunk_size - 1) / chunk_size);
+
+	return (unsigned short)max<uint64_t>(
+		min(file_size / _options.stripe_size, limit), 1);
+}
+
+bool send_engine::send_striped(const send_job& job,
+							   const send_file& file,
+							   const uint64_t& file_size,
+							   file_sender& sender,
+							   socket_channel& channel,
+							   vector<unique_ptr<stripe>>& stripes,
+							   uint32_t& digest)
+{
+	const unsigned short count = stripe_count(file_size);
+
+	// stripes start on chunk boundaries, so the receiver sees the same chunk
+	// offsets as from a single connection
+	const uint64_t chunk_size = max<uint32_t>(_options.chunk_size, 1);
+	const uint64_t chunks = (file_size + chunk_size - 1) / chunk_size;
+	auto range = [&](const unsigned short& index)
+	{
+		const uint64_t first = chunks * index / count;
+		const uint64_t last = chunks * (index + 1) / count;
+
+		return pair<uint64_t, uint64_t>(first * chunk_size,
+										(last - first) * chunk_size);
+	};
+
+	// one query covers every stripe, so the receiver settles a file it
+	// already holds only once
+	vector<uint8_t> present;
+	if (_options.resume
+		&& !sender.query(channel, job.indication_id, file.target_path,
+						 file_size, present))
+	{
+		return false;
+	}
+
+	auto progress = [&](const uint64_t& bytes)
+	{ _progress(job.indication_id, file.target_path, bytes); };
+
+	while (stripes.size() < (size_t)count - 1)
+	{
+		stripes.push_back(make_unique<stripe>(_options));
+		prepare(stripes.back()->sender);
+	}
+
+	vector<char> results(count, 0);
+	vector<uint32_t> digests(count, 0);
+	vector<thread> threads;
+	for (unsigned short index = 1; index < count; ++index)
+	{
+		threads.emplace_back(
+			[&, index]()
+			{
+				// a stripe broken on an earlier file reconnects afresh
+				if (stripes[index - 1]->sender.broken())
+				{
+					stripes[index - 1] = make_unique<stripe>(_options);
+					prepare(stripes[index - 1]->sender);
+				}
+
+				auto& target = *stripes[index - 1];
+				if (!target.connected)
+				{
+					target.connected
+						= target.channel.connect(job.host, job.port);
+				}
+
+				const auto [offset, length] = range(index);
+				results[index]
+					= target.connected
+					  && target.sender.send(
+						  target.channel, job.indication_id, file.source_path,
+						  file.target_path, progress, offset, length, present);
+				digests[index] = target.sender.digest();
+			});
+	}
+
+	results[0]
+		= sender.send(channel, job.indication_id, file.source_path,
+					  file.target_path, progress, 0, range(0).second, present);
+	digests[0] = sender.digest();
+
+	for (auto& worker : threads)
+	{
+		worker.join();
+	}
+
+	// the last stripe ends with the file rather than its full range
+	digest = digests[0];
+	for (unsigned short index = 1; index < count; ++index)
+	{
+		const auto [offset, length] = range(index);
+		digest = crc32c_combine(digest, digests[index],
+								min(length, file_size - offset));
+	}
+
+	return all_of(results.begin(), results.end(),
+				  [](const char& result) { return result != 0; });
+}
@@ -0,0 +1,137 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#pragma once
+
+#include "file_sender.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+struct send_file
+{
+	string source_path;
+	string target_path;
+};
+
+// files of one transfer, streamed over one connection to the data endpoint
+// of the receiver. a large file is striped over further connections that
+// last as long as the job.
+struct send_job
+{
+	string indication_id;
+	string host;
+	unsigned short port = 0;
+	vector<send_file> files;
+};
+
+// runs send jobs on a fixed set of workers, so a transfer never blocks the
+// thread that accepted its request. jobs still queued when the engine goes
+// are reported failed.
+class send_engine
+{
+public:
+	// progress(indication_id, target_path, bytes) follows every chunk and
+	// completion(indication_id, target_path, sent, digest) every file, see
+	// file_sender::digest
+	send_engine(
+		const unsigned short& worker_count,
+		const send_options& options,
+		const function<void(const string&, const string&, const uint64_t&)>&
+			progress,
+		const function<void(const string&, const string&, const bool&,
+							const uint32_t&)>& completion);
+	~send_engine(void);
+
+public:
+	// applies to the jobs started afterwards
+	void add_transform(const uint8_t& flag, const chunk_transform& transform);
+	void add_transform(const chunk_encoder& encoder);
+	// serves the references kept in store, see file_sender::set_store
+	void set_store(shared_ptr<blob_store> store);
+	// see file_sender::set_pipeline and file_sender::set_observer
+	void set_pipeline(shared_ptr<chunk_pipeline> pipeline);
+	void set_observer(const write_observer& observer);
+	void push(send_job&& job);
+
+private:
+	struct stripe
+	{
+		file_sender sender;
+		socket_channel channel;
+		bool connected = false;
+
+		stripe(const send_options& options)
+			: sender(options), channel(options.timeout, options.secret)
+		{
+		}
+	};
+
+private:
+	void run(void);
+	void execute(const send_job& job);
+	void fail(const send_job& job);
+	void prepare(file_sender& sender);
+	unsigned short stripe_count(const uint64_t& file_size) const;
+	bool send_striped(const send_job& job,
+					  const send_file& file,
+					  const uint64_t& file_size,
+					  file_sender& sender,
+					  socket_channel& channel,
+					  vector<unique_ptr<stripe>>& stripes,
+					  uint32_t& digest);
+
+private:
+	send_options _options;
+	function<void(const string&, const string&, const uint64_t&)> _progress;
+	function<void(const string&, const string&, const bool&, const uint32_t&)>
+		_completion;
+
+	mutex _mutex;
+	condition_variable _condition;
+	bool _stop;
+	deque<send_job> _jobs;
+	vector<chunk_encoder> _transforms;
+	shared_ptr<blob_store> _store;
+	shared_ptr<chunk_pipeline> _pipeline;
+	write_observer _observer;
+	vector<thread> _workers;
+};
@@ -0,0 +1,534 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include "uring_backend.h"
+
+#ifdef __linux__
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <thread>
+
+namespace
+{
+	// fixed file slots of every ring
+	constexpr unsigned int file_capacity = 1024;
+	// rings beyond this are shared by devices
+	constexpr size_t ring_limit = 8;
+	// user_data of the request that stops a reaper
+	constexpr uint64_t wake_up = UINT64_MAX;
+
+	int setup(const unsigned int& entries, io_uring_params* params)
+	{
+		return (int)syscall(__NR_io_uring_setup, entries, params);
+	}
+
+	int enter(const int& descriptor,
+			  const unsigned int& submit,
+			  const unsigned int& complete,
+			  const unsigned int& flags)
+	{
+		return (int)syscall(__NR_io_uring_enter, descriptor, submit, complete,
+							flags, nullptr, 0);
+	}
+
+	int enroll(const int& descriptor,
+			   const unsigned int& opcode,
+			   const void* argument,
+			   const unsigned int& count)
+	{
+		return (int)syscall(__NR_io_uring_register, descriptor, opcode,
+							argument, count);
+	}
+
+	// the ring indices are shared with the kernel
+	unsigned int load(unsigned int* index)
+	{
+		return atomic_ref<unsigned int>(*index).load(memory_order_acquire);
+	}
+
+	void store(unsigned int* index, const unsigned int& value)
+	{
+		atomic_ref<unsigned int>(*index).store(value, memory_order_release);
+	}
+}
+
+struct uring_backend::ring
+{
+	~ring(void)
+	{
+		if (sqes != MAP_FAILED)
+		{
+			munmap(sqes, sqes_size);
+		}
+		if (cq_map != MAP_FAILED && cq_map != sq_map)
+		{
+			munmap(cq_map, cq_size);
+		}
+		if (sq_map != MAP_FAILED)
+		{
+			munmap(sq_map, sq_size);
+		}
+		if (descriptor >= 0)
+		{
+			close(descriptor);
+		}
+	}
+
+	// pushes one entry and hands every unsubmitted one to the kernel
+	void push(const io_uring_sqe& entry)
+	{
+		const unsigned int tail = *sq_tail;
+		const unsigned int position = tail & *sq_mask;
+
+		sqes[position] = entry;
+		sq_array[position] = position;
+		store(sq_tail, tail + 1);
+
+		while (enter(descriptor, tail + 1 - load(sq_head), 0, 0) < 0
+			   && errno == EINTR)
+		{
+		}
+	}
+
+	int descriptor = -1;
+	uint64_t device = 0;
+	unsigned int entries = 0;
+
+	void* sq_map = MAP_FAILED;
+	size_t sq_size = 0;
+	void* cq_map = MAP_FAILED;
+	size_t cq_size = 0;
+	io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;
+	size_t sqes_size = 0;
+
+	unsigned int* sq_head = nullptr;
+	unsigned int* sq_tail = nullptr;
+	unsigned int* sq_mask = nullptr;
+	unsigned int* sq_array = nullptr;
+	unsigned int* cq_head = nullptr;
+	unsigned int* cq_tail = nullptr;
+	unsigned int* cq_mask = nullptr;
+	io_uring_cqe* cqes = nullptr;
+
+	bool fixed_buffers = false;
+	bool fixed_files = false;
+	vector<int> free_slots;
+
+	// guards the submission queue and the requests in flight
+	mutex submit_mutex;
+	condition_variable space;
+	vector<io_request> requests;
+	vector<unsigned int> free_requests;
+	thread reaper;
+};
+
+uring_backend::uring_backend(const io_options& options)
+	: io_backend(options), _available(false)
+{
+	// plain reads and writes came with 5.6, as did the opcode probe
+	io_uring_params params{};
+	int descriptor = setup(4, &params);
+	if (descriptor < 0)
+	{
+		return;
+	}
+
+	vector<char> probe(sizeof(io_uring_probe)
+					   + 256 * sizeof(io_uring_probe_op));
+	auto operations = (io_uring_probe*)probe.data();
+	if (enroll(descriptor, IORING_REGISTER_PROBE, operations, 256) == 0)
+	{
+		_available
+			= operations->last_op >= IORING_OP_WRITE
+			  && (operations->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)
+			  && (operations->ops[IORING_OP_WRITE].flags
+				  & IO_URING_OP_SUPPORTED);
+	}
+
+	close(descriptor);
+}
+
+uring_backend::~uring_backend(void)
+{
+	for (auto& target : _rings)
+	{
+		{
+			unique_lock<mutex> lock(target->submit_mutex);
+			target->space.wait(lock,
+							   [&]()
+							   {
+								   return target->free_requests.size()
+										  == target->entries;
+							   });
+
+			io_uring_sqe entry{};
+			entry.opcode = IORING_OP_NOP;
+			entry.user_data = wake_up;
+			target->push(entry);
+		}
+
+		target->reaper.join();
+	}
+}
+
+bool uring_backend::available(void) const { return _available; }
+
+int uring_backend::attach(const int& descriptor)
+{
+	struct stat status;
+	if (!_available || fstat(descriptor, &status) != 0)
+	{
+		return -1;
+	}
+
+	scoped_lock<mutex> guard(_mutex);
+
+	handle item;
+	item.target = open((uint64_t)status.st_dev);
+	item.descriptor = descriptor;
+	if (item.target == nullptr)
+	{
+		return -1;
+	}
+
+	if (item.target->fixed_files)
+	{
+		scoped_lock<mutex> submit_guard(item.target->submit_mutex);
+
+		if (!item.target->free_slots.empty())
+		{
+			io_uring_files_update update{};
+			update.offset = (uint32_t)item.target->free_slots.back();
+			update.fds = (uint64_t)(uintptr_t)&descriptor;
+			if (enroll(item.target->descriptor, IORING_REGISTER_FILES_UPDATE,
+					   &update, 1)
+				== 1)
+			{
+				item.slot = item.target->free_slots.back();
+				item.target->free_slots.pop_back();
+			}
+		}
+	}
+
+	if (_free_handles.empty())
+	{
+		_handles.push_back(item);
+		return (int)_handles.size() - 1;
+	}
+
+	int result = _free_handles.back();
+	_free_handles.pop_back();
+	_handles[result] = item;
+
+	return result;
+}
+
+void uring_backend::detach(const int& file)
+{
+	scoped_lock<mutex> guard(_mutex);
+
+	if (file < 0 || file >= (int)_handles.size()
+		|| _handles[file].target == nullptr)
+	{
+		return;
+	}
+
+	handle& item = _handles[file];
+	if (item.slot >= 0)
+	{
+		scoped_lock<mutex> submit_guard(item.target->submit_mutex);
+
+		const int removed = -1;
+		io_uring_files_update update{};
+		update.offset = (uint32_t)item.slot;
+		update.fds = (uint64_t)(uintptr_t)&removed;
+		enroll(item.target->descriptor, IORING_REGISTER_FILES_UPDATE,
+			   &update, 1);
+		item.target->free_slots.push_back(item.slot);
+	}
+
+	item = handle();
+	_free_handles.push_back(file);
+}
+
+bool uring_backend::submit(io_request&& request)
+{
+	handle item;
+	{
+		scoped_lock<mutex> guard(_mutex);
+
+		if (request.file < 0 || request.file >= (int)_handles.size())
+		{
+			return false;
+		}
+
+		item = _handles[request.file];
+	}
+
+	if (item.target == nullptr)
+	{
+		return false;
+	}
+
+	ring& target = *item.target;
+	const bool fixed_buffer = target.fixed_buffers && request.buffer >= 0;
+
+	io_uring_sqe entry{};
+	if (request.write)
+	{
+		entry.opcode = fixed_buffer ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	}
+	else
+	{
+		entry.opcode = fixed_buffer ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	}
+	if (item.slot >= 0)
+	{
+		entry.fd = item.slot;
+		entry.flags = IOSQE_FIXED_FILE;
+	}
+	else
+	{
+		entry.fd = item.descriptor;
+	}
+	entry.off = request.offset;
+	entry.addr = (uint64_t)(uintptr_t)request.data;
+	entry.len = request.size;
+	if (fixed_buffer)
+	{
+		entry.buf_index = (uint16_t)request.buffer;
+	}
+
+	// waits for a free entry instead of overflowing the completion queue
+	unique_lock<mutex> lock(target.submit_mutex);
+	target.space.wait(lock, [&]() { return !target.free_requests.empty(); });
+
+	const unsigned int index = target.free_requests.back();
+	target.free_requests.pop_back();
+	target.requests[index] = std::move(request);
+
+	entry.user_data = index;
+	target.push(entry);
+
+	return true;
+}
+
+string uring_backend::name(void) const { return "io_uring"; }
+
+uring_backend::ring* uring_backend::open(const uint64_t& device)
+{
+	for (auto& target : _rings)
+	{
+		if (target->device == device)
+		{
+			return target.get();
+		}
+	}
+
+	if (_rings.size() >= ring_limit)
+	{
+		return _rings[device % _rings.size()].get();
+	}
+
+	auto target = make_unique<ring>();
+	target->device = device;
+
+	io_uring_params params{};
+	target->descriptor = setup(max(_options.queue_depth, 1u), &params);
+	if (target->descriptor < 0)
+	{
+		return _rings.empty() ? nullptr : _rings.front().get();
+	}
+
+	target->entries = params.sq_entries;
+	target->sq_size
+		= params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	target->cq_size
+		= params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single)
+	{
+		target->sq_size = max(target->sq_size, target->cq_size);
+	}
+
+	target->sq_map = mmap(nullptr, target->sq_size, PROT_READ | PROT_WRITE,
+						  MAP_SHARED | MAP_POPULATE, target->descriptor,
+						  IORING_OFF_SQ_RING);
+	target->cq_map = single ? target->sq_map
+							: mmap(nullptr, target->cq_size,
+								   PROT_READ | PROT_WRITE,
+								   MAP_SHARED | MAP_POPULATE,
+								   target->descriptor, IORING_OFF_CQ_RING);
+	target->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	target->sqes = (io_uring_sqe*)mmap(
+		nullptr, target->sqes_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, target->descriptor, IORING_OFF_SQES);
+	if (target->sq_map == MAP_FAILED || target->cq_map == MAP_FAILED
+		|| target->sqes == MAP_FAILED)
+	{
+		return _rings.empty() ? nullptr : _rings.front().get();
+	}
+
+	char* sq = (char*)target->sq_map;
+	target->sq_head = (unsigned int*)(sq + params.sq_off.head);
+	target->sq_tail = (unsigned int*)(sq + params.sq_off.tail);
+	target->sq_mask = (unsigned int*)(sq + params.sq_off.ring_mask);
+	target->sq_array = (unsigned int*)(sq + params.sq_off.array);
+
+	char* cq = (char*)target->cq_map;
+	target->cq_head = (unsigned int*)(cq + params.cq_off.head);
+	target->cq_tail = (unsigned int*)(cq + params.cq_off.tail);
+	target->cq_mask = (unsigned int*)(cq + params.cq_off.ring_mask);
+	target->cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	// both registrations are optional; without them requests carry plain
+	// addresses and descriptors
+	vector<iovec> buffers(_options.buffer_count);
+	for (uint32_t index = 0; index < _options.buffer_count; ++index)
+	{
+		buffers[index].iov_base = buffer((int)index);
+		buffers[index].iov_len = _options.buffer_size;
+	}
+	target->fixed_buffers
+		= enroll(target->descriptor, IORING_REGISTER_BUFFERS, buffers.data(),
+				 (unsigned int)buffers.size())
+		  == 0;
+
+	vector<int> files(file_capacity, -1);
+	target->fixed_files = enroll(target->descriptor, IORING_REGISTER_FILES,
+								 files.data(), file_capacity)
+						  == 0;
+	if (target->fixed_files)
+	{
+		for (int slot = (int)file_capacity - 1; slot >= 0; --slot)
+		{
+			target->free_slots.push_back(slot);
+		}
+	}
+
+	target->requests.resize(target->entries);
+	for (unsigned int index = target->entries; index > 0; --index)
+	{
+		target->free_requests.push_back(index - 1);
+	}
+
+	target->reaper = thread(&uring_backend::reap, this, ref(*target));
+	_rings.push_back(std::move(target));
+
+	return _rings.back().get();
+}
+
+void uring_backend::reap(ring& target)
+{
+	vector<pair<function<void(const int64_t&)>, int64_t>> completed;
+
+	bool stop = false;
+	while (!stop)
+	{
+		if (enter(target.descriptor, 0, 1, IORING_ENTER_GETEVENTS) < 0
+			&& errno != EINTR && errno != EAGAIN && errno != EBUSY)
+		{
+			return;
+		}
+
+		{
+			scoped_lock<mutex> guard(target.submit_mutex);
+
+			unsigned int head = *target.cq_head;
+			const unsigned int tail = load(target.cq_tail);
+			for (; head != tail; ++head)
+			{
+				const io_uring_cqe& entry
+					= target.cqes[head & *target.cq_mask];
+				if (entry.user_data == wake_up)
+				{
+					stop = true;
+					continue;
+				}
+
+				auto& request = target.requests[entry.user_data];
+				completed.push_back(
+					{ std::move(request.completion), (int64_t)entry.res });
+				request = io_request();
+				target.free_requests.push_back((unsigned int)entry.user_data);
+			}
+			store(target.cq_head, head);
+		}
+
+		target.space.notify_all();
+
+		// completions may submit again, so they run without the lock
+		for (auto& [completion, result] : completed)
+		{
+			if (completion != nullptr)
+			{
+				completion(result);
+			}
+		}
+		completed.clear();
+	}
+}
+
+#else
+
+struct uring_backend::ring
+{
+};
+
+uring_backend::uring_backend(const io_options& options)
+	: io_backend(options), _available(false)
+{
+}
+
+uring_backend::~uring_backend(void) {}
+
+bool uring_backend::available(void) const { return false; }
+
+int uring_backend::attach(const int&) { return -1; }
+
+void uring_backend::detach(const int&) {}
+
+bool uring_backend::submit(io_request&&) { return false; }
+
+string uring_backend::name(void) const { return "io_uring"; }
+
+#endif
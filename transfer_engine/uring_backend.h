@@ -32,46 +32,54 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 
-#include "container/container.h"
-#include "core/value.h"
-#include "values/string_value.h"
+#include "io_backend.h"
 
-#include <map>
+#include <cstdint>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
 
 using namespace std;
-using namespace container_module;
 
-class file_manager
+// io_uring through the kernel interface itself, so no liburing is needed.
+// every device gets its own ring with the shared buffers registered and a
+// sparse table of fixed files, so requests skip the per-call buffer
+// mapping and file lookup. one thread per ring reaps completions.
+class uring_backend : public io_backend
 {
 public:
-	file_manager(void);
-	~file_manager(void);
+	uring_backend(const io_options& options);
+	~uring_backend(void) override;
 
 public:
-	bool set(const wstring& indication_id,
-			 const wstring& source_id,
-			 const wstring& source_sub_id,
-			 const vector<wstring>& file_list);
+	// false where the kernel has no io_uring or forbids it
+	bool available(void) const;
 
-	shared_ptr<value_container> received(
-		const wstring& indication_id, const wstring& file_path);
+	int attach(const int& descriptor) override;
+	void detach(const int& file) override;
+	bool submit(io_request&& request) override;
+	string name(void) const override;
 
 private:
-	void clear(const map<wstring, unsigned short>::iterator& percentage_iter,
-			   const map<wstring, pair<wstring, wstring>>::iterator& ids_iter,
-			   const map<wstring, vector<wstring>>::iterator& transferring_iter,
-			   const map<wstring, vector<wstring>>::iterator& transferred_iter,
-			   const map<wstring, vector<wstring>>::iterator& failed_iter);
+	struct ring;
+
+	ring* open(const uint64_t& device);
+	void reap(ring& target);
 
 private:
+	struct handle
+	{
+		ring* target = nullptr;
+		int descriptor = -1;
+		// position in the fixed file table, or -1 when the ring has none
+		int slot = -1;
+	};
+
+	bool _available;
+
 	mutex _mutex;
-	map<wstring, unsigned short> _transferred_percentage;
-	map<wstring, pair<wstring, wstring>> _transferring_ids;
-	map<wstring, vector<wstring>> _transferring_list;
-	map<wstring, vector<wstring>> _transferred_list;
-	map<wstring, vector<wstring>> _failed_list;
+	vector<unique_ptr<ring>> _rings;
+	vector<handle> _handles;
+	vector<int> _free_handles;
 };
@@ -0,0 +1,85 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include "checksum.h"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+TEST(checksum, crc32c_matches_known_value)
+{
+	// the check value of crc32c
+	const string data = "123456789";
+	EXPECT_EQ(crc32c(data.data(), data.size()), 0xE3069283u);
+	EXPECT_EQ(crc32c(nullptr, 0), 0u);
+}
+
+TEST(checksum, crc32c_continues_from_a_piece)
+{
+	vector<char> data(10000);
+	for (size_t index = 0; index < data.size(); ++index)
+	{
+		data[index] = (char)(index * 131 + 7);
+	}
+
+	const uint32_t whole = crc32c(data.data(), data.size());
+	for (size_t split : { (size_t)0, (size_t)1, (size_t)7, (size_t)4096,
+						  data.size() })
+	{
+		EXPECT_EQ(crc32c(data.data() + split, data.size() - split,
+						 crc32c(data.data(), split)),
+				  whole);
+	}
+}
+
+TEST(checksum, crc32c_combine_matches_whole)
+{
+	vector<char> data(70000);
+	for (size_t index = 0; index < data.size(); ++index)
+	{
+		data[index] = (char)(index * 31 + index / 256);
+	}
+
+	const uint32_t whole = crc32c(data.data(), data.size());
+	for (size_t split : { (size_t)0, (size_t)1, (size_t)3, (size_t)65536,
+						  data.size() - 1, data.size() })
+	{
+		const uint32_t first = crc32c(data.data(), split);
+		const uint32_t second
+			= crc32c(data.data() + split, data.size() - split);
+		EXPECT_EQ(crc32c_combine(first, second, data.size() - split), whole);
+	}
+}
@@ -0,0 +1,112 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include "chunk_bitmap.h"
+
+#include <filesystem>
+#include <string>
+
+using namespace std;
+
+namespace
+{
+	class chunk_bitmap_test : public ::testing::Test
+	{
+	protected:
+		void SetUp(void) override
+		{
+			_directory
+				= filesystem::temp_directory_path() / "chunk_bitmap_test";
+			filesystem::remove_all(_directory);
+			filesystem::create_directories(_directory);
+			_target = (_directory / "file").string();
+		}
+
+		void TearDown(void) override { filesystem::remove_all(_directory); }
+
+		filesystem::path _directory;
+		string _target;
+	};
+}
+
+TEST_F(chunk_bitmap_test, resumes_kept_chunks)
+{
+	// five chunks, the last one short
+	{
+		chunk_bitmap chunks;
+		ASSERT_TRUE(chunks.open(_target, 4500, 1000, true));
+		EXPECT_TRUE(chunks.set(1));
+		EXPECT_FALSE(chunks.set(1));
+		EXPECT_TRUE(chunks.set(4));
+		EXPECT_FALSE(chunks.set(5));
+		EXPECT_EQ(chunks.received_bytes(), 1500);
+	}
+
+	chunk_bitmap chunks;
+	ASSERT_TRUE(chunks.open(_target, 4500, 1000, true));
+	EXPECT_EQ(chunks.received_bytes(), 1500);
+	EXPECT_FALSE(chunks.set(4));
+	EXPECT_EQ(chunks.bits()[0], 0x12);
+
+	for (uint64_t index : { 0, 2, 3 })
+	{
+		EXPECT_TRUE(chunks.set(index));
+	}
+	EXPECT_TRUE(chunks.complete());
+	EXPECT_EQ(chunks.received_bytes(), 4500);
+
+	chunks.remove();
+	EXPECT_FALSE(filesystem::exists(chunk_bitmap::path(_target)));
+}
+
+TEST_F(chunk_bitmap_test, starts_over_for_another_file)
+{
+	{
+		chunk_bitmap chunks;
+		ASSERT_TRUE(chunks.open(_target, 4500, 1000, true));
+		chunks.set(0);
+	}
+
+	// a changed size or chunk size no longer matches the kept bits
+	{
+		chunk_bitmap chunks;
+		ASSERT_TRUE(chunks.open(_target, 4500, 500, true));
+		EXPECT_EQ(chunks.received_bytes(), 0);
+		chunks.set(0);
+	}
+
+	chunk_bitmap chunks;
+	ASSERT_TRUE(chunks.open(_target, 4500, 500, false));
+	EXPECT_EQ(chunks.received_bytes(), 0);
+}
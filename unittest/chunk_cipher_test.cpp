@@ -0,0 +1,127 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include "chunk_cipher.h"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	chunk_header header_of(const string& file_path, const uint64_t& offset)
+	{
+		chunk_header header;
+		header.indication_id = "transfer";
+		header.file_path = file_path;
+		header.offset = offset;
+
+		return header;
+	}
+
+	vector<char> sealed(chunk_cipher& cipher, chunk_header& header)
+	{
+		vector<char> payload(1000);
+		for (size_t index = 0; index < payload.size(); ++index)
+		{
+			payload[index] = (char)(index * 7);
+		}
+
+		EXPECT_TRUE(cipher.encrypt(payload, header));
+
+		return payload;
+	}
+}
+
+TEST(chunk_cipher, round_trips_a_chunk)
+{
+	chunk_cipher cipher("secret");
+	auto header = header_of("file", 4096);
+	auto payload = sealed(cipher, header);
+	EXPECT_NE(header.flags & chunk_header::encrypted, 0);
+
+	// another instance under the same secret, as on the receiving end
+	const chunk_cipher receiver("secret");
+	ASSERT_TRUE(receiver.decrypt(payload, header));
+	ASSERT_EQ(payload.size(), 1000);
+	EXPECT_EQ(payload[999], (char)(999 * 7));
+}
+
+TEST(chunk_cipher, rejects_a_changed_tag_or_payload)
+{
+	chunk_cipher cipher("secret");
+	auto header = header_of("file", 0);
+	const auto payload = sealed(cipher, header);
+
+	auto tag = payload;
+	tag.back() ^= 1;
+	EXPECT_FALSE(cipher.decrypt(tag, header));
+
+	auto body = payload;
+	body[body.size() / 2] ^= 1;
+	EXPECT_FALSE(cipher.decrypt(body, header));
+
+	auto cut = payload;
+	cut.resize(8);
+	EXPECT_FALSE(cipher.decrypt(cut, header));
+}
+
+TEST(chunk_cipher, rejects_a_chunk_moved_to_another_header)
+{
+	chunk_cipher cipher("secret");
+	auto header = header_of("file", 0);
+	const auto payload = sealed(cipher, header);
+
+	auto moved = payload;
+	EXPECT_FALSE(cipher.decrypt(moved, header_of("file", 1000)));
+
+	moved = payload;
+	EXPECT_FALSE(cipher.decrypt(moved, header_of("other", 0)));
+
+	auto other_transfer = header;
+	other_transfer.indication_id = "other";
+	moved = payload;
+	EXPECT_FALSE(cipher.decrypt(moved, other_transfer));
+}
+
+TEST(chunk_cipher, rejects_another_secret)
+{
+	chunk_cipher cipher("secret");
+	auto header = header_of("file", 0);
+	auto payload = sealed(cipher, header);
+
+	const chunk_cipher other("other secret");
+	EXPECT_FALSE(other.decrypt(payload, header));
+}
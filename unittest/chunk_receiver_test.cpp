@@ -0,0 +1,231 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include "chunk_frame.h"
+#include "chunk_receiver.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	class chunk_receiver_test : public ::testing::Test
+	{
+	protected:
+		void SetUp(void) override
+		{
+			_directory = filesystem::temp_directory_path()
+						 / "chunk_receiver_test";
+			filesystem::remove_all(_directory);
+			filesystem::create_directories(_directory / "root");
+
+			_receiver = make_unique<chunk_receiver>(
+				io_options(),
+				[](const string&, const string&, const uint64_t&) {},
+				[this](const string&, const string&, const bool& received,
+					   const uint32_t&)
+				{
+					if (received)
+					{
+						++_received;
+					}
+				});
+			_receiver->set_root((_directory / "root").string());
+			_receiver->set_registry(
+				[](const string& indication_id, const string& file_path)
+				{
+					return indication_id == "transfer"
+						   && (file_path == "file" || file_path == "../file"
+							   || file_path == "link");
+				});
+			_receiver->set_chunk_limit(1 << 20);
+			ASSERT_TRUE(_receiver->start(0));
+		}
+
+		void TearDown(void) override
+		{
+			_receiver.reset();
+			filesystem::remove_all(_directory);
+		}
+
+		chunk_header header(const string& file_path,
+							const uint32_t& size) const
+		{
+			chunk_header result;
+			result.indication_id = "transfer";
+			result.file_path = file_path;
+			result.file_size = size;
+			result.original_size = size;
+			result.size = size;
+
+			return result;
+		}
+
+		// sends the frame and tells whether the receiver cut the connection
+		// rather than waiting for the next one
+		bool refused(const chunk_header& frame_header,
+					 const vector<char>& payload = {})
+		{
+			const int connection = socket(AF_INET, SOCK_STREAM, 0);
+			sockaddr_in address{};
+			address.sin_family = AF_INET;
+			address.sin_port = htons(_receiver->port());
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			if (connect(connection, (sockaddr*)&address, sizeof(address)) != 0)
+			{
+				close(connection);
+				return false;
+			}
+
+			vector<char> frame;
+			encode_header(frame_header, frame);
+			frame.insert(frame.end(), payload.begin(), payload.end());
+			send(connection, frame.data(), frame.size(), MSG_NOSIGNAL);
+
+			timeval timeout{ 1, 0 };
+			setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+					   sizeof(timeout));
+			// a reset counts as a cut too, as the receiver drops the payload
+			// it did not read
+			char byte = 0;
+			ssize_t result = 0;
+			do
+			{
+				result = recv(connection, &byte, 1, 0);
+			} while (result < 0 && errno == EINTR);
+			const bool cut = result == 0
+							 || (result < 0 && errno != EAGAIN
+								 && errno != EWOULDBLOCK);
+			close(connection);
+
+			return cut;
+		}
+
+		filesystem::path _directory;
+		unique_ptr<chunk_receiver> _receiver;
+		atomic<int> _received{ 0 };
+	};
+}
+
+TEST_F(chunk_receiver_test, writes_registered_file)
+{
+	const vector<char> payload(4096, 'x');
+	EXPECT_FALSE(refused(header("file", 4096), payload));
+
+	for (int wait = 0; wait < 100 && _received.load() == 0; ++wait)
+	{
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+	EXPECT_EQ(_received.load(), 1);
+	EXPECT_EQ(filesystem::file_size(_directory / "root" / "file"), 4096);
+}
+
+TEST_F(chunk_receiver_test, refuses_path_out_of_root)
+{
+	EXPECT_TRUE(refused(header("../file", 16), vector<char>(16)));
+	EXPECT_FALSE(filesystem::exists(_directory / "file"));
+}
+
+TEST_F(chunk_receiver_test, refuses_unregistered_file)
+{
+	EXPECT_TRUE(refused(header("other", 16), vector<char>(16)));
+	EXPECT_FALSE(filesystem::exists(_directory / "root" / "other"));
+}
+
+TEST_F(chunk_receiver_test, refuses_oversized_chunk)
+{
+	// cut before the receiver allocates for the payload it announced
+	auto oversized = header("file", UINT32_MAX);
+	oversized.file_size = UINT64_MAX;
+	EXPECT_TRUE(refused(oversized));
+
+	auto grown = header("file", 16);
+	grown.flags = chunk_header::compressed;
+	grown.size = UINT32_MAX;
+	EXPECT_TRUE(refused(grown));
+
+	auto stored = header("file", 16);
+	stored.flags = chunk_header::stored;
+	stored.size = UINT32_MAX;
+	EXPECT_TRUE(refused(stored));
+}
+
+TEST_F(chunk_receiver_test, refuses_chunk_past_file_end)
+{
+	// offset + original_size would wrap around to a small value
+	auto wrapped = header("file", 16);
+	wrapped.file_size = 4096;
+	wrapped.offset = UINT64_MAX - 8;
+	EXPECT_TRUE(refused(wrapped, vector<char>(16)));
+}
+
+TEST_F(chunk_receiver_test, signs_only_registered_files_below_root)
+{
+	// a copy outside the root, reachable through a link inside it
+	{
+		ofstream outside(_directory / "file", ios::binary);
+		outside << string(100000, 's');
+	}
+	filesystem::create_symlink(_directory / "file",
+							   _directory / "root" / "link");
+
+	auto request = header("file", 0);
+	request.flags = chunk_header::signatures;
+	request.file_size = 100000;
+	request.size = 8192;
+
+	// a registered file without a copy is answered with no signatures
+	EXPECT_FALSE(refused(request));
+
+	request.file_path = "../file";
+	EXPECT_TRUE(refused(request));
+
+	request.file_path = "link";
+	EXPECT_TRUE(refused(request));
+
+	request.file_path = "other";
+	EXPECT_TRUE(refused(request));
+}
@@ -0,0 +1,302 @@
+/*****************************************************************************
+BSD 3-Clause License
+
+Copyright (c) 2021, 🍀☀🌕🌥 🌊
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include "file_index.h"
+#include "file_manager.h"
+#include "path_manifest.h"
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	uint64_t count_of(shared_ptr<value_container> message, const string& name)
+	{
+		return message->get_value(name)->to_ullong();
+	}
+
+	// settles a and b of a, b and c, damages the journal it left with
+	// damage and tells whether the restored transfer only kept a
+	bool keeps_intact_entries(
+		const function<void(const filesystem::path&)>& damage)
+	{
+		const auto directory
+			= filesystem::temp_directory_path() / "file_manager_test_replay";
+		filesystem::remove_all(directory);
+		filesystem::create_directories(directory);
+
+		file_manager_options options;
+		options.journal_path = (directory / "transfers").string();
+		{
+			file_manager manager(options);
+			manager.set("transfer", "source", "sub",
+						vector<string>{ "a", "b", "c" });
+			manager.received("transfer", "a");
+			manager.received("transfer", "b");
+		}
+
+		for (auto& item : filesystem::directory_iterator(directory))
+		{
+			if (item.path().extension() == ".wal")
+			{
+				damage(item.path());
+			}
+		}
+
+		bool result = false;
+		{
+			file_manager manager(options);
+			result = manager.received("transfer", "a") == nullptr
+					 && manager.received("transfer", "b") != nullptr;
+			auto message = manager.received("transfer", "c");
+			result = result && message != nullptr
+					 && count_of(message, "completed_count") == 3;
+		}
+
+		filesystem::remove_all(directory);
+
+		return result;
+	}
+}
+
+TEST(file_index, finds_listed_paths_only)
+{
+	vector<string> file_list;
+	for (int index = 0; index < 1000; ++index)
+	{
+		file_list.push_back("dir/file" + to_string(index));
+	}
+
+	file_index files(file_list);
+	ASSERT_EQ(files.size(), file_list.size());
+	for (uint32_t index = 0; index < files.size(); ++index)
+	{
+		EXPECT_EQ(files.find(file_list[index]), index);
+		EXPECT_EQ(files.path(index), file_list[index]);
+	}
+
+	EXPECT_EQ(files.find("dir/file1000"), file_index::npos);
+	EXPECT_EQ(files.find("dir/file"), file_index::npos);
+	EXPECT_EQ(files.find(""), file_index::npos);
+	EXPECT_EQ(file_index().find("dir/file0"), file_index::npos);
+}
+
+TEST(file_index, drops_repeated_paths)
+{
+	path_manifest file_list;
+	for (auto& file_path : { "a", "b", "a", "c", "b" })
+	{
+		file_list.push_back(file_path);
+	}
+
+	vector<uint32_t> positions;
+	file_index files(std::move(file_list), &positions);
+	ASSERT_EQ(files.size(), 3);
+	EXPECT_EQ(positions, (vector<uint32_t>{ 0, 1, 0, 2, 1 }));
+	EXPECT_EQ(files.find("c"), 2);
+
+	EXPECT_TRUE(files.mark(files.find("a")));
+	EXPECT_FALSE(files.mark(files.find("a")));
+	EXPECT_TRUE(files.marked(0));
+	EXPECT_FALSE(files.settled(1));
+}
+
+TEST(file_manager, repeated_failure_is_counted_once)
+{
+	file_manager manager;
+	ASSERT_TRUE(manager.set("transfer", "source", "sub",
+							vector<string>{ "a", "b", "c" }));
+
+	const bool failed[] = { false };
+	vector<string> paths{ "a" };
+
+	manager.received_batch("transfer", paths, span(failed));
+	manager.received_batch("transfer", paths, span(failed));
+	manager.received("transfer", "b");
+
+	auto message = manager.received("transfer", "c");
+	ASSERT_NE(message, nullptr);
+	EXPECT_EQ(count_of(message, "completed_count"), 2);
+	EXPECT_EQ(count_of(message, "failed_count"), 1);
+}
+
+TEST(file_manager, failure_then_success_is_counted_once)
+{
+	file_manager manager;
+	ASSERT_TRUE(manager.set("transfer", "source", "sub",
+							vector<string>{ "a", "b" }));
+
+	const bool failed[] = { false };
+	vector<string> paths{ "a" };
+
+	manager.received_batch("transfer", paths, span(failed));
+	// the success arriving late must not complete the transfer early
+	EXPECT_EQ(manager.received("transfer", "a"), nullptr);
+	EXPECT_FALSE(manager.expects("transfer", "a"));
+	EXPECT_TRUE(manager.expects("transfer", "b"));
+
+	auto message = manager.received("transfer", "b");
+	ASSERT_NE(message, nullptr);
+	EXPECT_EQ(count_of(message, "completed_count"), 1);
+	EXPECT_EQ(count_of(message, "failed_count"), 1);
+}
+
+TEST(file_manager, failures_without_path_are_counted)
+{
+	file_manager manager;
+	ASSERT_TRUE(manager.set("transfer", "source", "sub",
+							vector<string>{ "a", "b" }));
+
+	manager.received("transfer", "");
+
+	auto message = manager.received("transfer", "a");
+	ASSERT_NE(message, nullptr);
+	EXPECT_EQ(count_of(message, "completed_count"), 1);
+	EXPECT_EQ(count_of(message, "failed_count"), 1);
+}
+
+TEST(file_manager, journal_restores_failed_files)
+{
+	const auto directory
+		= filesystem::temp_directory_path() / "file_manager_test_journal";
+	filesystem::remove_all(directory);
+	filesystem::create_directories(directory);
+
+	file_manager_options options;
+	options.journal_path = (directory / "transfers").string();
+
+	const bool failed[] = { false };
+	vector<string> paths{ "a" };
+	{
+		file_manager manager(options);
+		ASSERT_TRUE(manager.set("transfer", "source", "sub",
+								vector<string>{ "a", "b" }));
+		manager.received_batch("transfer", paths, span(failed));
+	}
+
+	file_manager manager(options);
+	EXPECT_EQ(manager.received_batch("transfer", paths, span(failed)),
+			  nullptr);
+	EXPECT_EQ(manager.received("transfer", "a"), nullptr);
+
+	auto message = manager.received("transfer", "b");
+	ASSERT_NE(message, nullptr);
+	EXPECT_EQ(count_of(message, "completed_count"), 1);
+	EXPECT_EQ(count_of(message, "failed_count"), 1);
+
+	filesystem::remove_all(directory);
+}
+
+TEST(transfer_journal, replay_stops_at_torn_entry)
+{
+	EXPECT_TRUE(keeps_intact_entries(
+		[](const filesystem::path& file_path)
+		{
+			filesystem::resize_file(file_path,
+									filesystem::file_size(file_path) - 1);
+		}));
+}
+
+TEST(transfer_journal, replay_stops_at_corrupted_entry)
+{
+	EXPECT_TRUE(keeps_intact_entries(
+		[](const filesystem::path& file_path)
+		{
+			fstream file(file_path,
+						 ios::in | ios::out | ios::binary | ios::ate);
+			const auto last = (streamoff)file.tellg() - 1;
+			file.seekg(last);
+			const char byte = (char)(file.get() ^ 0xFF);
+			file.seekp(last);
+			file.put(byte);
+		}));
+}
+
+TEST(path_manifest, round_trips_paths)
+{
+	vector<string> file_list;
+	for (int index = 0; index < 100; ++index)
+	{
+		// shared prefixes of every length, across block boundaries
+		file_list.push_back("root/dir" + to_string(index / 10) + "/file"
+							+ to_string(index));
+	}
+	file_list.push_back("");
+	file_list.push_back("root");
+
+	path_manifest manifest;
+	for (auto& file_path : file_list)
+	{
+		manifest.push_back(file_path);
+	}
+	manifest.shrink_to_fit();
+
+	ASSERT_EQ(manifest.size(), file_list.size());
+	for (uint32_t index = 0; index < manifest.size(); ++index)
+	{
+		EXPECT_EQ(manifest.path(index), file_list[index]);
+		EXPECT_TRUE(manifest.equals(index, file_list[index]));
+	}
+	EXPECT_FALSE(manifest.equals(1, file_list[2]));
+
+	uint32_t visited = 0;
+	manifest.for_each(
+		[&](const uint32_t& index, string_view file_path)
+		{
+			EXPECT_EQ(index, visited++);
+			EXPECT_EQ(file_path, file_list[index]);
+		});
+	EXPECT_EQ(visited, file_list.size());
+
+	path_manifest converted(file_list);
+	ASSERT_EQ(converted.size(), file_list.size());
+	EXPECT_EQ(converted.path(57), file_list[57]);
+}
+
+TEST(file_manager, sets_transfer_from_manifest)
+{
+	path_manifest manifest;
+	manifest.push_back("a");
+	manifest.push_back("b");
+
+	file_manager manager;
+	ASSERT_TRUE(manager.set("transfer", "source", "sub", std::move(manifest)));
+	EXPECT_TRUE(manager.expects("transfer", "b"));
+	EXPECT_FALSE(manager.expects("transfer", "c"));
+}